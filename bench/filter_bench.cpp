@@ -0,0 +1,686 @@
+/**
+ * Latency benchmark of the filter steps and replay throughput.
+ *
+ * The dataset is replayed through the filters several times. Within every
+ * replay each Prediction and update call is timed on its own, so the samples
+ * come from realistic filter states. UpdateLidarUnscented is timed on a copy
+ * of the UKF taken right before the linear lidar update, so both lidar
+ * updates see the same state. The end-to-end section times ProcessMeasurement
+ * over whole replays and reports measurements per second. The epoch section
+ * moves every radar measurement onto the timestamp of the lidar measurement
+ * before it and compares processing both one by one with one
+ * ProcessMeasurements call per pair. The fast trig section repeats the
+ * end-to-end replays with the polynomial sine and cosine. The churn section
+ * keeps a set of live tracks and replaces one of them after every few
+ * measurements, with the filters on the heap or in a SlabPool. The precision
+ * section times the CTRV kernel over a large structure-of-arrays batch in
+ * double and float, checks every available kernel against the scalar
+ * reference and compares the RMSE and NIS of replays with float sigma
+ * points to the double ones. The lazy section replays with the lidar
+ * measurements ignored, eagerly predicted and left pending. The gate
+ * section adds clutter to the dataset and compares the RMSE of replays with
+ * and without the NIS gate, then checks that a stacked epoch update applies
+ * exactly the measurements the gate accepted. The association section
+ * tracks a grid of objects in a UKFBank and associates their shuffled
+ * returns with the TrackAssociator, pruned by its grid and over all pairs.
+ * The snapshot section writes and restores the filters of many tracks. The
+ * last line prints the bytes of one track.
+ *
+ * Usage: FilterBench [input_file] [passes] [ctrv_kernel]
+ */
+#include "ukf.h"
+#include "ekf.h"
+#include "ukf_bank.h"
+#include "measurement_model.h"
+#include "association.h"
+#include "counter_rng.h"
+#include "filter_snapshot.h"
+#include "sensor_log.h"
+#include "epoch_batcher.h"
+#include "replay.h"
+#include "slab_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// process noise used by the main program
+const double kStdA = 0.6;
+const double kStdYawdd = 0.4;
+
+double Nanoseconds(Clock::time_point start, Clock::time_point stop) {
+  return chrono::duration<double, nano>(stop - start).count();
+}
+
+/**
+ * Collects per call latencies of one operation
+ */
+class LatencySamples {
+public:
+  explicit LatencySamples(const char* name) : name_(name) {}
+
+  void Add(double ns) { samples_.push_back(ns); }
+
+  double Percentile(double q) {
+    size_t k = static_cast<size_t>(q * (samples_.size() - 1));
+    nth_element(samples_.begin(), samples_.begin() + k, samples_.end());
+    return samples_[k];
+  }
+
+  void Report() {
+    if (samples_.empty()) {
+      printf("%-28s no samples\n", name_);
+      return;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < samples_.size(); i++)
+      sum += samples_[i];
+    double min = *min_element(samples_.begin(), samples_.end());
+    double p50 = Percentile(0.50);
+    double p99 = Percentile(0.99);
+    printf("%-28s %9zu calls  mean %9.1f ns  min %9.1f ns  p50 %9.1f ns  p99 %9.1f ns\n",
+           name_, samples_.size(), sum / samples_.size(), min, p50, p99);
+  }
+
+private:
+  const char* name_;
+  vector<double> samples_;
+};
+
+/**
+ * Times the unscented lidar update on a copy of the filter, so the linear
+ * update which follows sees the same state. The EKF has no unscented update.
+ */
+void TimeUpdateLidarUnscented(const UKF& filter, const MeasurementPackage& meas, LatencySamples* samples) {
+  UKF probe = filter;
+  Clock::time_point start = Clock::now();
+  probe.UpdateLidarUnscented(meas);
+  samples->Add(Nanoseconds(start, Clock::now()));
+}
+
+void TimeUpdateLidarUnscented(const EKF&, const MeasurementPackage&, LatencySamples*) {}
+
+/**
+ * Replays the dataset through one filter and times the single steps. The
+ * steps are called in the same order as in ProcessMeasurement. The first
+ * measurement initializes the filter.
+ */
+template <class F>
+void ReplaySteps(F* filter, const vector<MeasurementPackage>& dataset, LatencySamples* prediction,
+                 LatencySamples* update_lidar, LatencySamples* update_radar,
+                 LatencySamples* update_lidar_unscented) {
+  filter->ProcessMeasurement(dataset[0]);
+  for (size_t i = 1; i < dataset.size(); i++) {
+    const MeasurementPackage& meas = dataset[i];
+    double dt = (meas.timestamp_ - filter->time_us_) / 1.0e6;
+    filter->time_us_ = meas.timestamp_;
+    filter->state_us_ = meas.timestamp_;
+    filter->timestep_++;
+
+    Clock::time_point start = Clock::now();
+    filter->Prediction(dt);
+    prediction->Add(Nanoseconds(start, Clock::now()));
+
+    if (meas.sensor_type_ == MeasurementPackage::LASER) {
+      if (update_lidar_unscented)
+        TimeUpdateLidarUnscented(*filter, meas, update_lidar_unscented);
+      start = Clock::now();
+      filter->UpdateLidar(meas);
+      update_lidar->Add(Nanoseconds(start, Clock::now()));
+    } else {
+      start = Clock::now();
+      filter->UpdateRadar(meas);
+      update_radar->Add(Nanoseconds(start, Clock::now()));
+    }
+  }
+}
+
+/**
+ * Times ProcessMeasurement per call and for whole replays
+ */
+void ReplayThroughput(const char* name, Filter* (*create)(), const vector<MeasurementPackage>& dataset,
+                      int passes) {
+  LatencySamples latency(name);
+  double total_ns = 0;
+  for (int pass = 0; pass < passes; pass++) {
+    Filter* filter = create();
+    Clock::time_point replay_start = Clock::now();
+    for (size_t i = 0; i < dataset.size(); i++) {
+      Clock::time_point start = Clock::now();
+      filter->ProcessMeasurement(dataset[i]);
+      latency.Add(Nanoseconds(start, Clock::now()));
+    }
+    total_ns += Nanoseconds(replay_start, Clock::now());
+    delete filter;
+  }
+  latency.Report();
+  double measurements = static_cast<double>(passes) * dataset.size();
+  printf("%-28s %9.0f measurements  %8.3f s  %10.0f measurements/s\n",
+         name, measurements, total_ns * 1e-9, measurements / (total_ns * 1e-9));
+}
+
+/**
+ * Times whole replays with the measurements grouped into fusion epochs
+ */
+void ReplayEpochThroughput(const char* name, Filter* (*create)(), const vector<MeasurementPackage>& dataset,
+                           long tolerance_us, int passes) {
+  double total_ns = 0;
+  for (int pass = 0; pass < passes; pass++) {
+    Filter* filter = create();
+    EpochBatcher batcher(tolerance_us);
+    auto process_epoch = [filter](const MeasurementPackage* batch, int n) {
+      filter->ProcessMeasurements(batch, n);
+    };
+    Clock::time_point replay_start = Clock::now();
+    for (size_t i = 0; i < dataset.size(); i++)
+      batcher.Add(dataset[i], process_epoch);
+    batcher.Flush(process_epoch);
+    total_ns += Nanoseconds(replay_start, Clock::now());
+    delete filter;
+  }
+  double measurements = static_cast<double>(passes) * dataset.size();
+  printf("%-28s %9.0f measurements  %8.3f s  %10.0f measurements/s\n",
+         name, measurements, total_ns * 1e-9, measurements / (total_ns * 1e-9));
+}
+
+/**
+ * A filter kept in the storage of its slot
+ */
+struct PooledFilter {
+  Filter* filter;
+  FilterStorage storage;
+};
+
+/**
+ * Spawns, updates and retires tracks. Every track processes
+ * kChurnMeasurements measurements before it is replaced by a new one at a
+ * pseudo random position of the live set.
+ */
+void TrackChurn(const char* name, bool pooled, const vector<MeasurementPackage>& dataset, int passes) {
+  const int kLiveTracks = 1024;
+  const int kChurnMeasurements = 4;
+  FilterConfig config;
+  config.std_a = kStdA;
+  config.std_yawdd = kStdYawdd;
+
+  SlabPool<PooledFilter> pool;
+  vector<Filter*> heap(kLiveTracks, NULL);
+  vector<PooledFilter*> slots(kLiveTracks, NULL);
+  long spawned = 0;
+  Clock::time_point start = Clock::now();
+  for (int pass = 0; pass < passes; pass++) {
+    for (size_t i = 0; i + kChurnMeasurements <= dataset.size(); i += kChurnMeasurements) {
+      size_t k = (i * 2654435761u + pass) % kLiveTracks;
+      Filter* filter;
+      if (pooled) {
+        if (slots[k] != NULL) {
+          slots[k]->filter->~Filter();
+          pool.Destroy(slots[k]);
+        }
+        slots[k] = pool.Create();
+        filter = slots[k]->filter = CreateFilter(config, &slots[k]->storage);
+      } else {
+        delete heap[k];
+        filter = heap[k] = CreateFilter(config);
+      }
+      spawned++;
+      for (int m = 0; m < kChurnMeasurements; m++)
+        filter->ProcessMeasurement(dataset[i + m]);
+    }
+  }
+  double total_ns = Nanoseconds(start, Clock::now());
+  for (int k = 0; k < kLiveTracks; k++) {
+    delete heap[k];
+    if (slots[k] != NULL)
+      slots[k]->filter->~Filter();
+  }
+  printf("%-28s %9ld tracks  %8.3f s  %10.0f tracks/s  %6.0f ns per spawn+update+retire\n",
+         name, spawned, total_ns * 1e-9, spawned / (total_ns * 1e-9), total_ns / spawned);
+}
+
+CtrvKernel ctrv_kernel = CTRV_KERNEL_AUTO;
+
+Filter* CreateUKF() {
+  UKF* ukf = new UKF(false, true, true, kStdA, kStdYawdd);
+  ukf->ctrv_kernel_ = ctrv_kernel;
+  return ukf;
+}
+
+Filter* CreateEKF() {
+  return new EKF(false, true, true, kStdA, kStdYawdd);
+}
+
+Filter* CreateUKFFloat() {
+  UKF* ukf = static_cast<UKF*>(CreateUKF());
+  ukf->ctrv_precision_ = CTRV_PRECISION_FLOAT;
+  return ukf;
+}
+
+Filter* CreateUKFRadarOnly() {
+  UKF* ukf = new UKF(false, false, true, kStdA, kStdYawdd);
+  ukf->ctrv_kernel_ = ctrv_kernel;
+  return ukf;
+}
+
+Filter* CreateUKFRadarOnlyLazy() {
+  Filter* filter = CreateUKFRadarOnly();
+  filter->lazy_prediction_ = true;
+  return filter;
+}
+
+Filter* CreateUKFFastTrig() {
+  Filter* filter = CreateUKF();
+  filter->trig_mode_ = TRIG_FAST;
+  return filter;
+}
+
+Filter* CreateEKFFastTrig() {
+  Filter* filter = CreateEKF();
+  filter->trig_mode_ = TRIG_FAST;
+  return filter;
+}
+
+template <class T>
+struct KernelInput {
+  vector<T> aug[7], pred[5], dt;
+  CtrvSigmaPointsT<T> points;
+
+  explicit KernelInput(int n) : dt(n, T(0.05)) {
+    for (int k = 0; k < 7; k++) {
+      aug[k].resize(n);
+      for (int i = 0; i < n; i++)
+        aug[k][i] = T(0.001 * ((i * (k + 3)) % 997) - (k >= 5 ? 0.5 : 0.0));
+      points.aug[k] = aug[k].data();
+    }
+    for (int k = 0; k < 5; k++) {
+      pred[k].resize(n);
+      points.pred[k] = pred[k].data();
+    }
+    points.delta_t = dt.data();
+    points.n = n;
+    points.fast_trig = false;
+  }
+};
+
+/**
+ * Times the CTRV kernel over kPoints sigma points in structure-of-arrays
+ * layout, as UKFBank passes them, with scalar type T
+ */
+template <class T>
+void KernelThroughput(const char* name, int passes) {
+  const int kPoints = 15 * 4096;
+  KernelInput<T> input(kPoints);
+
+  Clock::time_point start = Clock::now();
+  for (int pass = 0; pass < passes; pass++)
+    CtrvPredict(input.points, ctrv_kernel);
+  double total_ns = Nanoseconds(start, Clock::now());
+  double n = static_cast<double>(passes) * kPoints;
+  printf("%-28s %9.0f sigma points  %8.3f s  %8.2f ns/point\n", name, n, total_ns * 1e-9, total_ns / n);
+}
+
+/**
+ * Checks that every kernel the cpu supports predicts the same sigma points as
+ * the scalar reference, up to tolerance relative to max(1, |reference|).
+ * The point count is not a multiple of any register width, so the tail of
+ * each kernel is checked too.
+ */
+template <class T>
+bool KernelCheck(const char* name, double tolerance) {
+  const int kPoints = 15 * 64 + 7;
+  KernelInput<T> reference(kPoints), input(kPoints);
+  CtrvPredictScalar(reference.points);
+
+  bool ok = true;
+  printf("%-28s", name);
+  for (int kernel = CTRV_KERNEL_AVX2; kernel <= CTRV_KERNEL_NEON; kernel++) {
+    if (!CtrvKernelAvailable(static_cast<CtrvKernel>(kernel)))
+      continue;
+    CtrvPredict(input.points, static_cast<CtrvKernel>(kernel));
+    double max_error = 0;
+    for (int k = 0; k < 5; k++)
+      for (int i = 0; i < kPoints; i++) {
+        double ref = reference.pred[k][i];
+        double error = fabs(input.pred[k][i] - ref) / max(1.0, fabs(ref));
+        // a NaN error fails the check as well
+        if (!(error <= max_error))
+          max_error = error;
+      }
+    bool kernel_ok = max_error <= tolerance;
+    ok = ok && kernel_ok;
+    printf(" %s %.1e %s ", CtrvKernelName(static_cast<CtrvKernel>(kernel)), max_error, kernel_ok ? "ok" : "failed");
+  }
+  printf(" tolerance %.0e\n", tolerance);
+  return ok;
+}
+
+/**
+ * Replays the dataset with double and float sigma points and prints the
+ * RMSE and the NIS consistency of both
+ */
+void PrecisionReport(const vector<MeasurementPackage>& dataset) {
+  static const CtrvPrecision precisions[2] = {CTRV_PRECISION_DOUBLE, CTRV_PRECISION_FLOAT};
+  ReplayResult results[2];
+  for (int p = 0; p < 2; p++) {
+    FilterConfig config;
+    config.std_a = kStdA;
+    config.std_yawdd = kStdYawdd;
+    config.ctrv_kernel = ctrv_kernel;
+    config.ctrv_precision = precisions[p];
+    results[p] = Replay(config, dataset);
+    const ReplayResult& r = results[p];
+    printf("%-28s RMSE %.6f %.6f %.6f %.6f  NIS out laser %5.2f%%  radar %5.2f%%\n",
+           p == 0 ? "UKF double sigma points" : "UKF float sigma points",
+           r.rmse(0), r.rmse(1), r.rmse(2), r.rmse(3), r.nis_laser_percent, r.nis_radar_percent);
+  }
+  double max_rel = 0;
+  for (int k = 0; k < 4; k++)
+    max_rel = max(max_rel, fabs(results[1].rmse(k) - results[0].rmse(k)) / results[0].rmse(k));
+  printf("%-28s max relative RMSE change %.2e\n", "float vs double", max_rel);
+}
+
+/**
+ * Replaces every kClutterEvery-th measurement of the dataset by one kClutter
+ * off the object and replays it with every NIS gate
+ */
+void GateReport(const vector<MeasurementPackage>& dataset) {
+  const size_t kClutterEvery = 25;
+  const double kClutter = 8.0;
+  vector<MeasurementPackage> cluttered = dataset;
+  long clutter = 0;
+  for (size_t i = kClutterEvery / 2; i < cluttered.size(); i += kClutterEvery, clutter++) {
+    MeasurementPackage& meas = cluttered[i];
+    meas.raw_measurements_(0) += kClutter;
+    if (meas.sensor_type_ == MeasurementPackage::LASER)
+      meas.raw_measurements_(1) -= kClutter;
+  }
+
+  for (int g = NIS_GATE_OFF; g <= NIS_GATE_999; g++) {
+    FilterConfig config;
+    config.std_a = kStdA;
+    config.std_yawdd = kStdYawdd;
+    config.ctrv_kernel = ctrv_kernel;
+    config.nis_gate = static_cast<NisGate>(g);
+    Clock::time_point start = Clock::now();
+    ReplayResult r = Replay(config, cluttered);
+    double total_ns = Nanoseconds(start, Clock::now());
+    printf("UKF clutter, NIS gate %-5d RMSE %.6f %.6f %.6f %.6f  gated %3ld laser %3ld radar of %ld clutter"
+           "  %8.1f ns/measurement\n", NisGatePercent(config.nis_gate), r.rmse(0), r.rmse(1), r.rmse(2), r.rmse(3),
+           r.gated_laser, r.gated_radar, clutter, total_ns / r.measurements);
+  }
+}
+
+
+/**
+ * Checks that a stacked epoch update applies exactly the measurements the
+ * gate accepted. The filter is at the end of a rejection run, so the first
+ * lidar measurement passes although it is outside the gate, the radar
+ * measurement resets the run and the last lidar measurement is rejected.
+ * The result must equal an ungated stacked update of the first two.
+ * @return false if the gate applied another set of measurements
+ */
+bool GateRunCheck() {
+  UKF ukf(false, true, true, kStdA, kStdYawdd);
+  ukf.ctrv_kernel_ = ctrv_kernel;
+  ukf.x_ << 5.0, 2.0, 3.0, 0.3, 0.1;
+  ukf.P_ = 0.1 * StateMatrix::Identity();
+  ukf.is_initialized_ = true;
+  ukf.timestep_ = 1;
+  ukf.Prediction(0.1);
+
+  MeasurementPackage epoch[3];
+  epoch[0].sensor_type_ = MeasurementPackage::LASER;
+  epoch[0].raw_measurements_ = LaserMeasurement::Vector(ukf.x_(0) + 20.0, ukf.x_(1));
+  RadarMeasurement::Vector z;
+  RadarModel()(ukf.x_, &z);
+  epoch[1].sensor_type_ = MeasurementPackage::RADAR;
+  epoch[1].raw_measurements_ = z;
+  epoch[2].sensor_type_ = MeasurementPackage::LASER;
+  epoch[2].raw_measurements_ = LaserMeasurement::Vector(ukf.x_(0), ukf.x_(1) - 20.0);
+
+  UKF reference = ukf;
+  const MeasurementPackage* applied[] = {&epoch[0], &epoch[1]};
+  reference.UpdateStacked<EpochMeasurement>(applied, 2);
+
+  ukf.nis_gate_ = NIS_GATE_99;
+  ukf.gated_run_ = kMaxGatedRun;
+  ukf.UpdateEpoch(epoch, 3);
+
+  bool ok = ukf.gated_laser_counter_ == 1 && ukf.gated_radar_counter_ == 0 && ukf.gated_run_ == 1 &&
+            (ukf.x_ - reference.x_).norm() < 1e-12 && (ukf.P_ - reference.P_).norm() < 1e-12;
+  printf("%-28s %s\n", "UKF gate run in an epoch", ok ? "ok" : "failed");
+  return ok;
+}
+
+
+/**
+ * Tracks kSide x kSide objects kSpacing apart which move straight with
+ * their own heading. Every frame each object returns one radar measurement,
+ * or one lidar measurement on odd frames, in random order and without its
+ * track id. Only the association is timed.
+ */
+void AssociationThroughput(const char* name, double max_distance, int frames) {
+  const int kSide = 32;
+  const double kSpacing = 6.0;
+  const double kDt = 0.1;
+  const double kSpeed = 3.0;
+  const int n = kSide * kSide;
+  const FilterModelConfig& model = FilterModelConfig::Default();
+  CounterRng rng(1);
+
+  UKFBank bank(kStdA, kStdYawdd);
+  vector<StateVector> truth(n);
+  StateMatrix P = StateMatrix::Identity();
+  P(0, 0) = P(1, 1) = 0.1;
+  for (int k = 0; k < n; k++) {
+    truth[k] << 20.0 + kSpacing * (k % kSide), -kSide * kSpacing / 2 + kSpacing * (k / kSide),
+                kSpeed, 2.0 * M_PI * k / n, 0.0;
+    bank.AddTrack(truth[k], P);
+  }
+
+  TrackAssociator associator(max_distance);
+  TrackAssociator::Result result;
+  vector<MeasurementPackage> frame(n);
+  vector<int> order(n);
+  mt19937 shuffle_rng(1);
+  long correct = 0, candidates = 0;
+  double total_ns = 0;
+  for (int f = 0; f < frames; f++) {
+    for (int k = 0; k < n; k++) {
+      truth[k](0) += kSpeed * cos(truth[k](3)) * kDt;
+      truth[k](1) += kSpeed * sin(truth[k](3)) * kDt;
+      order[k] = k;
+    }
+    shuffle(order.begin(), order.end(), shuffle_rng);
+    for (int m = 0; m < n; m++) {
+      const StateVector& x = truth[order[m]];
+      MeasurementPackage& meas = frame[m];
+      double n0, n1, n2, unused;
+      rng.Normal2(f, order[m], 0, &n0, &n1);
+      if (f % 2 == 1) {
+        meas.sensor_type_ = MeasurementPackage::LASER;
+        meas.raw_measurements_.resize(2);
+        meas.raw_measurements_ << x(0) + model.std_laspx * n0, x(1) + model.std_laspy * n1;
+      } else {
+        rng.Normal2(f, order[m], 1, &n2, &unused);
+        const double rho = sqrt(x(0)*x(0) + x(1)*x(1));
+        meas.sensor_type_ = MeasurementPackage::RADAR;
+        meas.raw_measurements_.resize(3);
+        meas.raw_measurements_ << rho + model.std_radr * n0, atan2(x(1), x(0)) + model.std_radphi * n1,
+                                  (x(0)*cos(x(3)) + x(1)*sin(x(3))) * x(2) / rho + model.std_radrd * n2;
+      }
+    }
+
+    bank.Prediction(kDt);
+    bank.PredictRadarMeasurement();
+    Clock::time_point start = Clock::now();
+    associator.Associate(bank, frame.data(), n, &result);
+    total_ns += Nanoseconds(start, Clock::now());
+    bank.UpdateRadar(result.radar);
+    bank.UpdateLidar(result.lidar);
+
+    candidates += result.candidates;
+    for (int m = 0; m < n; m++)
+      correct += (result.track[m] == order[m]);
+  }
+  const double returns = static_cast<double>(frames) * n;
+  printf("%-28s %6d tracks  %9.1f us/frame  %7.1f candidates per return  %6.2f%% correct\n",
+         name, n, total_ns * 1e-3 / frames, candidates / returns, 100.0 * correct / returns);
+}
+
+
+/**
+ * Writes a snapshot of kTracks UKF tracks, each warmed up on the start of
+ * the dataset, and restores it into new filters
+ */
+void SnapshotThroughput(const vector<MeasurementPackage>& dataset) {
+  const int kTracks = 10000;
+  const size_t kWarmup = min<size_t>(dataset.size(), 20);
+  const char* const path = "filter_bench_snapshot.bin";
+  vector<Filter*> tracks(kTracks), restored(kTracks);
+  for (int k = 0; k < kTracks; k++) {
+    tracks[k] = CreateUKF();
+    restored[k] = CreateUKF();
+    // every track stops at another measurement, so the states differ
+    for (size_t i = 0; i < kWarmup - k % 4; i++)
+      tracks[k]->ProcessMeasurement(dataset[i]);
+  }
+
+  Clock::time_point start = Clock::now();
+  FilterSnapshotWriter writer;
+  bool ok = writer.Open(path);
+  for (int k = 0; k < kTracks && ok; k++)
+    ok = writer.Write(k, *tracks[k]);
+  ok = writer.Close() && ok;
+  double save_ns = Nanoseconds(start, Clock::now());
+
+  start = Clock::now();
+  MappedFilterSnapshot snapshot;
+  ok = ok && snapshot.Open(path) && snapshot.Size() == static_cast<size_t>(kTracks);
+  for (int k = 0; k < kTracks && ok; k++)
+    ok = snapshot.Restore(k, restored[snapshot.Record(k).track_id]);
+  double restore_ns = Nanoseconds(start, Clock::now());
+  snapshot.Close();
+  remove(path);
+
+  long mismatches = 0;
+  for (int k = 0; k < kTracks; k++) {
+    mismatches += (memcmp(tracks[k]->x_.data(), restored[k]->x_.data(), sizeof(StateVector)) != 0 ||
+                   memcmp(tracks[k]->P_.data(), restored[k]->P_.data(), sizeof(StateMatrix)) != 0);
+    delete tracks[k];
+    delete restored[k];
+  }
+  printf("%-28s %6d tracks  save %7.2f ms  restore %7.2f ms  %zu B per track  %s\n", "UKF snapshot", kTracks,
+         save_ns * 1e-6, restore_ns * 1e-6, sizeof(FilterSnapshotRecord),
+         !ok ? "failed" : (mismatches == 0 ? "identical" : "differs"));
+}
+
+}
+
+
+int main(int argc, char* argv[]) {
+  string input_file = (argc > 1) ? argv[1] : "../data/obj_pose-laser-radar-synthetic-input.txt";
+  int passes = (argc > 2) ? atoi(argv[2]) : 200;
+  if (argc > 3 && !CtrvParseKernel(argv[3], &ctrv_kernel)) {
+    cerr << "Unknown CTRV kernel: " << argv[3] << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<MeasurementPackage> dataset;
+  TextLogReader reader;
+  if (!reader.Open(input_file)) {
+    cerr << "Cannot open input file: " << input_file << endl;
+    return EXIT_FAILURE;
+  }
+  MeasurementPackage meas_package;
+  while (reader.Next(&meas_package))
+    dataset.push_back(meas_package);
+  if (dataset.size() < 2) {
+    cerr << "Not enough measurements in " << input_file << endl;
+    return EXIT_FAILURE;
+  }
+  printf("%zu measurements, %d passes, CTRV kernel %s\n",
+         dataset.size(), passes, CtrvKernelName(CtrvResolveKernel(ctrv_kernel)));
+
+  LatencySamples ukf_prediction("UKF::Prediction");
+  LatencySamples ukf_update_lidar("UKF::UpdateLidar");
+  LatencySamples ukf_update_lidar_unscented("UKF::UpdateLidarUnscented");
+  LatencySamples ukf_update_radar("UKF::UpdateRadar");
+  for (int pass = 0; pass < passes; pass++) {
+    UKF* ukf = static_cast<UKF*>(CreateUKF());
+    ReplaySteps(ukf, dataset, &ukf_prediction, &ukf_update_lidar, &ukf_update_radar,
+                &ukf_update_lidar_unscented);
+    delete ukf;
+  }
+  ukf_prediction.Report();
+  ukf_update_lidar.Report();
+  ukf_update_lidar_unscented.Report();
+  ukf_update_radar.Report();
+
+  LatencySamples ekf_prediction("EKF::Prediction");
+  LatencySamples ekf_update_lidar("EKF::UpdateLidar");
+  LatencySamples ekf_update_radar("EKF::UpdateRadar");
+  for (int pass = 0; pass < passes; pass++) {
+    EKF* ekf = static_cast<EKF*>(CreateEKF());
+    ReplaySteps(ekf, dataset, &ekf_prediction, &ekf_update_lidar, &ekf_update_radar, NULL);
+    delete ekf;
+  }
+  ekf_prediction.Report();
+  ekf_update_lidar.Report();
+  ekf_update_radar.Report();
+
+  ReplayThroughput("UKF::ProcessMeasurement", CreateUKF, dataset, passes);
+  ReplayThroughput("EKF::ProcessMeasurement", CreateEKF, dataset, passes);
+
+  vector<MeasurementPackage> paired = dataset;
+  for (size_t i = 1; i < paired.size(); i++)
+    if (paired[i].sensor_type_ == MeasurementPackage::RADAR &&
+        paired[i-1].sensor_type_ == MeasurementPackage::LASER)
+      paired[i].timestamp_ = paired[i-1].timestamp_;
+  ReplayEpochThroughput("UKF paired, one by one", CreateUKF, paired, -1, passes);
+  ReplayEpochThroughput("UKF paired, epochs", CreateUKF, paired, 0, passes);
+  ReplayEpochThroughput("EKF paired, one by one", CreateEKF, paired, -1, passes);
+  ReplayEpochThroughput("EKF paired, epochs", CreateEKF, paired, 0, passes);
+
+  ReplayThroughput("UKF fast trig", CreateUKFFastTrig, dataset, passes);
+  ReplayThroughput("EKF fast trig", CreateEKFFastTrig, dataset, passes);
+
+  TrackChurn("UKF track churn, heap", false, dataset, passes);
+  TrackChurn("UKF track churn, pool", true, dataset, passes);
+
+  KernelThroughput<double>("CTRV kernel, double", passes);
+  KernelThroughput<float>("CTRV kernel, float", passes);
+  if (!KernelCheck<double>("CTRV kernels = scalar, double", 1e-12) ||
+      !KernelCheck<float>("CTRV kernels = scalar, float", 1e-5))
+    return EXIT_FAILURE;
+  ReplayThroughput("UKF float sigma points", CreateUKFFloat, dataset, passes);
+  PrecisionReport(dataset);
+
+  ReplayThroughput("UKF radar only, eager", CreateUKFRadarOnly, dataset, passes);
+  ReplayThroughput("UKF radar only, lazy", CreateUKFRadarOnlyLazy, dataset, passes);
+
+  GateReport(dataset);
+  if (!GateRunCheck())
+    return EXIT_FAILURE;
+
+  AssociationThroughput("GNN association, grid", 20.0, 20);
+  AssociationThroughput("GNN association, all pairs", 1e4, 20);
+
+  SnapshotThroughput(dataset);
+
+  printf("%-28s UKF %zu B  EKF %zu B  pool slot %zu B  shared FilterModelConfig %zu B\n",
+         "bytes per track", sizeof(UKF), sizeof(EKF), SlabPool<PooledFilter>::SlotSize(), sizeof(FilterModelConfig));
+  return 0;
+}
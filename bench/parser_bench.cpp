@@ -0,0 +1,217 @@
+/**
+ * Micro benchmark of the text log parsers.
+ *
+ * The bundled dataset is replicated in memory until it holds the requested
+ * number of lines (10M by default), which is then parsed with the previous
+ * istringstream based parser, with ParseMeasurement and with TextLogReader
+ * reading the replicated data from a temporary file.
+ *
+ * The last section compares the simulator message handling: the previous
+ * json.hpp round trip against ParseTelemetryFrame and FormatEstimateReply.
+ *
+ * Usage: ParserBench [input_file] [lines]
+ */
+#include "sensor_log.h"
+#include "telemetry.h"
+// json.hpp trips -Wmaybe-uninitialized in GCC, even included as a system header
+// as the warning is raised on inlined moves, so it is turned off for json.hpp alone
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include "json.hpp"
+#pragma GCC diagnostic pop
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// lines per replicated block, large enough to not fit into the caches
+const long kBlockLines = 100000;
+
+// previous per line parser of main.cpp for reference
+MeasurementPackage ParseWithStream(const string &sensor_measurement)
+{
+  MeasurementPackage meas_package;
+  istringstream iss(sensor_measurement);
+  long long timestamp;
+  float px, py, ro, theta, ro_dot, x_gt, y_gt, vx_gt, vy_gt, yaw_gt, yawrate_gt;
+  string sensor_type;
+  iss >> sensor_type;
+  if (sensor_type.compare("L") == 0) {
+    meas_package.sensor_type_ = MeasurementPackage::LASER;
+    meas_package.raw_measurements_.resize(2);
+    iss >> px >> py;
+    meas_package.raw_measurements_ << px, py;
+  } else {
+    meas_package.sensor_type_ = MeasurementPackage::RADAR;
+    meas_package.raw_measurements_.resize(3);
+    iss >> ro >> theta >> ro_dot;
+    meas_package.raw_measurements_ << ro, theta, ro_dot;
+  }
+  iss >> timestamp;
+  meas_package.timestamp_ = timestamp;
+  iss >> x_gt >> y_gt >> vx_gt >> vy_gt >> yaw_gt >> yawrate_gt;
+  meas_package.ground_truth_ << x_gt, y_gt, vx_gt, vy_gt, yaw_gt, yawrate_gt;
+  return meas_package;
+}
+
+// previous frame check of main.cpp
+string HasData(string s) {
+  auto found_null = s.find("null");
+  auto b1 = s.find_first_of("[");
+  auto b2 = s.find_first_of("]");
+  if (found_null != string::npos)
+    return "";
+  else if (b1 != string::npos && b2 != string::npos)
+    return s.substr(b1, b2 - b1 + 1);
+  return "";
+}
+
+// previous message handling of main.cpp without the filter
+string HandleWithJson(const char* data, size_t length, double* checksum) {
+  string s = HasData(string(data, length));
+  auto j = nlohmann::json::parse(s);
+  string sensor_measurement = j[1]["sensor_measurement"];
+  MeasurementPackage meas_package = ParseWithStream(sensor_measurement);
+  *checksum += meas_package.timestamp_ * 1e-12;
+
+  nlohmann::json msgJson;
+  msgJson["estimate_x"] = meas_package.ground_truth_(0);
+  msgJson["estimate_y"] = meas_package.ground_truth_(1);
+  msgJson["rmse_x"] =  0.1;
+  msgJson["rmse_y"] =  0.1;
+  msgJson["rmse_vx"] = 0.3;
+  msgJson["rmse_vy"] = 0.2;
+  return "42[\"estimate_marker\"," + msgJson.dump() + "]";
+}
+
+double Seconds(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void Report(const char* name, long lines, double seconds, double checksum) {
+  printf("%-28s %10ld lines  %8.3f s  %8.1f ns/line  %8.2f Mlines/s  (checksum %.6g)\n",
+         name, lines, seconds, 1e9 * seconds / lines, lines / seconds / 1e6, checksum);
+}
+
+}
+
+
+int main(int argc, char* argv[]) {
+  string input_file = (argc > 1) ? argv[1] : "../data/obj_pose-laser-radar-synthetic-input.txt";
+  long lines = (argc > 2) ? atol(argv[2]) : 10000000;
+
+  ifstream in_file(input_file.c_str());
+  if (!in_file.is_open()) {
+    cerr << "Cannot open input file: " << input_file << endl;
+    return EXIT_FAILURE;
+  }
+  vector<string> dataset;
+  string line;
+  while (getline(in_file, line))
+    if (!line.empty())
+      dataset.push_back(line);
+
+  // one block of replicated lines, it is parsed repeatedly to reach the line count
+  long block_lines = min(lines, kBlockLines);
+  vector<string> block_lines_vec;
+  string block;
+  for (long i = 0; i < block_lines; i++) {
+    block_lines_vec.push_back(dataset[i % dataset.size()]);
+    block += dataset[i % dataset.size()];
+    block += '\n';
+  }
+  long repeats = (lines + block_lines - 1) / block_lines;
+  long total = repeats * block_lines;
+  printf("%ld dataset lines replicated to %ld lines (%ld x %ld line block, %.1f MB)\n",
+         (long)dataset.size(), total, repeats, block_lines, block.size() / 1e6);
+
+  // previous parser
+  double checksum = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (long r = 0; r < repeats; r++)
+    for (long i = 0; i < block_lines; i++)
+      checksum += ParseWithStream(block_lines_vec[i]).timestamp_ * 1e-12;
+  Report("istringstream (previous)", total, Seconds(start), checksum);
+
+  // in place parser over the memory buffer
+  checksum = 0;
+  start = chrono::steady_clock::now();
+  MeasurementPackage meas_package;
+  for (long r = 0; r < repeats; r++) {
+    const char* p = block.data();
+    const char* end = p + block.size();
+    while (p < end) {
+      const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (ParseMeasurement(p, newline, &meas_package))
+        checksum += meas_package.timestamp_ * 1e-12;
+      p = newline + 1;
+    }
+  }
+  Report("ParseMeasurement", total, Seconds(start), checksum);
+
+  // buffered file reader, the temporary file is in the page cache
+  string tmp_file = "parser_bench.tmp";
+  FILE* tmp = fopen(tmp_file.c_str(), "wb");
+  if (tmp == NULL || fwrite(block.data(), 1, block.size(), tmp) != block.size()) {
+    cerr << "Cannot write temporary file: " << tmp_file << endl;
+    return EXIT_FAILURE;
+  }
+  fclose(tmp);
+  checksum = 0;
+  start = chrono::steady_clock::now();
+  for (long r = 0; r < repeats; r++) {
+    TextLogReader reader;
+    reader.Open(tmp_file);
+    while (reader.Next(&meas_package))
+      checksum += meas_package.timestamp_ * 1e-12;
+  }
+  Report("TextLogReader", total, Seconds(start), checksum);
+  remove(tmp_file.c_str());
+
+  // simulator frames of the dataset lines, tabs are escaped as in the json
+  vector<string> frames;
+  for (size_t i = 0; i < dataset.size(); i++) {
+    string escaped;
+    for (size_t k = 0; k < dataset[i].size(); k++) {
+      if (dataset[i][k] == '\t')
+        escaped += "\\t";
+      else if (dataset[i][k] != '\r')
+        escaped += dataset[i][k];
+    }
+    frames.push_back("42[\"telemetry\",{\"sensor_measurement\":\"" + escaped + "\"}]");
+  }
+  long frame_count = max(1L, lines / 20);
+  checksum = 0;
+  size_t reply_bytes = 0;
+  start = chrono::steady_clock::now();
+  for (long i = 0; i < frame_count; i++) {
+    const string& frame = frames[i % frames.size()];
+    reply_bytes += HandleWithJson(frame.data(), frame.size(), &checksum).size();
+  }
+  Report("telemetry json (previous)", frame_count, Seconds(start), checksum);
+
+  checksum = 0;
+  start = chrono::steady_clock::now();
+  for (long i = 0; i < frame_count; i++) {
+    const string& frame = frames[i % frames.size()];
+    if (ParseTelemetryFrame(frame.data(), frame.size(), &meas_package) == TELEMETRY_MEASUREMENT)
+      checksum += meas_package.timestamp_ * 1e-12;
+    FilterEstimate estimate;
+    estimate.x = meas_package.ground_truth_(0);
+    estimate.y = meas_package.ground_truth_(1);
+    estimate.rmse << 0.1, 0.1, 0.3, 0.2;
+    char reply[TELEMETRY_MAX_REPLY];
+    reply_bytes += FormatEstimateReply(estimate, reply);
+  }
+  Report("ParseTelemetryFrame", frame_count, Seconds(start), checksum);
+  return reply_bytes > 0 ? 0 : 1;
+}
@@ -0,0 +1,728 @@
+/**
+ * Performance regression suite of the UKF and EKF.
+ *
+ * Replays the bundled dataset and a scaled up synthetic set through three
+ * variants: the UKF with the linear lidar update, the UKF with
+ * UpdateLidarUnscented and the EKF. The synthetic set holds one replay per
+ * trial of measurements synthesized from the ground truth of the dataset
+ * like the Monte Carlo evaluation, so it covers many noise realizations with
+ * a fixed seed. Within every replay each Prediction and update call is timed
+ * on its own, the step case times the prediction and the update of every
+ * measurement together and carries the RMSE of the variant. The
+ * process_measurement cases time the entry point of the main program.
+ *
+ * Every case reports the latency per call, the heap allocations per call
+ * counted by the operator new of this program and, where the kernel allows
+ * it, the user space cache references and misses from perf_event. The step
+ * and process_measurement cases count the cache events over their whole
+ * replays, the single step cases report none. Before the cases, a replay of
+ * the bundled dataset through the UKF and the EKF fails the run if copying a
+ * measurement or any step after the first allocates.
+ *
+ * The suite is repeated --repeat times. The statistics are over the calls of
+ * all repetitions, except ns_p50_best, the lowest p50 of a single repetition,
+ * which a slow phase of a shared machine doesn't move. The report is written
+ * as JSON with one case per line. Passing a previous report as baseline fails
+ * the run if the ns_p50_best of a case grew by more than --max_regression
+ * percent or an RMSE by more than --max_rmse_regression percent. A case
+ * missing from either side fails it as well, so a renamed or dropped case
+ * can't leave the gate unnoticed, unless --allow_case_changes is given for a
+ * run which adds or renames cases on purpose.
+ *
+ * Latencies of an unoptimized build say nothing about a release, so the
+ * suite refuses to run unless it was compiled with optimization or
+ * --allow_unoptimized is given.
+ *
+ * Usage: PerfSuite [--data file] [--passes n] [--trials n] [--repeat n]
+ *                  [--report file] [--baseline file] [--max_regression percent]
+ *                  [--max_rmse_regression percent] [--ctrv_kernel name]
+ *                  [--allow_case_changes] [--allow_unoptimized]
+ */
+#include "ukf.h"
+#include "ekf.h"
+#include "monte_carlo.h"
+#include "sensor_log.h"
+#include "tools.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// every heap allocation of the program, the filters allocate through these
+static atomic<long> allocations(0);
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if (p == NULL)
+    throw bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+// process noise used by the main program
+const double kStdA = 0.6;
+const double kStdYawdd = 0.4;
+
+double Nanoseconds(Clock::time_point start, Clock::time_point stop) {
+  return chrono::duration<double, nano>(stop - start).count();
+}
+
+/**
+ * User space cache references and misses of this thread, both counters are
+ * read together as one group
+ */
+class CacheCounters {
+public:
+  CacheCounters() : leader_(-1), misses_(-1) {
+#ifdef __linux__
+    leader_ = Open(PERF_COUNT_HW_CACHE_REFERENCES, -1);
+    if (leader_ >= 0)
+      misses_ = Open(PERF_COUNT_HW_CACHE_MISSES, leader_);
+    if (misses_ < 0 && leader_ >= 0) {
+      close(leader_);
+      leader_ = -1;
+    }
+#endif
+  }
+
+  ~CacheCounters() {
+#ifdef __linux__
+    if (misses_ >= 0)
+      close(misses_);
+    if (leader_ >= 0)
+      close(leader_);
+#endif
+  }
+
+  bool Available() const { return leader_ >= 0; }
+
+  void Start() {
+#ifdef __linux__
+    if (!Available())
+      return;
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  /**
+   * Stops counting and adds the counts since Start
+   */
+  void Stop(double* references, double* misses) {
+#ifdef __linux__
+    if (!Available())
+      return;
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    // PERF_FORMAT_GROUP: the number of counters followed by their values
+    uint64_t values[3];
+    if (read(leader_, values, sizeof(values)) == sizeof(values) && values[0] == 2) {
+      *references += values[1];
+      *misses += values[2];
+    }
+#endif
+  }
+
+private:
+#ifdef __linux__
+  static int Open(uint64_t config, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group < 0) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+  }
+#endif
+
+  int leader_;
+  int misses_;
+};
+
+/**
+ * Latency, allocations and cache events of one case
+ */
+class PerfCase {
+public:
+  explicit PerfCase(const string& name) : name_(name), allocations_(0), references_(0), misses_(0),
+                                          cache_counted_(false), rmse_valid_(false), best_p50_(-1) {}
+
+  void Add(double ns, long allocations) {
+    samples_.push_back(ns);
+    allocations_ += allocations;
+  }
+
+  void AddCacheEvents(double references, double misses) {
+    references_ += references;
+    misses_ += misses;
+    cache_counted_ = true;
+  }
+
+  void SetRmse(const RmseVector& rmse) {
+    rmse_ = rmse;
+    rmse_valid_ = true;
+  }
+
+  /**
+   * Adds the calls of the same case of another repetition
+   */
+  void Merge(const PerfCase& other) {
+    best_p50_ = min(BestP50(), other.BestP50());
+    samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+    allocations_ += other.allocations_;
+    if (other.cache_counted_)
+      AddCacheEvents(other.references_, other.misses_);
+  }
+
+  /**
+   * Lowest p50 of the merged repetitions
+   */
+  double BestP50() const { return (best_p50_ < 0) ? Percentile(0.50) : best_p50_; }
+
+  const string& Name() const { return name_; }
+  bool HasRmse() const { return rmse_valid_; }
+  const RmseVector& Rmse() const { return rmse_; }
+
+  double Percentile(double q) const {
+    if (samples_.empty())
+      return 0;
+    vector<double> sorted = samples_;
+    size_t k = static_cast<size_t>(q * (sorted.size() - 1));
+    nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+  }
+
+  double Mean() const {
+    double sum = 0;
+    for (size_t i = 0; i < samples_.size(); i++)
+      sum += samples_[i];
+    return samples_.empty() ? 0 : sum / samples_.size();
+  }
+
+  void Print() const {
+    printf("%-44s %9zu calls  mean %8.1f ns  p50 %8.1f ns  best p50 %8.1f ns  p99 %8.1f ns  %5.2f allocs",
+           name_.c_str(), samples_.size(), Mean(), Percentile(0.50), BestP50(), Percentile(0.99),
+           AllocationsPerCall());
+    if (cache_counted_)
+      printf("  %6.2f cache misses", misses_ / Calls());
+    if (rmse_valid_)
+      printf("  RMSE %.4f %.4f %.4f %.4f", rmse_(0), rmse_(1), rmse_(2), rmse_(3));
+    printf("\n");
+  }
+
+  /**
+   * One line JSON object, the baseline comparison reads the fields back by
+   * their names
+   */
+  void WriteJson(FILE* file) const {
+    fprintf(file, "{\"name\": \"%s\", \"calls\": %zu, \"ns_mean\": %.2f, \"ns_p50\": %.2f, \"ns_p50_best\": %.2f, "
+                  "\"ns_p99\": %.2f, \"allocations_per_call\": %.4f, ", name_.c_str(), samples_.size(), Mean(),
+            Percentile(0.50), BestP50(), Percentile(0.99), AllocationsPerCall());
+    if (cache_counted_)
+      fprintf(file, "\"cache_references_per_call\": %.3f, \"cache_misses_per_call\": %.3f, ",
+              references_ / Calls(), misses_ / Calls());
+    else
+      fprintf(file, "\"cache_references_per_call\": null, \"cache_misses_per_call\": null, ");
+    if (rmse_valid_)
+      fprintf(file, "\"rmse\": [%.6g, %.6g, %.6g, %.6g]}", rmse_(0), rmse_(1), rmse_(2), rmse_(3));
+    else
+      fprintf(file, "\"rmse\": null}");
+  }
+
+private:
+  double Calls() const { return max<double>(1, samples_.size()); }
+  double AllocationsPerCall() const { return allocations_ / Calls(); }
+
+  string name_;
+  vector<double> samples_;
+  long allocations_;
+  double references_;
+  double misses_;
+  bool cache_counted_;
+  RmseVector rmse_;
+  bool rmse_valid_;
+  double best_p50_;
+};
+
+CtrvKernel ctrv_kernel = CTRV_KERNEL_AUTO;
+
+UKF* CreateUKF() {
+  UKF* ukf = new UKF(false, true, true, kStdA, kStdYawdd);
+  ukf->ctrv_kernel_ = ctrv_kernel;
+  return ukf;
+}
+
+EKF* CreateEKF() {
+  return new EKF(false, true, true, kStdA, kStdYawdd);
+}
+
+void UpdateLidar(UKF* filter, const MeasurementPackage& meas, bool unscented) {
+  if (unscented)
+    filter->UpdateLidarUnscented(meas);
+  else
+    filter->UpdateLidar(meas);
+}
+
+void UpdateLidar(EKF* filter, const MeasurementPackage& meas, bool) {
+  filter->UpdateLidar(meas);
+}
+
+/**
+ * Timed cases of one filter variant
+ */
+struct VariantCases {
+  PerfCase prediction;
+  PerfCase update_lidar;
+  PerfCase update_radar;
+  PerfCase step;
+  RmseAccumulator rmse;
+
+  explicit VariantCases(const string& prefix)
+    : prediction(prefix + "/prediction"),
+      update_lidar(prefix + "/update_lidar"),
+      update_radar(prefix + "/update_radar"),
+      step(prefix + "/step") {}
+};
+
+/**
+ * Replays one log through a new filter and times the single steps. The
+ * steps are called in the same order as in ProcessMeasurement, the first
+ * measurement initializes the filter.
+ */
+template <class F>
+void ReplaySteps(F* filter, const vector<MeasurementPackage>& log, bool unscented_lidar,
+                 CacheCounters* counters, VariantCases* cases) {
+  filter->ProcessMeasurement(log[0]);
+  cases->rmse.Add(CartesianEstimate(filter->x_), log[0].ground_truth_);
+  double references = 0, misses = 0;
+  counters->Start();
+  for (size_t i = 1; i < log.size(); i++) {
+    const MeasurementPackage& meas = log[i];
+    double dt = (meas.timestamp_ - filter->time_us_) / 1.0e6;
+    filter->time_us_ = meas.timestamp_;
+    filter->state_us_ = meas.timestamp_;
+    filter->timestep_++;
+
+    long allocations_start = allocations.load(memory_order_relaxed);
+    Clock::time_point start = Clock::now();
+    filter->Prediction(dt);
+    Clock::time_point predicted = Clock::now();
+    long allocations_predicted = allocations.load(memory_order_relaxed);
+    PerfCase* update;
+    if (meas.sensor_type_ == MeasurementPackage::LASER) {
+      UpdateLidar(filter, meas, unscented_lidar);
+      update = &cases->update_lidar;
+    } else {
+      filter->UpdateRadar(meas);
+      update = &cases->update_radar;
+    }
+    Clock::time_point stop = Clock::now();
+    long allocations_stop = allocations.load(memory_order_relaxed);
+
+    cases->prediction.Add(Nanoseconds(start, predicted), allocations_predicted - allocations_start);
+    update->Add(Nanoseconds(predicted, stop), allocations_stop - allocations_predicted);
+    cases->step.Add(Nanoseconds(start, stop), allocations_stop - allocations_start);
+    cases->rmse.Add(CartesianEstimate(filter->x_), meas.ground_truth_);
+  }
+  counters->Stop(&references, &misses);
+  if (counters->Available())
+    cases->step.AddCacheEvents(references, misses);
+}
+
+/**
+ * Times ProcessMeasurement per call over whole replays of every log
+ */
+void ProcessThroughput(Filter* (*create)(), const vector<vector<MeasurementPackage> >& logs, int passes,
+                       CacheCounters* counters, PerfCase* result) {
+  RmseAccumulator rmse;
+  double references = 0, misses = 0;
+  for (int pass = 0; pass < passes; pass++) {
+    for (size_t l = 0; l < logs.size(); l++) {
+      Filter* filter = create();
+      counters->Start();
+      for (size_t i = 0; i < logs[l].size(); i++) {
+        long allocations_start = allocations.load(memory_order_relaxed);
+        Clock::time_point start = Clock::now();
+        filter->ProcessMeasurement(logs[l][i]);
+        Clock::time_point stop = Clock::now();
+        result->Add(Nanoseconds(start, stop), allocations.load(memory_order_relaxed) - allocations_start);
+        rmse.Add(CartesianEstimate(filter->x_), logs[l][i].ground_truth_);
+      }
+      counters->Stop(&references, &misses);
+      delete filter;
+    }
+  }
+  if (counters->Available())
+    result->AddCacheEvents(references, misses);
+  result->SetRmse(rmse.Rmse());
+}
+
+Filter* CreateUKFFilter() {
+  return CreateUKF();
+}
+
+Filter* CreateEKFFilter() {
+  return CreateEKF();
+}
+
+/**
+ * Runs all cases of one set of logs and appends them to cases
+ */
+void RunDataset(const string& name, const vector<vector<MeasurementPackage> >& logs, int passes,
+                CacheCounters* counters, vector<PerfCase>* cases) {
+  VariantCases ukf(name + "/ukf");
+  VariantCases ukf_unscented(name + "/ukf_unscented_lidar");
+  VariantCases ekf(name + "/ekf");
+  for (int pass = 0; pass < passes; pass++) {
+    for (size_t l = 0; l < logs.size(); l++) {
+      UKF* filter = CreateUKF();
+      ReplaySteps(filter, logs[l], false, counters, &ukf);
+      delete filter;
+      filter = CreateUKF();
+      ReplaySteps(filter, logs[l], true, counters, &ukf_unscented);
+      delete filter;
+      EKF* ekf_filter = CreateEKF();
+      ReplaySteps(ekf_filter, logs[l], false, counters, &ekf);
+      delete ekf_filter;
+    }
+  }
+  VariantCases* variants[] = {&ukf, &ukf_unscented, &ekf};
+  for (int v = 0; v < 3; v++) {
+    variants[v]->step.SetRmse(variants[v]->rmse.Rmse());
+    cases->push_back(variants[v]->prediction);
+    cases->push_back(variants[v]->update_lidar);
+    cases->push_back(variants[v]->update_radar);
+    cases->push_back(variants[v]->step);
+  }
+
+  PerfCase ukf_process(name + "/ukf/process_measurement");
+  ProcessThroughput(CreateUKFFilter, logs, passes, counters, &ukf_process);
+  cases->push_back(ukf_process);
+  PerfCase ekf_process(name + "/ekf/process_measurement");
+  ProcessThroughput(CreateEKFFilter, logs, passes, counters, &ekf_process);
+  cases->push_back(ekf_process);
+}
+
+/**
+ * Replays the log through a new filter with a copy of every measurement and
+ * counts the heap allocations of the copies and of the steps after the
+ * first measurement. Both must be zero, the payload of a MeasurementPackage
+ * is stored inline and the steps work on fixed size matrices.
+ */
+bool AllocationCheck(const string& name, Filter* (*create)(), const vector<MeasurementPackage>& log) {
+  Filter* filter = create();
+  filter->ProcessMeasurement(log[0]);
+  long copy_allocations = 0, step_allocations = 0;
+  for (size_t i = 1; i < log.size(); i++) {
+    long allocations_start = allocations.load(memory_order_relaxed);
+    MeasurementPackage meas = log[i];
+    long allocations_copied = allocations.load(memory_order_relaxed);
+    filter->ProcessMeasurement(meas);
+    step_allocations += allocations.load(memory_order_relaxed) - allocations_copied;
+    copy_allocations += allocations_copied - allocations_start;
+  }
+  delete filter;
+  bool ok = copy_allocations == 0 && step_allocations == 0;
+  printf("%-36s %zu steps  %ld allocations in the measurement copies  %ld in the steps  %s\n",
+         (name + " allocations").c_str(), log.size() - 1, copy_allocations, step_allocations, ok ? "ok" : "failed");
+  return ok;
+}
+
+bool WriteReport(const string& path, const vector<PerfCase>& cases, int passes, int trials, int repeat,
+                 bool perf_events) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == NULL)
+    return false;
+  fprintf(file, "{\n\"suite\": \"PerfSuite\",\n\"version\": 1,\n");
+  fprintf(file, "\"build\": {\"compiler\": \"%s\", \"ctrv_kernel\": \"%s\", \"stats\": %s},\n", __VERSION__,
+          CtrvKernelName(CtrvResolveKernel(ctrv_kernel)),
+#ifdef UKF_STATS
+          "true"
+#else
+          "false"
+#endif
+          );
+  fprintf(file, "\"passes\": %d,\n\"trials\": %d,\n\"repeat\": %d,\n\"perf_events\": %s,\n\"cases\": [\n", passes,
+          trials, repeat, perf_events ? "true" : "false");
+  for (size_t i = 0; i < cases.size(); i++) {
+    cases[i].WriteJson(file);
+    fprintf(file, (i + 1 < cases.size()) ? ",\n" : "\n");
+  }
+  fprintf(file, "]\n}\n");
+  return fclose(file) == 0;
+}
+
+/**
+ * Reads the number after "key": in line
+ */
+bool FindNumber(const string& line, const string& key, double* value) {
+  size_t pos = line.find("\"" + key + "\": ");
+  if (pos == string::npos)
+    return false;
+  const char* begin = line.c_str() + pos + key.size() + 4;
+  char* end;
+  *value = strtod(begin, &end);
+  return end != begin;
+}
+
+/**
+ * Baseline values of one case
+ */
+struct BaselineCase {
+  double ns_p50_best;
+  bool has_rmse;
+  double rmse[4];
+};
+
+/**
+ * Reads the cases of a previous report, which holds one case per line
+ */
+bool ReadBaseline(const string& path, map<string, BaselineCase>* baseline) {
+  ifstream file(path.c_str());
+  if (!file.is_open())
+    return false;
+  string line;
+  while (getline(file, line)) {
+    size_t name = line.find("{\"name\": \"");
+    if (name == string::npos)
+      continue;
+    size_t begin = name + 10, end = line.find('"', begin);
+    BaselineCase c;
+    if (end == string::npos || !FindNumber(line, "ns_p50_best", &c.ns_p50_best))
+      continue;
+    size_t rmse = line.find("\"rmse\": [");
+    c.has_rmse = rmse != string::npos &&
+                 sscanf(line.c_str() + rmse + 9, "%lf, %lf, %lf, %lf", &c.rmse[0], &c.rmse[1], &c.rmse[2],
+                        &c.rmse[3]) == 4;
+    (*baseline)[line.substr(begin, end - begin)] = c;
+  }
+  return !baseline->empty();
+}
+
+/**
+ * Compares the cases to the baseline and prints every regression. Cases
+ * which are only in the run or only in the baseline count as regressions
+ * unless allow_case_changes is set.
+ * @return number of regressions
+ */
+int CompareBaseline(const vector<PerfCase>& cases, const map<string, BaselineCase>& baseline,
+                    double max_regression, double max_rmse_regression, bool allow_case_changes) {
+  int regressions = 0;
+  map<string, BaselineCase> unmatched = baseline;
+  for (size_t i = 0; i < cases.size(); i++) {
+    map<string, BaselineCase>::const_iterator it = baseline.find(cases[i].Name());
+    if (it == baseline.end()) {
+      printf("%-44s %s not in the baseline\n", cases[i].Name().c_str(),
+             allow_case_changes ? "new case," : "REGRESSION");
+      regressions += !allow_case_changes;
+      continue;
+    }
+    unmatched.erase(it->first);
+    const double p50 = cases[i].BestP50();
+    const double change = (it->second.ns_p50_best > 0) ? 100.0 * (p50 / it->second.ns_p50_best - 1) : 0;
+    if (change > max_regression) {
+      printf("%-44s REGRESSION best p50 %.1f ns, baseline %.1f ns (%+.1f%%)\n", cases[i].Name().c_str(), p50,
+             it->second.ns_p50_best, change);
+      regressions++;
+    }
+    if (!cases[i].HasRmse() || !it->second.has_rmse)
+      continue;
+    for (int k = 0; k < 4; k++) {
+      const double limit = it->second.rmse[k] * (1 + max_rmse_regression / 100.0);
+      if (cases[i].Rmse()(k) > limit) {
+        printf("%-44s REGRESSION RMSE[%d] %.6g, baseline %.6g\n", cases[i].Name().c_str(), k,
+               cases[i].Rmse()(k), it->second.rmse[k]);
+        regressions++;
+      }
+    }
+  }
+  for (map<string, BaselineCase>::const_iterator it = unmatched.begin(); it != unmatched.end(); ++it) {
+    printf("%-44s %s not run, only in the baseline\n", it->first.c_str(),
+           allow_case_changes ? "dropped case," : "REGRESSION");
+    regressions += !allow_case_changes;
+  }
+  return regressions;
+}
+
+void PrintUsage() {
+  cerr << "Usage: PerfSuite [--data file] [--passes n] [--trials n] [--repeat n] [--report file]\n"
+          "                 [--baseline file] [--max_regression percent] [--max_rmse_regression percent]\n"
+          "                 [--ctrv_kernel name] [--allow_case_changes] [--allow_unoptimized]" << endl;
+  exit(EXIT_FAILURE);
+}
+
+}
+
+
+int main(int argc, char* argv[]) {
+  string input_file = "../data/obj_pose-laser-radar-synthetic-input.txt";
+  string report_file = "perf_report.json";
+  string baseline_file = "";
+  int passes = 50;
+  int trials = 64;
+  int repeat = 5;
+  double max_regression = 10;
+  double max_rmse_regression = 1;
+  bool allow_case_changes = false;
+  bool allow_unoptimized = false;
+
+  const option long_opts[] = {
+          {"data",                1, nullptr, 'i'},
+          {"passes",              1, nullptr, 'p'},
+          {"trials",              1, nullptr, 'n'},
+          {"repeat",              1, nullptr, 'R'},
+          {"report",              1, nullptr, 'o'},
+          {"baseline",            1, nullptr, 'b'},
+          {"max_regression",      1, nullptr, 'r'},
+          {"max_rmse_regression", 1, nullptr, 'e'},
+          {"ctrv_kernel",         1, nullptr, 'k'},
+          {"allow_case_changes",  0, nullptr, 'c'},
+          {"allow_unoptimized",   0, nullptr, 'u'},
+          {nullptr,               0, nullptr, 0}
+  };
+  while (true) {
+    const int opt = getopt_long(argc, argv, "", long_opts, nullptr);
+    if (opt == -1)
+      break;
+    switch (opt) {
+      case 'i': input_file = optarg; break;
+      case 'p': passes = max(1, atoi(optarg)); break;
+      case 'n': trials = max(0, atoi(optarg)); break;
+      case 'R': repeat = max(1, atoi(optarg)); break;
+      case 'o': report_file = optarg; break;
+      case 'b': baseline_file = optarg; break;
+      case 'r': max_regression = atof(optarg); break;
+      case 'e': max_rmse_regression = atof(optarg); break;
+      case 'k':
+        if (!CtrvParseKernel(optarg, &ctrv_kernel))
+          PrintUsage();
+        break;
+      case 'c': allow_case_changes = true; break;
+      case 'u': allow_unoptimized = true; break;
+      default:
+        PrintUsage();
+    }
+  }
+
+#ifdef __OPTIMIZE__
+  const bool optimized = true;
+#else
+  const bool optimized = false;
+#endif
+  if (!optimized && !allow_unoptimized) {
+    cerr << "PerfSuite was built without optimization, its latencies don't compare to a release build. "
+            "Configure with -DCMAKE_BUILD_TYPE=Release or pass --allow_unoptimized." << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<vector<MeasurementPackage> > bundled(1);
+  TextLogReader reader;
+  if (!reader.Open(input_file)) {
+    cerr << "Cannot open input file: " << input_file << endl;
+    return EXIT_FAILURE;
+  }
+  MeasurementPackage meas_package;
+  while (reader.Next(&meas_package))
+    bundled[0].push_back(meas_package);
+  if (bundled[0].size() < 2) {
+    cerr << "Not enough measurements in " << input_file << endl;
+    return EXIT_FAILURE;
+  }
+
+  // noise realizations of the sensor noise the filters assume, with a fixed
+  // seed so every build replays the same measurements
+  vector<vector<MeasurementPackage> > synthetic(trials);
+  FilterConfig config;
+  MonteCarloSpec spec;
+  spec.trials = trials;
+  spec.seed = 1;
+  MonteCarloSensorNoise(config, &spec);
+  for (int t = 0; t < trials; t++)
+    SynthesizeMeasurements(spec, t, bundled[0], &synthetic[t]);
+
+  CacheCounters counters;
+  printf("%zu measurements, %d passes, %d synthetic trials, %d repetitions, CTRV kernel %s, perf_event %s\n",
+         bundled[0].size(), passes, trials, repeat, CtrvKernelName(CtrvResolveKernel(ctrv_kernel)),
+         counters.Available() ? "available" : "not available");
+
+  if (!AllocationCheck("bundled/ukf", CreateUKFFilter, bundled[0]) ||
+      !AllocationCheck("bundled/ekf", CreateEKFFilter, bundled[0]))
+    return EXIT_FAILURE;
+
+  vector<PerfCase> cases;
+  for (int r = 0; r < repeat; r++) {
+    vector<PerfCase> repetition;
+    RunDataset("bundled", bundled, passes, &counters, &repetition);
+    if (trials > 0)
+      RunDataset("synthetic", synthetic, 1, &counters, &repetition);
+    if (cases.empty())
+      cases = repetition;
+    else
+      for (size_t i = 0; i < cases.size(); i++)
+        cases[i].Merge(repetition[i]);
+  }
+  for (size_t i = 0; i < cases.size(); i++)
+    cases[i].Print();
+
+  if (!WriteReport(report_file, cases, passes, trials, repeat, counters.Available())) {
+    cerr << "Failed to write report: " << report_file << endl;
+    return EXIT_FAILURE;
+  }
+  printf("Wrote %zu cases to %s\n", cases.size(), report_file.c_str());
+
+  if (baseline_file.empty())
+    return 0;
+  map<string, BaselineCase> baseline;
+  if (!ReadBaseline(baseline_file, &baseline)) {
+    cerr << "Cannot read baseline report: " << baseline_file << endl;
+    return EXIT_FAILURE;
+  }
+  int regressions = CompareBaseline(cases, baseline, max_regression, max_rmse_regression, allow_case_changes);
+  printf("%d regressions against %s (latency > %+g%%, RMSE > %+g%%)\n", regressions, baseline_file.c_str(),
+         max_regression, max_rmse_regression);
+  return (regressions == 0) ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,251 @@
+#include "association.h"
+#include "measurement_model.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+namespace {
+
+// cost of a pair which is not a candidate and of an unassigned return. Both
+// are far above any NIS + ln det S, so the solution assigns as many returns
+// as possible before it compares their costs.
+const double kInfeasible = 1e12;
+const double kUnassigned = 1e6;
+
+/**
+ * Hungarian algorithm with potentials (shortest augmenting paths), O(rows^2
+ * cols) for rows <= cols. cost holds row r in cost[r*cols...], row_to_col
+ * receives the column of every row.
+ */
+void SolveAssignment(const vector<double>& cost, int rows, int cols, vector<int>* row_to_col) {
+  // 1 based rows and columns, column 0 is the root of the augmenting paths
+  vector<double> u(rows + 1, 0.0), v(cols + 1, 0.0), min_v(cols + 1);
+  vector<int> owner(cols + 1, 0), way(cols + 1, 0);
+  vector<char> used(cols + 1);
+  for (int i = 1; i <= rows; i++) {
+    owner[0] = i;
+    int j0 = 0;
+    fill(min_v.begin(), min_v.end(), HUGE_VAL);
+    fill(used.begin(), used.end(), 0);
+    do {
+      used[j0] = 1;
+      const int i0 = owner[j0];
+      double delta = HUGE_VAL;
+      int j1 = 0;
+      for (int j = 1; j <= cols; j++) {
+        if (used[j])
+          continue;
+        const double reduced = cost[(i0 - 1)*cols + (j - 1)] - u[i0] - v[j];
+        if (reduced < min_v[j]) {
+          min_v[j] = reduced;
+          way[j] = j0;
+        }
+        if (min_v[j] < delta) {
+          delta = min_v[j];
+          j1 = j;
+        }
+      }
+      for (int j = 0; j <= cols; j++) {
+        if (used[j]) {
+          u[owner[j]] += delta;
+          v[j] -= delta;
+        } else {
+          min_v[j] -= delta;
+        }
+      }
+      j0 = j1;
+    } while (owner[j0] != 0);
+    // flip the augmenting path
+    do {
+      const int j1 = way[j0];
+      owner[j0] = owner[j1];
+      j0 = j1;
+    } while (j0 != 0);
+  }
+  row_to_col->assign(rows, -1);
+  for (int j = 1; j <= cols; j++)
+    if (owner[j] != 0)
+      (*row_to_col)[owner[j] - 1] = j - 1;
+}
+
+}
+
+
+TrackAssociator::TrackAssociator(double max_distance, NisGate gate)
+  : max_distance_(max_distance),
+    gate_(gate) {
+}
+
+
+// positions beyond this many cells from the origin share the outermost cell,
+// which only costs pruning, the candidates still check the exact distance
+static const double kMaxCell = 1 << 30;
+
+long long TrackAssociator::Cell(double p) const {
+  const double c = floor(p / max_distance_);
+  return static_cast<long long>(max(-kMaxCell, min(kMaxCell, c)));
+}
+
+
+uint64_t TrackAssociator::CellKey(long long cx, long long cy) {
+  return (static_cast<uint64_t>(cx) << 32) ^ static_cast<uint32_t>(cy);
+}
+
+
+int TrackAssociator::Find(int node) {
+  while (parent_[node] != node) {
+    parent_[node] = parent_[parent_[node]];
+    node = parent_[node];
+  }
+  return node;
+}
+
+
+void TrackAssociator::Associate(const UKFBank& bank, const MeasurementPackage* frame, int n, Result* result) {
+  const int n_tracks = bank.Size();
+  result->radar.clear();
+  result->lidar.clear();
+  result->track.assign(n, -1);
+  result->candidates = 0;
+
+  //bin the predicted positions, a sorted vector keeps the lookups allocation
+  //free once the workspace has grown. A diverged track with a position that
+  //is not finite stays out of the grid and gets no candidates.
+  cells_.clear();
+  for (int t = 0; t < n_tracks; t++) {
+    const StateVector x = bank.State(t);
+    if (isfinite(x(0)) && isfinite(x(1)))
+      cells_.push_back(make_pair(CellKey(Cell(x(0)), Cell(x(1))), t));
+  }
+  sort(cells_.begin(), cells_.end());
+
+  //gated candidates of every return from the cells around it
+  const double max_distance_sq = max_distance_ * max_distance_;
+  candidates_.clear();
+  for (int m = 0; m < n; m++) {
+    const MeasurementPackage& meas = frame[m];
+    const bool radar = (meas.sensor_type_ == MeasurementPackage::RADAR);
+    double px, py;
+    if (radar) {
+      px = meas.raw_measurements_(0) * cos(meas.raw_measurements_(1));
+      py = meas.raw_measurements_(0) * sin(meas.raw_measurements_(1));
+    } else {
+      px = meas.raw_measurements_(0);
+      py = meas.raw_measurements_(1);
+    }
+    if (!isfinite(px) || !isfinite(py))
+      continue;
+    const double chi_square = radar ? RadarModel::ChiSquare(gate_) : LidarModel::ChiSquare(gate_);
+    const long long cx = Cell(px), cy = Cell(py);
+    for (long long dx = -1; dx <= 1; dx++) {
+      for (long long dy = -1; dy <= 1; dy++) {
+        const uint64_t key = CellKey(cx + dx, cy + dy);
+        vector<pair<uint64_t, int> >::const_iterator it =
+            lower_bound(cells_.begin(), cells_.end(), make_pair(key, -1));
+        for (; it != cells_.end() && it->first == key; ++it) {
+          const int t = it->second;
+          const StateVector x = bank.State(t);
+          if ((x(0) - px)*(x(0) - px) + (x(1) - py)*(x(1) - py) > max_distance_sq)
+            continue;
+          result->candidates++;
+          double log_det;
+          const double nis = radar ? bank.RadarNis(t, meas.raw_measurements_, &log_det)
+                                   : bank.LidarNis(t, meas.raw_measurements_, &log_det);
+          if (nis > chi_square)
+            continue;
+          Candidate c = {m, t, nis + log_det, -1};
+          candidates_.push_back(c);
+        }
+      }
+    }
+  }
+
+  //clusters of returns and tracks which share candidates, returns are nodes
+  //0..n-1 and tracks n..n+n_tracks-1
+  parent_.resize(n + n_tracks);
+  for (int i = 0; i < n + n_tracks; i++)
+    parent_[i] = i;
+  for (size_t k = 0; k < candidates_.size(); k++) {
+    const int a = Find(candidates_[k].meas), b = Find(n + candidates_[k].track);
+    if (a != b)
+      parent_[a] = b;
+  }
+  for (size_t k = 0; k < candidates_.size(); k++)
+    candidates_[k].cluster = Find(candidates_[k].meas);
+  sort(candidates_.begin(), candidates_.end(), [](const Candidate& a, const Candidate& b) {
+    if (a.cluster != b.cluster)
+      return a.cluster < b.cluster;
+    return a.meas < b.meas || (a.meas == b.meas && a.track < b.track);
+  });
+
+  local_.assign(n + n_tracks, -1);
+  for (size_t begin = 0; begin < candidates_.size();) {
+    size_t end = begin + 1;
+    while (end < candidates_.size() && candidates_[end].cluster == candidates_[begin].cluster)
+      end++;
+    SolveCluster(n, begin, end, result);
+    begin = end;
+  }
+
+  for (int m = 0; m < n; m++) {
+    const int t = result->track[m];
+    if (t < 0)
+      continue;
+    if (frame[m].sensor_type_ == MeasurementPackage::RADAR) {
+      UKFBank::RadarUpdate update = {t, frame[m].raw_measurements_};
+      result->radar.push_back(update);
+    } else {
+      UKFBank::LidarUpdate update = {t, frame[m].raw_measurements_};
+      result->lidar.push_back(update);
+    }
+  }
+}
+
+
+void TrackAssociator::SolveCluster(int n, size_t begin, size_t end, Result* result) {
+  //a single candidate needs no solver, the most common case with well
+  //separated tracks
+  if (end - begin == 1) {
+    result->track[candidates_[begin].meas] = candidates_[begin].track;
+    return;
+  }
+
+  //local rows of the returns and columns of the tracks
+  rows_.clear();
+  cols_.clear();
+  for (size_t k = begin; k < end; k++) {
+    const Candidate& c = candidates_[k];
+    if (local_[c.meas] < 0) {
+      local_[c.meas] = static_cast<int>(rows_.size());
+      rows_.push_back(c.meas);
+    }
+    if (local_[n + c.track] < 0) {
+      local_[n + c.track] = static_cast<int>(cols_.size());
+      cols_.push_back(c.track);
+    }
+  }
+
+  //every return also gets its own unassigned column, so the problem is
+  //always feasible and has at least as many columns as rows
+  const int rows = static_cast<int>(rows_.size());
+  const int cols = static_cast<int>(cols_.size()) + rows;
+  cost_.assign(static_cast<size_t>(rows) * cols, kInfeasible);
+  for (int r = 0; r < rows; r++)
+    cost_[r*cols + cols_.size() + r] = kUnassigned;
+  for (size_t k = begin; k < end; k++) {
+    const Candidate& c = candidates_[k];
+    cost_[local_[c.meas]*cols + local_[n + c.track]] = c.cost;
+  }
+
+  SolveAssignment(cost_, rows, cols, &assignment_);
+  for (int r = 0; r < rows; r++)
+    if (assignment_[r] < static_cast<int>(cols_.size()))
+      result->track[rows_[r]] = cols_[assignment_[r]];
+
+  for (int r = 0; r < rows; r++)
+    local_[rows_[r]] = -1;
+  for (size_t c = 0; c < cols_.size(); c++)
+    local_[n + cols_[c]] = -1;
+}
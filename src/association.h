@@ -0,0 +1,96 @@
+#ifndef ASSOCIATION_H_
+#define ASSOCIATION_H_
+
+#include "filter.h"
+#include "measurement_package.h"
+#include "ukf_bank.h"
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Global nearest neighbour (GNN) association of unlabeled lidar and radar
+ * returns with the tracks of a UKFBank.
+ *
+ * A frame of returns is associated in one call between the prediction of the
+ * bank and its updates:
+ *
+ *   bank.Prediction(dt);
+ *   bank.PredictRadarMeasurement();
+ *   associator.Associate(bank, frame, n, &result);
+ *   bank.UpdateRadar(result.radar);
+ *   bank.UpdateLidar(result.lidar);
+ *
+ * The predicted track positions are binned into a uniform grid with cells of
+ * max_distance. A return is only compared with the tracks of its cell and the
+ * eight around it which are at most max_distance away, so the cost is
+ * proportional to the returns times the tracks near them instead of all
+ * tracks. Each remaining pair is gated on its NIS, computed with the innovation
+ * factorization the bank caches per track. The gated pairs split into clusters
+ * of returns and tracks which share candidates, and every cluster is solved on
+ * its own with the Hungarian algorithm: it assigns as many returns as possible
+ * and among those minimizes the sum of NIS + ln det S, so a track with a wide
+ * innovation covariance does not win over a close one. Every track gets at most
+ * one return per frame, the others stay unassigned.
+ */
+class TrackAssociator {
+public:
+  /**
+   * Assignment of a frame
+   */
+  struct Result {
+    std::vector<UKFBank::RadarUpdate> radar;
+    std::vector<UKFBank::LidarUpdate> lidar;
+    ///* track of every return of the frame, -1 if it is unassigned
+    std::vector<int> track;
+    ///* pairs whose NIS was computed, the rest was pruned by the grid
+    long candidates;
+  };
+
+  /**
+   * @param max_distance largest distance in m between a predicted position and
+   *        a return, also the cell size of the grid. It has to cover the
+   *        bearing noise of the radar at the largest range.
+   * @param gate NIS gate of the candidate pairs, NIS_GATE_OFF keeps every
+   *        pair within max_distance
+   */
+  explicit TrackAssociator(double max_distance = 20.0, NisGate gate = NIS_GATE_99);
+
+  /**
+   * Associates the returns of one frame with the tracks of the bank
+   * @param bank Tracks after Prediction and PredictRadarMeasurement
+   * @param frame Lidar and radar returns, the track ids are not used
+   * @param n Number of returns
+   * @param result Updates for the bank and the track of every return
+   */
+  void Associate(const UKFBank& bank, const MeasurementPackage* frame, int n, Result* result);
+
+private:
+  struct Candidate {
+    int meas;
+    int track;
+    double cost;
+    int cluster;
+  };
+
+  double max_distance_;
+  NisGate gate_;
+
+  // workspace of Associate, reused between frames
+  std::vector<std::pair<uint64_t, int> > cells_;
+  std::vector<Candidate> candidates_;
+  std::vector<int> parent_;
+  std::vector<int> local_;
+  std::vector<int> rows_;
+  std::vector<int> cols_;
+  std::vector<double> cost_;
+  std::vector<int> assignment_;
+
+  // cell of a finite coordinate and the key of a cell in cells_
+  long long Cell(double p) const;
+  static uint64_t CellKey(long long cx, long long cy);
+  int Find(int node);
+  void SolveCluster(int n, size_t begin, size_t end, Result* result);
+};
+
+#endif /* ASSOCIATION_H_ */
@@ -0,0 +1,131 @@
+#include "async_filter.h"
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+
+AsyncFilter::AsyncFilter(Filter* filter, size_t capacity, size_t history)
+  : filter_(filter),
+    history_(filter, history),
+    use_history_(history > 0),
+    input_(capacity),
+    output_(capacity),
+    submitted_(0),
+    dropped_(0),
+    max_input_depth_(0),
+    processed_(0),
+    estimates_dropped_(0),
+    rewinds_(0),
+    replayed_(0),
+    history_dropped_(0),
+    stop_(false) {
+  thread_ = thread(&AsyncFilter::Run, this);
+}
+
+
+AsyncFilter::~AsyncFilter() {
+  Stop();
+}
+
+
+void* AsyncFilter::operator new(size_t size) {
+  void* memory = NULL;
+  if (posix_memalign(&memory, alignof(AsyncFilter), size) != 0)
+    throw bad_alloc();
+  return memory;
+}
+
+
+void AsyncFilter::operator delete(void* memory) {
+  free(memory);
+}
+
+
+bool AsyncFilter::Submit(const MeasurementPackage& meas_package) {
+  if (!input_.TryPush(meas_package)) {
+    dropped_++;
+    return false;
+  }
+  submitted_++;
+  size_t depth = input_.Size();
+  if (depth > max_input_depth_)
+    max_input_depth_ = depth;
+  return true;
+}
+
+
+bool AsyncFilter::PollEstimate(FilterEstimate* estimate) {
+  return output_.TryPop(estimate);
+}
+
+
+AsyncFilterStats AsyncFilter::Stats() const {
+  AsyncFilterStats stats;
+  stats.submitted = submitted_;
+  stats.dropped = dropped_;
+  stats.processed = processed_.load();
+  stats.estimates_dropped = estimates_dropped_.load();
+  stats.input_depth = input_.Size();
+  stats.max_input_depth = max_input_depth_;
+  stats.output_depth = output_.Size();
+  stats.rewinds = rewinds_.load();
+  stats.replayed = replayed_.load();
+  stats.history_dropped = history_dropped_.load();
+  return stats;
+}
+
+
+void AsyncFilter::Stop() {
+  if (thread_.joinable()) {
+    stop_ = true;
+    thread_.join();
+  }
+}
+
+
+void AsyncFilter::Run() {
+  MeasurementPackage meas_package;
+  int idle = 0;
+  while (true) {
+    if (!input_.TryPop(&meas_package)) {
+      // the producer sets stop_ after its last Submit, so a measurement
+      // pushed between the failed pop and the check of stop_ is still
+      // queued. One more pop drains it before the thread returns.
+      if (stop_) {
+        if (!input_.TryPop(&meas_package))
+          return;
+      } else {
+        // back off from spinning to sleeping while the queue stays empty, the
+        // first measurements after a pause are picked up within a few us
+        idle++;
+        if (idle > 256)
+          this_thread::sleep_for(chrono::microseconds(50));
+        else if (idle > 64)
+          this_thread::yield();
+        continue;
+      }
+    }
+    idle = 0;
+
+    if (use_history_) {
+      history_.ProcessMeasurement(meas_package);
+      rewinds_ = history_.Rewinds();
+      replayed_ = history_.Replayed();
+      history_dropped_ = history_.Dropped();
+    } else
+      filter_->ProcessMeasurement(meas_package);
+    const StateVector& x = filter_->StateAt(meas_package.timestamp_);
+    rmse_.Add(CartesianEstimate(x), meas_package.ground_truth_);
+
+    FilterEstimate estimate;
+    estimate.timestamp = meas_package.timestamp_;
+    estimate.x = x(0);
+    estimate.y = x(1);
+    estimate.rmse = rmse_.Rmse();
+    if (!output_.TryPush(estimate))
+      estimates_dropped_++;
+    processed_++;
+  }
+}
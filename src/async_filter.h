@@ -0,0 +1,112 @@
+#ifndef ASYNC_FILTER_H_
+#define ASYNC_FILTER_H_
+
+#include "filter.h"
+#include "spsc_queue.h"
+#include "filter_history.h"
+#include "tools.h"
+#include <atomic>
+#include <thread>
+
+/**
+ * Estimate published by the filter thread for one measurement
+ */
+struct FilterEstimate {
+  long timestamp;
+  double x;
+  double y;
+  RmseVector rmse;
+};
+
+/**
+ * Counters of an AsyncFilter. Read from the producer thread, the values of
+ * the filter thread can be slightly behind.
+ */
+struct AsyncFilterStats {
+  long submitted;          // measurements accepted into the input queue
+  long dropped;            // measurements rejected because the input queue was full
+  long processed;          // measurements processed by the filter thread
+  long estimates_dropped;  // estimates lost because the output queue was full
+  size_t input_depth;      // measurements currently queued
+  size_t max_input_depth;  // highest observed depth of the input queue
+  size_t output_depth;     // estimates waiting to be sent
+  long rewinds;            // rewinds of the out of sequence history, see FilterHistory
+  long replayed;           // measurements processed again by the rewinds
+  long history_dropped;    // measurements too old for the history
+};
+
+/**
+ * Runs a filter on its own thread. One producer thread pushes measurements
+ * with Submit and collects the estimates with PollEstimate, both never block,
+ * so the producer (the socket thread) is not stalled by the filter.
+ */
+class AsyncFilter {
+public:
+  /**
+   * @param filter filter used by the filter thread, the caller keeps ownership
+   * @param capacity size of the input and the output queue
+   * @param history out of sequence measurements which can be rewound, 0 disables
+   */
+  AsyncFilter(Filter* filter, size_t capacity = 1024, size_t history = 0);
+
+  /**
+   * Stops the filter thread after it processed all queued measurements
+   */
+  virtual ~AsyncFilter();
+
+  /**
+   * The queues keep their indices on separate cache lines with alignas(64),
+   * which plain new does not honour before C++17, so instances are allocated
+   * with that alignment
+   */
+  static void* operator new(size_t size);
+  static void operator delete(void* memory);
+
+  /**
+   * Queues a measurement, returns false and counts a drop if the queue is full
+   */
+  bool Submit(const MeasurementPackage& meas_package);
+
+  /**
+   * Takes the next published estimate, returns false if there is none
+   */
+  bool PollEstimate(FilterEstimate* estimate);
+
+  AsyncFilterStats Stats() const;
+
+  /**
+   * Processes the queued measurements and joins the filter thread. The filter
+   * can be used directly afterwards.
+   */
+  void Stop();
+
+  /**
+   * RMSE of all processed measurements, only valid after Stop
+   */
+  const RmseAccumulator& Rmse() const { return rmse_; }
+
+private:
+  Filter* filter_;
+  FilterHistory history_;
+  bool use_history_;
+  RmseAccumulator rmse_;
+  SpscQueue<MeasurementPackage> input_;
+  SpscQueue<FilterEstimate> output_;
+
+  long submitted_;
+  long dropped_;
+  size_t max_input_depth_;
+  std::atomic<long> processed_;
+  std::atomic<long> estimates_dropped_;
+  ///* counters of history_, copied by the filter thread after every measurement
+  std::atomic<long> rewinds_;
+  std::atomic<long> replayed_;
+  std::atomic<long> history_dropped_;
+
+  std::atomic<bool> stop_;
+  std::thread thread_;
+
+  void Run();
+};
+
+#endif /* ASYNC_FILTER_H_ */
@@ -0,0 +1,261 @@
+#include "batch_replay.h"
+#include "epoch_batcher.h"
+#include "filter_history.h"
+#include "sensor_log.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <glob.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+namespace {
+
+string FileStem(const string& path) {
+  size_t slash = path.find_last_of('/');
+  string name = (slash == string::npos) ? path : path.substr(slash + 1);
+  size_t dot = name.find_last_of('.');
+  return (dot == string::npos || dot == 0) ? name : name.substr(0, dot);
+}
+
+/**
+ * Statistics of a set of logs, merged over all of their measurements
+ */
+struct BatchTotals {
+  RmseAccumulator rmse;
+  long files;
+  long failed;
+  long measurements;
+  long dropped;
+  long timestep;
+  long nis_laser_counter;
+  long nis_radar_counter;
+  long gated_laser_counter;
+  long gated_radar_counter;
+};
+
+BatchTotals MergeResults(const vector<BatchFileResult>& results) {
+  BatchTotals t;
+  t.files = results.size();
+  t.failed = t.measurements = t.dropped = t.timestep = 0;
+  t.nis_laser_counter = t.nis_radar_counter = t.gated_laser_counter = t.gated_radar_counter = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    const BatchFileResult& r = results[i];
+    if (!r.ok) {
+      t.failed++;
+      continue;
+    }
+    t.rmse.Merge(r.rmse);
+    t.measurements += r.measurements;
+    t.dropped += r.dropped;
+    t.timestep += r.timestep;
+    t.nis_laser_counter += r.nis_laser_counter;
+    t.nis_radar_counter += r.nis_radar_counter;
+    t.gated_laser_counter += r.gated_laser_counter;
+    t.gated_radar_counter += r.gated_radar_counter;
+  }
+  return t;
+}
+
+double Percent(long counter, long timestep) {
+  return (timestep > 0) ? 100.0 * counter / timestep : 0.0;
+}
+
+}
+
+
+bool ReadManifest(const string& path, vector<string>* inputs) {
+  ifstream manifest(path.c_str());
+  if (!manifest.is_open())
+    return false;
+  string line;
+  while (getline(manifest, line)) {
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == string::npos || line[begin] == '#')
+      continue;
+    size_t end = line.find_last_not_of(" \t\r");
+    inputs->push_back(line.substr(begin, end - begin + 1));
+  }
+  return true;
+}
+
+
+bool ExpandGlob(const string& pattern, vector<string>* inputs) {
+  glob_t matches;
+  if (glob(pattern.c_str(), 0, NULL, &matches) != 0) {
+    globfree(&matches);
+    return false;
+  }
+  // glob sorts the matches
+  for (size_t i = 0; i < matches.gl_pathc; i++)
+    inputs->push_back(matches.gl_pathv[i]);
+  globfree(&matches);
+  return true;
+}
+
+
+bool ReplayFile(const FilterConfig& config, const string& input, OutputSink* out, BatchFileResult* result) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  result->input = input;
+  result->ok = false;
+  result->rmse.Reset();
+  result->measurements = result->dropped = 0;
+  result->timestep = 0;
+  result->nis_laser_counter = result->nis_radar_counter = 0;
+  result->gated_laser_counter = result->gated_radar_counter = 0;
+  result->seconds = 0;
+
+  unique_ptr<Filter> filter(CreateFilter(config));
+  if (!filter)
+    return false;
+  unique_ptr<FilterHistory> history((config.history > 0) ? new FilterHistory(filter.get(), config.history) : NULL);
+  bool written = true;
+  FusedRecord record;
+  auto write_row = [&](const MeasurementPackage& meas_package) {
+    result->rmse.Add(CartesianEstimate(filter->StateAt(meas_package.timestamp_)), meas_package.ground_truth_);
+    if (out != NULL) {
+      MakeFusedRecord(*filter, meas_package, result->rmse.Rmse(), &record);
+      written = out->Write(record) && written;
+    }
+  };
+  auto process_epoch = [&](const MeasurementPackage* batch, int n) {
+    filter->ProcessMeasurements(batch, n);
+    for (int k = 0; k < n; k++)
+      write_row(batch[k]);
+  };
+  EpochBatcher batcher(history ? -1 : config.epoch_tolerance_us);
+  auto process = [&](const MeasurementPackage& meas_package) {
+    result->measurements++;
+    if (history) {
+      history->ProcessMeasurement(meas_package);
+      write_row(meas_package);
+    } else {
+      batcher.Add(meas_package, process_epoch);
+    }
+  };
+
+  MeasurementPackage meas_package;
+  if (IsBinarySensorLog(input)) {
+    MappedSensorLog log;
+    if (!log.Open(input))
+      return false;
+    for (size_t i = 0; i < log.Size(); i++) {
+      log.Get(i, &meas_package);
+      process(meas_package);
+    }
+  } else {
+    TextLogReader reader;
+    if (!reader.Open(input))
+      return false;
+    while (reader.Next(&meas_package))
+      process(meas_package);
+  }
+  batcher.Flush(process_epoch);
+
+  result->dropped = history ? history->Dropped() : 0;
+  result->timestep = filter->timestep_;
+  result->nis_laser_counter = filter->nis_laser_counter_;
+  result->nis_radar_counter = filter->nis_radar_counter_;
+  result->gated_laser_counter = filter->gated_laser_counter_;
+  result->gated_radar_counter = filter->gated_radar_counter_;
+  result->ok = written;
+  result->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  return result->ok;
+}
+
+
+vector<BatchFileResult> RunBatch(const FilterConfig& config, const BatchSpec& spec, int* workers) {
+  vector<BatchFileResult> results(spec.inputs.size());
+
+  // output names are assigned up front, so they don't depend on the order in
+  // which the workers finish
+  map<string, int> stems;
+  if (!spec.output_dir.empty())
+    mkdir(spec.output_dir.c_str(), 0755);
+  for (size_t i = 0; i < spec.inputs.size(); i++) {
+    results[i].input = spec.inputs[i];
+    if (spec.output_dir.empty())
+      continue;
+    string stem = FileStem(spec.inputs[i]);
+    int n = stems[stem]++;
+    if (n > 0)
+      stem += "." + to_string(n);
+    results[i].output = spec.output_dir + "/" + stem + "." + spec.output_format;
+  }
+
+  ThreadPool pool(spec.threads);
+  if (workers != NULL)
+    *workers = pool.Size();
+  for (size_t i = 0; i < spec.inputs.size(); i++) {
+    // every task writes only its own result slot
+    pool.Submit([&config, &spec, &results, i] {
+      BatchFileResult& result = results[i];
+      string output = result.output;
+      unique_ptr<BufferedOutputWriter> out;
+      if (!output.empty()) {
+        if (spec.output_format == "bin")
+          out.reset(new BinaryOutputWriter(1 << 20, spec.flush_every));
+        else
+          out.reset(new CsvOutputWriter(1 << 20, spec.flush_every));
+        if (!out->Open(output)) {
+          result.ok = false;
+          return;
+        }
+      }
+      bool ok = ReplayFile(config, spec.inputs[i], out.get(), &result);
+      result.output = output;
+      if (out) {
+        result.ok = out->Close() && ok;
+        // no partial outputs of logs which failed
+        if (!result.ok)
+          remove(output.c_str());
+      }
+    });
+  }
+  pool.Wait();
+  return results;
+}
+
+
+bool WriteBatchSummary(const string& path, const vector<BatchFileResult>& results) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == NULL)
+    return false;
+  fprintf(file, "input,status,measurements,dropped,rmse_px,rmse_py,rmse_vx,rmse_vy,nis_laser%%,nis_radar%%,"
+                "gated_laser,gated_radar,seconds\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const BatchFileResult& r = results[i];
+    RmseVector rmse = r.rmse.Rmse();
+    fprintf(file, "%s,%s,%ld,%ld,%.6g,%.6g,%.6g,%.6g,%.4g,%.4g,%d,%d,%.6g\n", r.input.c_str(),
+            r.ok ? "ok" : "failed", r.measurements, r.dropped, rmse(0), rmse(1), rmse(2), rmse(3),
+            Percent(r.nis_laser_counter, r.timestep), Percent(r.nis_radar_counter, r.timestep),
+            r.gated_laser_counter, r.gated_radar_counter, r.seconds);
+  }
+  BatchTotals t = MergeResults(results);
+  RmseVector rmse = t.rmse.Rmse();
+  fprintf(file, "total,%ld failed,%ld,%ld,%.6g,%.6g,%.6g,%.6g,%.4g,%.4g,%ld,%ld,\n", t.failed, t.measurements,
+          t.dropped, rmse(0), rmse(1), rmse(2), rmse(3), Percent(t.nis_laser_counter, t.timestep),
+          Percent(t.nis_radar_counter, t.timestep), t.gated_laser_counter, t.gated_radar_counter);
+  return fclose(file) == 0;
+}
+
+
+void PrintBatchSummary(const vector<BatchFileResult>& results, double seconds, int threads) {
+  BatchTotals t = MergeResults(results);
+  for (size_t i = 0; i < results.size(); i++)
+    if (!results[i].ok)
+      fprintf(stderr, "Failed to replay %s\n", results[i].input.c_str());
+  RmseVector rmse = t.rmse.Rmse();
+  printf("%ld logs, %ld failed, %ld measurements, %ld dropped\n", t.files, t.failed, t.measurements, t.dropped);
+  printf("RMSE over all measurements: px=%g, py=%g, vx=%g, vy=%g\n", rmse(0), rmse(1), rmse(2), rmse(3));
+  printf("NIS out of the 95%% range: laser %.2f%%, radar %.2f%%, gated %ld laser, %ld radar\n",
+         Percent(t.nis_laser_counter, t.timestep), Percent(t.nis_radar_counter, t.timestep),
+         t.gated_laser_counter, t.gated_radar_counter);
+  printf("%g s on %d threads, %.0f measurements/s\n", seconds, threads,
+         (seconds > 0) ? t.measurements / seconds : 0.0);
+}
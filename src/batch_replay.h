@@ -0,0 +1,88 @@
+#ifndef BATCH_REPLAY_H_
+#define BATCH_REPLAY_H_
+
+#include "replay.h"
+#include "output_writer.h"
+#include <string>
+#include <vector>
+
+/**
+ * Offline replay of many sensor logs.
+ *
+ * Every log is one task on a ThreadPool of a bounded number of workers. A
+ * task streams its log through the filter into its output: text logs are
+ * parsed from a read buffer and binary logs memory mapped, the fused rows
+ * are collected in the buffer of the output writer. So at most one log per
+ * worker is open and every worker moves through the read, filter and write
+ * stages of its own log, without any hand off between threads. The logs are
+ * independent, so the throughput grows with the number of workers until the
+ * storage is saturated.
+ */
+struct BatchSpec {
+  std::vector<std::string> inputs;
+  std::string output_dir;       // one output per log and the summary, empty writes none
+  std::string output_format;    // "csv" or "bin"
+  long flush_every;             // rows per write of the outputs, 0 writes full buffers
+  int threads;                  // 0 uses all cores
+};
+
+/**
+ * Result of the replay of one log
+ */
+struct BatchFileResult {
+  std::string input;
+  std::string output;
+  bool ok;
+  RmseAccumulator rmse;
+  long measurements;
+  long dropped;                 // out of sequence measurements that were too old
+  int timestep;
+  int nis_laser_counter;
+  int nis_radar_counter;
+  int gated_laser_counter;
+  int gated_radar_counter;
+  double seconds;
+};
+
+/**
+ * Reads a manifest with one log path per line. Empty lines and lines starting
+ * with # are skipped, relative paths are relative to the working directory.
+ * @return false if the manifest can not be read
+ */
+bool ReadManifest(const std::string& path, std::vector<std::string>* inputs);
+
+/**
+ * Appends the files matching a shell pattern in sorted order
+ * @return false if nothing matches
+ */
+bool ExpandGlob(const std::string& pattern, std::vector<std::string>* inputs);
+
+/**
+ * Streams one log through a new filter into out, which may be NULL. Handles
+ * the history and the fusion epochs of the configuration like the csv mode
+ * of the main program.
+ * @return false if the log can not be read or the output not written
+ */
+bool ReplayFile(const FilterConfig& config, const std::string& input, OutputSink* out, BatchFileResult* result);
+
+/**
+ * Replays all logs of the spec, the results are in the order of the inputs.
+ * The output directory is created if it doesn't exist, logs with the same
+ * file name get a numbered output name.
+ * @param workers receives the number of worker threads if not NULL
+ */
+std::vector<BatchFileResult> RunBatch(const FilterConfig& config, const BatchSpec& spec, int* workers = NULL);
+
+/**
+ * Writes one csv row per log and a last row with the RMSE and NIS of all
+ * measurements of all logs which were replayed
+ * @return false if the file can not be written
+ */
+bool WriteBatchSummary(const std::string& path, const std::vector<BatchFileResult>& results);
+
+/**
+ * Prints the merged statistics of all logs
+ */
+void PrintBatchSummary(const std::vector<BatchFileResult>& results, double seconds, int threads);
+
+#endif /* BATCH_REPLAY_H_ */
@@ -0,0 +1,68 @@
+#ifndef COUNTER_RNG_H_
+#define COUNTER_RNG_H_
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ * Counter based random numbers with the Philox4x32-10 generator of Salmon et
+ * al., "Parallel random numbers: as easy as 1, 2, 3". A block of four random
+ * words is a pure function of a 64 bit key and a 128 bit counter, so every
+ * (trial, measurement, component) gets its own independent numbers without
+ * any generator state. Results therefore do not depend on which thread runs a
+ * trial or in which order.
+ */
+class CounterRng {
+public:
+  struct Block {
+    uint32_t w[4];
+  };
+
+  explicit CounterRng(uint64_t seed)
+    : key0_(static_cast<uint32_t>(seed)),
+      key1_(static_cast<uint32_t>(seed >> 32)) {}
+
+  /**
+   * The random block of counter (c0, c1, c2, c3)
+   */
+  Block Generate(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3) const {
+    Block b = {{c0, c1, c2, c3}};
+    uint32_t k0 = key0_;
+    uint32_t k1 = key1_;
+    for (int round = 0; round < 10; round++) {
+      uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * b.w[0];
+      uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * b.w[2];
+      uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+      uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+      b.w[0] = hi1 ^ b.w[1] ^ k0;
+      b.w[1] = lo1;
+      b.w[2] = hi0 ^ b.w[3] ^ k1;
+      b.w[3] = lo0;
+      // Weyl sequence of the key
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    return b;
+  }
+
+  /**
+   * Two independent standard normal numbers of counter (c0, c1, c2) by the
+   * Box-Muller transform. Each uniform uses 64 bits of the block.
+   */
+  void Normal2(uint32_t c0, uint32_t c1, uint32_t c2, double* n0, double* n1) const {
+    Block b = Generate(c0, c1, c2, 0);
+    // uniforms in (0, 1] and [0, 1) with 53 bits
+    double u0 = ((((static_cast<uint64_t>(b.w[0]) << 32) | b.w[1]) >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double u1 = (((static_cast<uint64_t>(b.w[2]) << 32) | b.w[3]) >> 11) * (1.0 / 9007199254740992.0);
+    double r = sqrt(-2.0 * log(u0));
+    double phi = 2.0 * M_PI * u1;
+    *n0 = r * cos(phi);
+    *n1 = r * sin(phi);
+  }
+
+private:
+  uint32_t key0_;
+  uint32_t key1_;
+};
+
+#endif /* COUNTER_RNG_H_ */
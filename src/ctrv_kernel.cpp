@@ -0,0 +1,194 @@
+#include "ctrv_kernel.h"
+#include "trig.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(CTRV_KERNEL_X86)
+void CtrvPredictAvx2(const CtrvSigmaPoints& points);
+void CtrvPredictAvx2(const CtrvSigmaPointsF& points);
+void CtrvPredictAvx512(const CtrvSigmaPoints& points);
+void CtrvPredictAvx512(const CtrvSigmaPointsF& points);
+#endif
+#if defined(CTRV_KERNEL_ARM)
+void CtrvPredictNeon(const CtrvSigmaPoints& points);
+void CtrvPredictNeon(const CtrvSigmaPointsF& points);
+#endif
+
+
+void CtrvPredictScalar(const CtrvSigmaPoints& points) {
+  const TrigMode mode = points.fast_trig ? TRIG_FAST : TRIG_EXACT;
+  for (int i = 0; i < points.n; i++) {
+    //extract values for better readability
+    double p_x      = points.aug[0][i];
+    double p_y      = points.aug[1][i];
+    double v        = points.aug[2][i];
+    double yaw      = points.aug[3][i];
+    double yawd     = points.aug[4][i];
+    double nu_a     = points.aug[5][i];
+    double nu_yawdd = points.aug[6][i];
+    double delta_t  = points.delta_t[i];
+
+    //predicted state values
+    double px_p, py_p, v_p, yaw_p, yawd_p;
+
+    //sine and cosine of the yaw before and after the turn, shared by the
+    //motion and the noise terms
+    double sin_yaw, cos_yaw, sin_yaw_p, cos_yaw_p;
+    SinCos(yaw, &sin_yaw, &cos_yaw, mode);
+
+    //avoid division by zero
+    if (fabs(yawd) > std::numeric_limits<double>::epsilon()) {
+        SinCos(yaw + yawd*delta_t, &sin_yaw_p, &cos_yaw_p, mode);
+        px_p = p_x + v/yawd * ( sin_yaw_p - sin_yaw );
+        py_p = p_y + v/yawd * ( cos_yaw - cos_yaw_p );
+    } else {
+        px_p = p_x + v*delta_t*cos_yaw;
+        py_p = p_y + v*delta_t*sin_yaw;
+    }
+
+    // add noise
+    px_p += 0.5*nu_a*delta_t*delta_t * cos_yaw;
+    py_p += 0.5*nu_a*delta_t*delta_t * sin_yaw;
+    // prediction and adding noise
+    v_p     = v + nu_a*delta_t;
+    yaw_p   = yaw + yawd*delta_t + 0.5*nu_yawdd*delta_t*delta_t;
+    yawd_p  = yawd + nu_yawdd*delta_t;
+
+    points.pred[0][i] = px_p;
+    points.pred[1][i] = py_p;
+    points.pred[2][i] = v_p;
+    points.pred[3][i] = yaw_p;
+    points.pred[4][i] = yawd_p;
+  }
+}
+
+
+void CtrvPredictScalar(const CtrvSigmaPointsF& points) {
+  for (int i = 0; i < points.n; i++) {
+    float p_x      = points.aug[0][i];
+    float p_y      = points.aug[1][i];
+    float v        = points.aug[2][i];
+    float yaw      = points.aug[3][i];
+    float yawd     = points.aug[4][i];
+    float nu_a     = points.aug[5][i];
+    float nu_yawdd = points.aug[6][i];
+    float delta_t  = points.delta_t[i];
+
+    //half of the turn, sin(h)/h tends to 1 for a zero yaw rate
+    float h = 0.5f*yawd*delta_t;
+    float sinc_h = (h != 0.0f) ? sinf(h) / h : 1.0f;
+    float turn = v*delta_t*sinc_h;
+    float px_p = p_x + turn * cosf(yaw + h);
+    float py_p = p_y + turn * sinf(yaw + h);
+
+    // add noise
+    float half_a_dt2 = 0.5f*nu_a*delta_t*delta_t;
+    points.pred[0][i] = px_p + half_a_dt2 * cosf(yaw);
+    points.pred[1][i] = py_p + half_a_dt2 * sinf(yaw);
+    points.pred[2][i] = v + nu_a*delta_t;
+    points.pred[3][i] = yaw + yawd*delta_t + 0.5f*nu_yawdd*delta_t*delta_t;
+    points.pred[4][i] = yawd + nu_yawdd*delta_t;
+  }
+}
+
+
+bool CtrvKernelAvailable(CtrvKernel kernel) {
+  switch (kernel) {
+    case CTRV_KERNEL_SCALAR:
+      return true;
+#if defined(CTRV_KERNEL_X86)
+    case CTRV_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case CTRV_KERNEL_AVX512:
+      return __builtin_cpu_supports("avx512f");
+#endif
+#if defined(CTRV_KERNEL_ARM)
+    case CTRV_KERNEL_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+
+CtrvKernel CtrvResolveKernel(CtrvKernel kernel) {
+  if (kernel == CTRV_KERNEL_AUTO) {
+    // the cpu does not change while running, so the best kernel is determined once
+    static const CtrvKernel best =
+      CtrvKernelAvailable(CTRV_KERNEL_AVX512) ? CTRV_KERNEL_AVX512 :
+      CtrvKernelAvailable(CTRV_KERNEL_AVX2)   ? CTRV_KERNEL_AVX2 :
+      CtrvKernelAvailable(CTRV_KERNEL_NEON)   ? CTRV_KERNEL_NEON : CTRV_KERNEL_SCALAR;
+    return best;
+  }
+  return CtrvKernelAvailable(kernel) ? kernel : CTRV_KERNEL_SCALAR;
+}
+
+
+void CtrvPredict(const CtrvSigmaPoints& points, CtrvKernel kernel) {
+  switch (CtrvResolveKernel(kernel)) {
+#if defined(CTRV_KERNEL_X86)
+    case CTRV_KERNEL_AVX2:
+      CtrvPredictAvx2(points);
+      break;
+    case CTRV_KERNEL_AVX512:
+      CtrvPredictAvx512(points);
+      break;
+#endif
+#if defined(CTRV_KERNEL_ARM)
+    case CTRV_KERNEL_NEON:
+      CtrvPredictNeon(points);
+      break;
+#endif
+    default:
+      CtrvPredictScalar(points);
+      break;
+  }
+}
+
+
+void CtrvPredict(const CtrvSigmaPointsF& points, CtrvKernel kernel) {
+  switch (CtrvResolveKernel(kernel)) {
+#if defined(CTRV_KERNEL_X86)
+    case CTRV_KERNEL_AVX2:
+      CtrvPredictAvx2(points);
+      break;
+    case CTRV_KERNEL_AVX512:
+      CtrvPredictAvx512(points);
+      break;
+#endif
+#if defined(CTRV_KERNEL_ARM)
+    case CTRV_KERNEL_NEON:
+      CtrvPredictNeon(points);
+      break;
+#endif
+    default:
+      CtrvPredictScalar(points);
+      break;
+  }
+}
+
+
+static const char* const kernel_names[] = {"auto", "scalar", "avx2", "avx512", "neon"};
+
+
+const char* CtrvKernelName(CtrvKernel kernel) {
+  return kernel_names[kernel];
+}
+
+
+bool CtrvParseKernel(const char* name, CtrvKernel* kernel) {
+  for (int i = CTRV_KERNEL_AUTO; i <= CTRV_KERNEL_NEON; i++) {
+    if (strcmp(name, kernel_names[i]) == 0) {
+      *kernel = static_cast<CtrvKernel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+const char* CtrvPrecisionName(CtrvPrecision precision) {
+  return (precision == CTRV_PRECISION_FLOAT) ? "float" : "double";
+}
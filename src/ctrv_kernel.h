@@ -0,0 +1,92 @@
+#ifndef CTRV_KERNEL_H
+#define CTRV_KERNEL_H
+
+/**
+ * CTRV process model kernels for the sigma point propagation of the UKF.
+ *
+ * This header is included by the translation units which are compiled with
+ * instruction set specific flags (AVX2, AVX-512), so it must not pull in any
+ * header with inline functions (Eigen, STL) to keep those out of the
+ * vectorized object files.
+ */
+
+enum CtrvKernel {
+  CTRV_KERNEL_AUTO = 0,   // best kernel supported by the running cpu
+  CTRV_KERNEL_SCALAR,     // reference implementation
+  CTRV_KERNEL_AVX2,
+  CTRV_KERNEL_AVX512,
+  CTRV_KERNEL_NEON
+};
+
+/**
+ * Precision of the sigma point propagation. The mean, the covariance and its
+ * Cholesky decomposition are computed in double either way.
+ */
+enum CtrvPrecision {
+  CTRV_PRECISION_DOUBLE = 0,
+  CTRV_PRECISION_FLOAT    // twice the lanes per register, see CtrvPredict(const CtrvSigmaPointsF&)
+};
+
+/**
+ * Sigma points in structure-of-arrays layout.
+ * aug[k] points to component k of the augmented state [px py v yaw yawd nu_a nu_yawdd]
+ * and pred[k] to component k of the predicted state [px py v yaw yawd] of n
+ * points. delta_t holds the time step in s for each of the n points.
+ * fast_trig selects the polynomial sine and cosine of trig.h, which trade
+ * exactness for speed, see TRIG_FAST_MAX_ERROR.
+ */
+template <class T>
+struct CtrvSigmaPointsT {
+  const T* aug[7];
+  T* pred[5];
+  const T* delta_t;
+  int n;
+  bool fast_trig;
+};
+typedef CtrvSigmaPointsT<double> CtrvSigmaPoints;
+typedef CtrvSigmaPointsT<float>  CtrvSigmaPointsF;
+
+/**
+ * Predicts all sigma points with the requested kernel. If the kernel is not
+ * supported by the cpu the scalar reference implementation is used.
+ */
+void CtrvPredict(const CtrvSigmaPoints& points, CtrvKernel kernel = CTRV_KERNEL_AUTO);
+
+/**
+ * Scalar reference implementation of the CTRV process model
+ */
+void CtrvPredictScalar(const CtrvSigmaPoints& points);
+
+/**
+ * Single precision versions of the above. In float the difference of the
+ * sines before and after the turn would cancel for small yaw rates, so the
+ * turn is evaluated as v*dt * sin(h)/h * cos(yaw + h) with h = yawd*dt/2,
+ * which needs no case for a zero yaw rate. The sines and cosines are
+ * evaluated with float accuracy, fast_trig is ignored.
+ */
+void CtrvPredict(const CtrvSigmaPointsF& points, CtrvKernel kernel = CTRV_KERNEL_AUTO);
+void CtrvPredictScalar(const CtrvSigmaPointsF& points);
+
+/**
+ * Returns true if the kernel is compiled in and supported by the running cpu
+ */
+bool CtrvKernelAvailable(CtrvKernel kernel);
+
+/**
+ * Maps CTRV_KERNEL_AUTO and unavailable kernels to the kernel that is used
+ */
+CtrvKernel CtrvResolveKernel(CtrvKernel kernel);
+
+/**
+ * Name of a kernel and the inverse mapping used for command line parsing,
+ * CtrvParseKernel returns false for unknown names
+ */
+const char* CtrvKernelName(CtrvKernel kernel);
+bool CtrvParseKernel(const char* name, CtrvKernel* kernel);
+
+/**
+ * Name of a precision, "double" or "float"
+ */
+const char* CtrvPrecisionName(CtrvPrecision precision);
+
+#endif /* CTRV_KERNEL_H */
@@ -0,0 +1,63 @@
+// Compiled with -mavx2 -mfma, only called after a runtime cpu check.
+#include "ctrv_kernel_simd.h"
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2Ops {
+  typedef double Scalar;
+  typedef __m256d Reg;
+  typedef __m256d Mask;
+  enum { kWidth = 4 };
+
+  static Reg Set(double a)                    { return _mm256_set1_pd(a); }
+  static Reg Load(const double* p)            { return _mm256_loadu_pd(p); }
+  static void Store(double* p, Reg a)         { _mm256_storeu_pd(p, a); }
+  static Reg Add(Reg a, Reg b)                { return _mm256_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b)                { return _mm256_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b)                { return _mm256_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b)                { return _mm256_div_pd(a, b); }
+  static Reg Fma(Reg a, Reg b, Reg c)         { return _mm256_fmadd_pd(a, b, c); }
+  static Reg Abs(Reg a)                       { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+  static Reg Neg(Reg a)                       { return _mm256_xor_pd(_mm256_set1_pd(-0.0), a); }
+  static Reg Round(Reg a)                     { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static Reg Floor(Reg a)                     { return _mm256_floor_pd(a); }
+  static Mask Gt(Reg a, Reg b)                { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+  static Mask Eq(Reg a, Reg b)                { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+  static Mask Or(Mask a, Mask b)              { return _mm256_or_pd(a, b); }
+  static Reg Select(Mask m, Reg t, Reg f)     { return _mm256_blendv_pd(f, t, m); }
+};
+
+struct Avx2FloatOps {
+  typedef float Scalar;
+  typedef __m256 Reg;
+  typedef __m256 Mask;
+  enum { kWidth = 8 };
+
+  static Reg Set(float a)                     { return _mm256_set1_ps(a); }
+  static Reg Load(const float* p)             { return _mm256_loadu_ps(p); }
+  static void Store(float* p, Reg a)          { _mm256_storeu_ps(p, a); }
+  static Reg Add(Reg a, Reg b)                { return _mm256_add_ps(a, b); }
+  static Reg Sub(Reg a, Reg b)                { return _mm256_sub_ps(a, b); }
+  static Reg Mul(Reg a, Reg b)                { return _mm256_mul_ps(a, b); }
+  static Reg Div(Reg a, Reg b)                { return _mm256_div_ps(a, b); }
+  static Reg Fma(Reg a, Reg b, Reg c)         { return _mm256_fmadd_ps(a, b, c); }
+  static Reg Abs(Reg a)                       { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+  static Reg Neg(Reg a)                       { return _mm256_xor_ps(_mm256_set1_ps(-0.0f), a); }
+  static Reg Round(Reg a)                     { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static Reg Floor(Reg a)                     { return _mm256_floor_ps(a); }
+  static Mask Gt(Reg a, Reg b)                { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static Mask Eq(Reg a, Reg b)                { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+  static Mask Or(Mask a, Mask b)              { return _mm256_or_ps(a, b); }
+  static Reg Select(Mask m, Reg t, Reg f)     { return _mm256_blendv_ps(f, t, m); }
+};
+
+}
+
+void CtrvPredictAvx2(const CtrvSigmaPoints& points) {
+  CtrvPredictSimd<Avx2Ops>(points);
+}
+
+void CtrvPredictAvx2(const CtrvSigmaPointsF& points) {
+  CtrvPredictSimd<Avx2FloatOps>(points);
+}
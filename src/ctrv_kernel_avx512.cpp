@@ -0,0 +1,65 @@
+// Compiled with -mavx512f -mavx2 -mfma, only called after a runtime cpu check.
+// Round and Floor use the zero masked roundscale, the unmasked intrinsic of
+// GCC passes an undefined source register which -Wall reports as uninitialized.
+#include "ctrv_kernel_simd.h"
+#include <immintrin.h>
+
+namespace {
+
+struct Avx512Ops {
+  typedef double Scalar;
+  typedef __m512d Reg;
+  typedef __mmask8 Mask;
+  enum { kWidth = 8 };
+
+  static Reg Set(double a)                    { return _mm512_set1_pd(a); }
+  static Reg Load(const double* p)            { return _mm512_loadu_pd(p); }
+  static void Store(double* p, Reg a)         { _mm512_storeu_pd(p, a); }
+  static Reg Add(Reg a, Reg b)                { return _mm512_add_pd(a, b); }
+  static Reg Sub(Reg a, Reg b)                { return _mm512_sub_pd(a, b); }
+  static Reg Mul(Reg a, Reg b)                { return _mm512_mul_pd(a, b); }
+  static Reg Div(Reg a, Reg b)                { return _mm512_div_pd(a, b); }
+  static Reg Fma(Reg a, Reg b, Reg c)         { return _mm512_fmadd_pd(a, b, c); }
+  static Reg Abs(Reg a)                       { return _mm512_abs_pd(a); }
+  static Reg Neg(Reg a)                       { return _mm512_sub_pd(_mm512_setzero_pd(), a); }
+  static Reg Round(Reg a)                     { return _mm512_maskz_roundscale_pd(0xFF, a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static Reg Floor(Reg a)                     { return _mm512_maskz_roundscale_pd(0xFF, a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+  static Mask Gt(Reg a, Reg b)                { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+  static Mask Eq(Reg a, Reg b)                { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+  static Mask Or(Mask a, Mask b)              { return _mm512_kor(a, b); }
+  static Reg Select(Mask m, Reg t, Reg f)     { return _mm512_mask_blend_pd(m, f, t); }
+};
+
+struct Avx512FloatOps {
+  typedef float Scalar;
+  typedef __m512 Reg;
+  typedef __mmask16 Mask;
+  enum { kWidth = 16 };
+
+  static Reg Set(float a)                     { return _mm512_set1_ps(a); }
+  static Reg Load(const float* p)             { return _mm512_loadu_ps(p); }
+  static void Store(float* p, Reg a)          { _mm512_storeu_ps(p, a); }
+  static Reg Add(Reg a, Reg b)                { return _mm512_add_ps(a, b); }
+  static Reg Sub(Reg a, Reg b)                { return _mm512_sub_ps(a, b); }
+  static Reg Mul(Reg a, Reg b)                { return _mm512_mul_ps(a, b); }
+  static Reg Div(Reg a, Reg b)                { return _mm512_div_ps(a, b); }
+  static Reg Fma(Reg a, Reg b, Reg c)         { return _mm512_fmadd_ps(a, b, c); }
+  static Reg Abs(Reg a)                       { return _mm512_abs_ps(a); }
+  static Reg Neg(Reg a)                       { return _mm512_sub_ps(_mm512_setzero_ps(), a); }
+  static Reg Round(Reg a)                     { return _mm512_maskz_roundscale_ps(0xFFFF, a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static Reg Floor(Reg a)                     { return _mm512_maskz_roundscale_ps(0xFFFF, a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+  static Mask Gt(Reg a, Reg b)                { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+  static Mask Eq(Reg a, Reg b)                { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+  static Mask Or(Mask a, Mask b)              { return _mm512_kor(a, b); }
+  static Reg Select(Mask m, Reg t, Reg f)     { return _mm512_mask_blend_ps(m, f, t); }
+};
+
+}
+
+void CtrvPredictAvx512(const CtrvSigmaPoints& points) {
+  CtrvPredictSimd<Avx512Ops>(points);
+}
+
+void CtrvPredictAvx512(const CtrvSigmaPointsF& points) {
+  CtrvPredictSimd<Avx512FloatOps>(points);
+}
@@ -0,0 +1,63 @@
+// NEON is part of the aarch64 baseline, no runtime check is needed.
+#include "ctrv_kernel_simd.h"
+#include <arm_neon.h>
+
+namespace {
+
+struct NeonOps {
+  typedef double Scalar;
+  typedef float64x2_t Reg;
+  typedef uint64x2_t Mask;
+  enum { kWidth = 2 };
+
+  static Reg Set(double a)                    { return vdupq_n_f64(a); }
+  static Reg Load(const double* p)            { return vld1q_f64(p); }
+  static void Store(double* p, Reg a)         { vst1q_f64(p, a); }
+  static Reg Add(Reg a, Reg b)                { return vaddq_f64(a, b); }
+  static Reg Sub(Reg a, Reg b)                { return vsubq_f64(a, b); }
+  static Reg Mul(Reg a, Reg b)                { return vmulq_f64(a, b); }
+  static Reg Div(Reg a, Reg b)                { return vdivq_f64(a, b); }
+  static Reg Fma(Reg a, Reg b, Reg c)         { return vfmaq_f64(c, a, b); }
+  static Reg Abs(Reg a)                       { return vabsq_f64(a); }
+  static Reg Neg(Reg a)                       { return vnegq_f64(a); }
+  static Reg Round(Reg a)                     { return vrndnq_f64(a); }
+  static Reg Floor(Reg a)                     { return vrndmq_f64(a); }
+  static Mask Gt(Reg a, Reg b)                { return vcgtq_f64(a, b); }
+  static Mask Eq(Reg a, Reg b)                { return vceqq_f64(a, b); }
+  static Mask Or(Mask a, Mask b)              { return vorrq_u64(a, b); }
+  static Reg Select(Mask m, Reg t, Reg f)     { return vbslq_f64(m, t, f); }
+};
+
+struct NeonFloatOps {
+  typedef float Scalar;
+  typedef float32x4_t Reg;
+  typedef uint32x4_t Mask;
+  enum { kWidth = 4 };
+
+  static Reg Set(float a)                     { return vdupq_n_f32(a); }
+  static Reg Load(const float* p)             { return vld1q_f32(p); }
+  static void Store(float* p, Reg a)          { vst1q_f32(p, a); }
+  static Reg Add(Reg a, Reg b)                { return vaddq_f32(a, b); }
+  static Reg Sub(Reg a, Reg b)                { return vsubq_f32(a, b); }
+  static Reg Mul(Reg a, Reg b)                { return vmulq_f32(a, b); }
+  static Reg Div(Reg a, Reg b)                { return vdivq_f32(a, b); }
+  static Reg Fma(Reg a, Reg b, Reg c)         { return vfmaq_f32(c, a, b); }
+  static Reg Abs(Reg a)                       { return vabsq_f32(a); }
+  static Reg Neg(Reg a)                       { return vnegq_f32(a); }
+  static Reg Round(Reg a)                     { return vrndnq_f32(a); }
+  static Reg Floor(Reg a)                     { return vrndmq_f32(a); }
+  static Mask Gt(Reg a, Reg b)                { return vcgtq_f32(a, b); }
+  static Mask Eq(Reg a, Reg b)                { return vceqq_f32(a, b); }
+  static Mask Or(Mask a, Mask b)              { return vorrq_u32(a, b); }
+  static Reg Select(Mask m, Reg t, Reg f)     { return vbslq_f32(m, t, f); }
+};
+
+}
+
+void CtrvPredictNeon(const CtrvSigmaPoints& points) {
+  CtrvPredictSimd<NeonOps>(points);
+}
+
+void CtrvPredictNeon(const CtrvSigmaPointsF& points) {
+  CtrvPredictSimd<NeonFloatOps>(points);
+}
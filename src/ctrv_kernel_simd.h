@@ -0,0 +1,224 @@
+#ifndef CTRV_KERNEL_SIMD_H
+#define CTRV_KERNEL_SIMD_H
+
+#include "ctrv_kernel.h"
+
+/**
+ * Generic vectorized CTRV kernel. It is instantiated once per instruction set
+ * with an Ops type which wraps the intrinsics:
+ *
+ *   typedef ... Scalar;  typedef ... Reg;  typedef ... Mask;  enum { kWidth = lanes };
+ *   Set, Load, Store, Add, Sub, Mul, Div, Fma(a, b, c) = a*b + c, Abs, Neg,
+ *   Round (to nearest), Floor, Gt, Eq, Or, Select(mask, if_true, if_false)
+ *
+ * Scalar is double or float, the float instantiations use the formulation
+ * of CtrvPredictScalar(const CtrvSigmaPointsF&).
+ *
+ * Only include this header from the instruction set specific translation units
+ * and instantiate it with an Ops type from an anonymous namespace.
+ */
+
+// pi/2 split in three parts, the first two have enough trailing zero bits
+// that q*part is exact for the quadrant numbers q reached by yaw angles
+#define CTRV_PIO2_A   1.5707962512969970703125
+#define CTRV_PIO2_B   7.5497894158615963533e-08
+#define CTRV_PIO2_C   5.3903028581581190529e-15
+#define CTRV_2_OVER_PI 0.63661977236758134308
+
+// the same split for float, q*part is exact for the first two parts
+#define CTRV_PIO2_A_F 1.5703125f
+#define CTRV_PIO2_B_F 4.837512969970703125e-4f
+#define CTRV_PIO2_C_F 7.54978995489188216e-8f
+
+/**
+ * Vectorized sincos. Cody-Waite reduction to [-pi/4, pi/4] and the minimax
+ * polynomials of the cephes library, which are accurate to about 1 ulp there.
+ * kFast drops the two highest terms of both polynomials like SinCosFast of
+ * trig.h, which bounds the error by TRIG_FAST_MAX_ERROR instead. In float
+ * the shorter polynomials of the cephes sinf and cosf are used and kFast has
+ * no effect.
+ */
+template <class Ops, bool kFast>
+inline void CtrvSinCos(typename Ops::Reg x, typename Ops::Reg* s, typename Ops::Reg* c) {
+  typedef typename Ops::Reg Reg;
+  typedef typename Ops::Mask Mask;
+  const bool is_float = sizeof(typename Ops::Scalar) == sizeof(float);
+
+  // quadrant and reduced argument
+  Reg q = Ops::Round(Ops::Mul(x, Ops::Set(CTRV_2_OVER_PI)));
+  Reg r, r2, sin_r, cos_r;
+  if (is_float) {
+    r = Ops::Fma(q, Ops::Set(-CTRV_PIO2_A_F), x);
+    r = Ops::Fma(q, Ops::Set(-CTRV_PIO2_B_F), r);
+    r = Ops::Fma(q, Ops::Set(-CTRV_PIO2_C_F), r);
+    r2 = Ops::Mul(r, r);
+
+    Reg ps = Ops::Set(-1.9515295891E-4);
+    ps = Ops::Fma(ps, r2, Ops::Set(8.3321608736E-3));
+    ps = Ops::Fma(ps, r2, Ops::Set(-1.6666654611E-1));
+    sin_r = Ops::Fma(Ops::Mul(ps, r2), r, r);
+
+    Reg pc = Ops::Set(2.443315711809948E-5);
+    pc = Ops::Fma(pc, r2, Ops::Set(-1.388731625493765E-3));
+    pc = Ops::Fma(pc, r2, Ops::Set(4.166664568298827E-2));
+    cos_r = Ops::Fma(Ops::Mul(pc, r2), r2, Ops::Fma(Ops::Set(-0.5), r2, Ops::Set(1.0)));
+  } else {
+    r = Ops::Fma(q, Ops::Set(-CTRV_PIO2_A), x);
+    r = Ops::Fma(q, Ops::Set(-CTRV_PIO2_B), r);
+    r = Ops::Fma(q, Ops::Set(-CTRV_PIO2_C), r);
+    r2 = Ops::Mul(r, r);
+
+    Reg ps, pc;
+    if (kFast) {
+      ps = Ops::Set(2.75573136213857245213E-6);
+      pc = Ops::Set(-2.75573141792967388112E-7);
+    } else {
+      ps = Ops::Set(1.58962301576546568060E-10);
+      ps = Ops::Fma(ps, r2, Ops::Set(-2.50507477628578072866E-8));
+      ps = Ops::Fma(ps, r2, Ops::Set(2.75573136213857245213E-6));
+      pc = Ops::Set(-1.13585365213876817300E-11);
+      pc = Ops::Fma(pc, r2, Ops::Set(2.08757008419747316778E-9));
+      pc = Ops::Fma(pc, r2, Ops::Set(-2.75573141792967388112E-7));
+    }
+    ps = Ops::Fma(ps, r2, Ops::Set(-1.98412698295895385996E-4));
+    ps = Ops::Fma(ps, r2, Ops::Set(8.33333333332211858878E-3));
+    ps = Ops::Fma(ps, r2, Ops::Set(-1.66666666666666307295E-1));
+    sin_r = Ops::Fma(Ops::Mul(ps, r2), r, r);
+
+    pc = Ops::Fma(pc, r2, Ops::Set(2.48015872888517045348E-5));
+    pc = Ops::Fma(pc, r2, Ops::Set(-1.38888888888730564116E-3));
+    pc = Ops::Fma(pc, r2, Ops::Set(4.16666666666665929218E-2));
+    cos_r = Ops::Fma(Ops::Mul(pc, r2), r2, Ops::Fma(Ops::Set(-0.5), r2, Ops::Set(1.0)));
+  }
+
+  // quadrant modulo 4: 0 -> (s, c), 1 -> (c, -s), 2 -> (-s, -c), 3 -> (-c, s)
+  Reg qm = Ops::Sub(q, Ops::Mul(Ops::Set(4.0), Ops::Floor(Ops::Mul(q, Ops::Set(0.25)))));
+  Mask q1 = Ops::Eq(qm, Ops::Set(1.0));
+  Mask q2 = Ops::Eq(qm, Ops::Set(2.0));
+  Mask q3 = Ops::Eq(qm, Ops::Set(3.0));
+  Mask swap = Ops::Or(q1, q3);
+  Reg sv = Ops::Select(swap, cos_r, sin_r);
+  Reg cv = Ops::Select(swap, sin_r, cos_r);
+  *s = Ops::Select(Ops::Or(q2, q3), Ops::Neg(sv), sv);
+  *c = Ops::Select(Ops::Or(q1, q2), Ops::Neg(cv), cv);
+}
+
+/**
+ * Predicts Ops::kWidth sigma points starting at index i
+ */
+template <class Ops, bool kFast>
+inline void CtrvPredictLanes(const CtrvSigmaPointsT<typename Ops::Scalar>& p, int i) {
+  typedef typename Ops::Reg Reg;
+  typedef typename Ops::Mask Mask;
+
+  Reg p_x      = Ops::Load(p.aug[0] + i);
+  Reg p_y      = Ops::Load(p.aug[1] + i);
+  Reg v        = Ops::Load(p.aug[2] + i);
+  Reg yaw      = Ops::Load(p.aug[3] + i);
+  Reg yawd     = Ops::Load(p.aug[4] + i);
+  Reg nu_a     = Ops::Load(p.aug[5] + i);
+  Reg nu_yawdd = Ops::Load(p.aug[6] + i);
+  Reg dt       = Ops::Load(p.delta_t + i);
+  Reg half_dt2 = Ops::Mul(Ops::Set(0.5), Ops::Mul(dt, dt));
+
+  Reg sin_yaw, cos_yaw, px_p, py_p;
+  Reg yaw_turn = Ops::Fma(yawd, dt, yaw);
+  CtrvSinCos<Ops, kFast>(yaw, &sin_yaw, &cos_yaw);
+  if (sizeof(typename Ops::Scalar) == sizeof(float)) {
+    // v*dt * sin(h)/h * (cos, sin)(yaw + h) with h = yawd*dt/2, the lanes
+    // with h = 0 use the limit 1 of sin(h)/h
+    Reg h = Ops::Mul(Ops::Set(0.5), Ops::Mul(yawd, dt));
+    Reg sin_h, cos_h, sin_mid, cos_mid;
+    CtrvSinCos<Ops, kFast>(h, &sin_h, &cos_h);
+    CtrvSinCos<Ops, kFast>(Ops::Add(yaw, h), &sin_mid, &cos_mid);
+    Mask zero = Ops::Eq(h, Ops::Set(0.0));
+    Reg sinc_h = Ops::Select(zero, Ops::Set(1.0), Ops::Div(sin_h, Ops::Select(zero, Ops::Set(1.0), h)));
+    Reg turn = Ops::Mul(Ops::Mul(v, dt), sinc_h);
+    px_p = Ops::Fma(turn, cos_mid, p_x);
+    py_p = Ops::Fma(turn, sin_mid, p_y);
+  } else {
+    Reg sin_yaw_p, cos_yaw_p;
+    CtrvSinCos<Ops, kFast>(yaw_turn, &sin_yaw_p, &cos_yaw_p);
+
+    // both the turning and the straight line motion are evaluated and the
+    // result is selected per lane, yawd is replaced in the lanes that would
+    // divide by zero
+    Mask turning = Ops::Gt(Ops::Abs(yawd), Ops::Set(2.2204460492503131e-16));
+    Reg v_yawd = Ops::Div(v, Ops::Select(turning, yawd, Ops::Set(1.0)));
+    Reg v_dt = Ops::Mul(v, dt);
+    px_p = Ops::Select(turning,
+                       Ops::Fma(v_yawd, Ops::Sub(sin_yaw_p, sin_yaw), p_x),
+                       Ops::Fma(v_dt, cos_yaw, p_x));
+    py_p = Ops::Select(turning,
+                       Ops::Fma(v_yawd, Ops::Sub(cos_yaw, cos_yaw_p), p_y),
+                       Ops::Fma(v_dt, sin_yaw, p_y));
+  }
+
+  // add noise
+  Reg a_dt2 = Ops::Mul(nu_a, half_dt2);
+  px_p = Ops::Fma(a_dt2, cos_yaw, px_p);
+  py_p = Ops::Fma(a_dt2, sin_yaw, py_p);
+  Reg v_p    = Ops::Fma(nu_a, dt, v);
+  Reg yaw_p  = Ops::Fma(nu_yawdd, half_dt2, yaw_turn);
+  Reg yawd_p = Ops::Fma(nu_yawdd, dt, yawd);
+
+  Ops::Store(p.pred[0] + i, px_p);
+  Ops::Store(p.pred[1] + i, py_p);
+  Ops::Store(p.pred[2] + i, v_p);
+  Ops::Store(p.pred[3] + i, yaw_p);
+  Ops::Store(p.pred[4] + i, yawd_p);
+}
+
+/**
+ * Runs the vectorized kernel over all points. The remainder which does not
+ * fill a whole register is copied into a padded block, so every point is
+ * computed by the same instruction sequence.
+ */
+template <class Ops, bool kFast>
+void CtrvPredictSimdLoop(const CtrvSigmaPointsT<typename Ops::Scalar>& points) {
+  typedef typename Ops::Scalar Scalar;
+  const int w = Ops::kWidth;
+  const int n_full = points.n - points.n % w;
+  for (int i = 0; i < n_full; i += w)
+    CtrvPredictLanes<Ops, kFast>(points, i);
+
+  const int rest = points.n - n_full;
+  if (rest == 0)
+    return;
+
+  Scalar aug[7][Ops::kWidth];
+  Scalar pred[5][Ops::kWidth];
+  Scalar dt[Ops::kWidth];
+  CtrvSigmaPointsT<Scalar> tail;
+  for (int j = 0; j < w; j++) {
+    // padding lanes repeat the last point so they stay finite
+    int src = n_full + (j < rest ? j : rest - 1);
+    for (int k = 0; k < 7; k++)
+      aug[k][j] = points.aug[k][src];
+    dt[j] = points.delta_t[src];
+  }
+  for (int k = 0; k < 7; k++)
+    tail.aug[k] = aug[k];
+  for (int k = 0; k < 5; k++)
+    tail.pred[k] = pred[k];
+  tail.delta_t = dt;
+  tail.n = w;
+  tail.fast_trig = kFast;
+  CtrvPredictLanes<Ops, kFast>(tail, 0);
+  for (int k = 0; k < 5; k++)
+    for (int j = 0; j < rest; j++)
+      points.pred[k][n_full + j] = pred[k][j];
+}
+
+/**
+ * Runs the vectorized kernel with the sincos selected by points.fast_trig
+ */
+template <class Ops>
+void CtrvPredictSimd(const CtrvSigmaPointsT<typename Ops::Scalar>& points) {
+  if (points.fast_trig && sizeof(typename Ops::Scalar) == sizeof(double))
+    CtrvPredictSimdLoop<Ops, true>(points);
+  else
+    CtrvPredictSimdLoop<Ops, false>(points);
+}
+
+#endif /* CTRV_KERNEL_SIMD_H */
@@ -1,4 +1,6 @@
 #include "ekf.h"
+#include "measurement_model.h"
+#include "stats.h"
 #include <Eigen/Dense>
 #include <iostream>
 
@@ -7,11 +9,6 @@ using Eigen::MatrixXd;
 using Eigen::VectorXd;
 using std::vector;
 
-// Chi-square distribution parameters for NIS check
-#define CHI_SQ_3  7.8
-#define CHI_SQ_2  5.991
-
-
 EKF::EKF() {
   Init();
 }
@@ -28,8 +25,8 @@ EKF::EKF(bool verbose, bool use_laser, bool use_radar, double std_a, double std_
  */
 void EKF::Init(bool verbose, bool use_laser, bool use_radar, double std_a, double std_yawdd)
 {
-  n_x_        = 5; // we use 5 state variables: px, py, v, yaw, yawrate
-  n_aug_      = 7; // augmented state vector additionally includes std_a and std_yawdd
+  n_x_        = CTRV::kStateDim; // we use 5 state variables: px, py, v, yaw, yawrate
+  n_aug_      = CTRV::kAugStateDim; // augmented state vector additionally includes std_a and std_yawdd
 
   // if this is false, laser measurements will be ignored (except during init)
   use_laser_ = use_laser;
@@ -38,43 +35,14 @@ void EKF::Init(bool verbose, bool use_laser, bool use_radar, double std_a, doubl
   use_radar_ = use_radar;
   verbose_ = verbose;
 
-  // initial state vector
-  x_ = VectorXd(n_x_);
-
-  // initial covariance matrix
-  P_ = MatrixXd(n_x_, n_x_);
-  H_laser_ = MatrixXd(2, n_x_);
-  H_radar_ = MatrixXd(3, n_x_);
-
-  R_lidar_ = MatrixXd(2, 2);
-  R_radar_ = MatrixXd(3, 3);
-
-  // measurement matrix for linear kalman filter update from laser scanner data
-  H_laser_ << 1,    0,    0,    0,  0,
-              0,    1,    0,    0,  0;
-
   // Process noise standard deviation longitudinal acceleration in m/s^2
   std_a_ = std_a;
 
   // Process noise standard deviation yaw acceleration in rad/s^2
   std_yawdd_ = std_yawdd;
-  
-  //DO NOT MODIFY measurement noise values below these are provided by the sensor manufacturer.
-  // Laser measurement noise standard deviation position1 in m
-  std_laspx_ = 0.15;
-
-  // Laser measurement noise standard deviation position2 in m
-  std_laspy_ = 0.15;
-
-  // Radar measurement noise standard deviation radius in m
-  std_radr_ = 0.3;
-
-  // Radar measurement noise standard deviation angle in rad
-  std_radphi_ = 0.03;
 
-  // Radar measurement noise standard deviation radius change in m/s
-  std_radrd_ = 0.3;
-  //DO NOT MODIFY measurement noise values above these are provided by the sensor manufacturer.
+  // measurement noise values of the sensor manufacturer, shared by all filters
+  model_ = &FilterModelConfig::Default();
   
   /**
   TODO:
@@ -84,18 +52,23 @@ void EKF::Init(bool verbose, bool use_laser, bool use_radar, double std_a, doubl
   Hint: one or more values initialized above might be wildly off...
   */
   timestep_ = 0;
+  trig_mode_ = TRIG_EXACT;
   is_initialized_ = false;
   time_us_    = 0;
-  x_          = VectorXd::Zero(n_x_);
-  P_          = MatrixXd::Identity(n_x_, n_x_);
-  R_radar_ <<   std_radr_*std_radr_,  0,                          0,
-                0,                    std_radphi_*std_radphi_,    0,
-                0,                    0,                          std_radrd_*std_radrd_;
-  R_lidar_ <<   std_laspx_*std_laspx_,  0,
-                0,                      std_laspy_*std_laspy_;
+  state_us_   = 0;
+  lazy_prediction_ = false;
+  x_          = StateVector::Zero();
+  P_          = StateMatrix::Identity();
 
+  nis_laser_ = 0;
+  nis_radar_ = 0;
   nis_laser_counter_ = 0;
   nis_radar_counter_ = 0;
+  log_likelihood_ = 0;
+  nis_gate_ = NIS_GATE_OFF;
+  gated_laser_counter_ = 0;
+  gated_radar_counter_ = 0;
+  gated_run_ = 0;
 }
 
 
@@ -106,7 +79,7 @@ EKF::~EKF() {}
  * @param {MeasurementPackage} meas_package The latest measurement data of
  * either radar or laser.
  */
-void EKF::ProcessMeasurement(MeasurementPackage meas_package) {
+void EKF::ProcessMeasurement(const MeasurementPackage& meas_package) {
   /**
   TODO:
 
@@ -114,7 +87,6 @@ void EKF::ProcessMeasurement(MeasurementPackage meas_package) {
   measurements.
   */
   double dt;
-  Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
 
   //compute the time elapsed between the current and previous measurements
   dt = (meas_package.timestamp_ - time_us_) / 1.0e6; //time in seconds
@@ -124,53 +96,22 @@ void EKF::ProcessMeasurement(MeasurementPackage meas_package) {
   timestep_++;
 
   if (!is_initialized_) {
-    if ((meas_package.sensor_type_ == MeasurementPackage::LASER) && use_laser_) {
-      /**
-      Initialize state by lidar measurement.
-      */
-      if (verbose_)
-        cout << "Initial lidar measurement received!" << endl;
-
-      double px, py, v, yaw, yawd;
-      px = meas_package.raw_measurements_[0];
-      py = meas_package.raw_measurements_[1];
-      v  = 0.0;
-      yaw = 0.0; 
-      yawd = 0.0; 
-      x_ << px, py, v, yaw, yawd;
-
-      // done initializing, no need to predict or update
-      is_initialized_ = true;
-    } 
-    if ((meas_package.sensor_type_ == MeasurementPackage::RADAR) && use_radar_) {
-      /**
-      Initialize state by radar measurement, 
-      this involves converting radar measurements from polar to cartesian coordinates.
-      */
-      if (verbose_)
-          cout << "Initial radar measurement received!" << endl;
-
-      double px, py, v, yaw, yawd;
-      double rho = meas_package.raw_measurements_[0];
-      double phi = meas_package.raw_measurements_[1];
-      double rhodot = meas_package.raw_measurements_[2];
-      px = rho * cos(phi);
-      py = rho * sin(phi);
-      v  = 0.0;
-      yaw = 0.0; 
-      yawd = 0.0; 
-      x_ << px, py, v, yaw, yawd;
-
-      // done initializing, no need to predict or update
-      is_initialized_ = true;
-    }
+    InitializeState(meas_package);
+    state_us_ = time_us_;
   }
-  else {
-      Prediction(dt);
-      if ((meas_package.sensor_type_ == MeasurementPackage::LASER) && use_laser_)
-        UpdateLidar(meas_package);
-      if ((meas_package.sensor_type_ == MeasurementPackage::RADAR) && use_radar_)
-        UpdateRadar(meas_package);
+  else if (UsesSensor(meas_package.sensor_type_)) {
+      //a lazy filter keeps the time pending if the measurement is rejected
+      FilterState prior;
+      if (lazy_prediction_)
+        SaveState(&prior);
+      PredictTo(time_us_);
+
+      //the update of the sensor type is looked up in the update table
+      if (!(this->*kUpdates[meas_package.sensor_type_])(meas_package) && lazy_prediction_)
+        DiscardPrediction(prior);
+  }
+  else if (!lazy_prediction_) {
+      PredictTo(time_us_);
   }
 
   if (!x_.allFinite()) {
@@ -188,6 +129,7 @@ void EKF::ProcessMeasurement(MeasurementPackage meas_package) {
   
   if (verbose_) {
     // print the output
+    Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
     cout << "x_ = " << endl << x_.format(CleanFmt) << endl;
     cout << "P_ = " << endl << P_.format(CleanFmt) << endl << endl;
   }
@@ -200,15 +142,12 @@ void EKF::ProcessMeasurement(MeasurementPackage meas_package) {
  * measurement and this one.
  */
 void EKF::Prediction(double delta_t) {
+  STATS_TIMER(STATS_PREDICTION);
   if (verbose_)
     cout << "Prediction step" << endl;
 
-  // Vector / Matrix output format
-  Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
-  VectorXd x_d  = VectorXd::Zero(n_x_);
-  VectorXd u    = VectorXd::Zero(n_x_);
-  MatrixXd Fj   = MatrixXd::Identity(n_x_, n_x_);
-  MatrixXd Q    = MatrixXd::Zero(n_x_, n_x_);
+  StateMatrix Fj = StateMatrix::Identity();
+  StateMatrix Q  = StateMatrix::Zero();
 
   double p_x, p_y, v, yaw, yawd, px_d, py_d;
   float dt_2 = delta_t * delta_t;
@@ -220,19 +159,25 @@ void EKF::Prediction(double delta_t) {
   v     = x_(2);
   yaw   = x_(3);
   yawd  = x_(4);
+
+  // sine and cosine of the yaw before and after the turn, shared by the
+  // state evolution and the jacobian
+  double sin_yaw, cos_yaw, sin_yaw_p, cos_yaw_p;
+  SinCos(yaw, &sin_yaw, &cos_yaw, trig_mode_);
+  SinCos(yaw + yawd*delta_t, &sin_yaw_p, &cos_yaw_p, trig_mode_);
   
   //avoid division by zero
   if (fabs(yawd) > std::numeric_limits<double>::epsilon()) {
-      px_d = v/yawd * (sin(yaw + yawd*delta_t) - sin(yaw));
-      py_d = v/yawd * (cos(yaw) - cos(yaw+yawd*delta_t) );
+      px_d = v/yawd * (sin_yaw_p - sin_yaw);
+      py_d = v/yawd * (cos_yaw - cos_yaw_p);
   } else {
-      px_d = delta_t*v*cos(yaw);
-      py_d = delta_t*v*sin(yaw);
+      px_d = delta_t*v*cos_yaw;
+      py_d = delta_t*v*sin_yaw;
   }
 
   // update state by applying state evolution kinematics equations + noise terms
-  x_ <<  p_x  +  px_d           +  0.5*dt_2*cos(yaw)*std_a_,
-         p_y  +  py_d           +  0.5*dt_2*sin(yaw)*std_a_,
+  x_ <<  p_x  +  px_d           +  0.5*dt_2*cos_yaw*std_a_,
+         p_y  +  py_d           +  0.5*dt_2*sin_yaw*std_a_,
          v    +  0.0            +  delta_t*std_a_,
          yaw  +  yawd*delta_t   +  0.5*dt_2*std_yawdd_,
          yawd +  0              +  delta_t*std_yawdd_;
@@ -243,13 +188,14 @@ void EKF::Prediction(double delta_t) {
   // F matrix is jacobian matrix Fj
   if (fabs(yawd) < std::numeric_limits<double>::epsilon()) {
     yawd = std::numeric_limits<double>::epsilon();
+    SinCos(yaw + yawd*delta_t, &sin_yaw_p, &cos_yaw_p, trig_mode_);
   }
-  double Fj12 = v/yawd * (cos(delta_t*yawd + yaw) - cos(yaw));
-  double Fj13 = 1./yawd * (sin(delta_t*yawd + yaw) - sin(yaw));
-  double Fj14 = delta_t*v/yawd * cos(delta_t*yawd + yaw) - v/(yawd*yawd)*(sin(delta_t*yawd + yaw) - sin(yaw));
-  double Fj22 = v/yawd * (sin(delta_t*yawd + yaw) - sin(yaw));
-  double Fj23 = 1./yawd * (cos(yaw) - cos(delta_t*yawd + yaw));
-  double Fj24 = delta_t*v/yawd * sin(delta_t*yawd + yaw) - v/(yawd*yawd)*(cos(yaw) - cos(delta_t*yawd + yaw));
+  double Fj12 = v/yawd * (cos_yaw_p - cos_yaw);
+  double Fj13 = 1./yawd * (sin_yaw_p - sin_yaw);
+  double Fj14 = delta_t*v/yawd * cos_yaw_p - v/(yawd*yawd)*(sin_yaw_p - sin_yaw);
+  double Fj22 = v/yawd * (sin_yaw_p - sin_yaw);
+  double Fj23 = 1./yawd * (cos_yaw - cos_yaw_p);
+  double Fj24 = delta_t*v/yawd * sin_yaw_p - v/(yawd*yawd)*(cos_yaw - cos_yaw_p);
   Fj << 1.,  0.,  Fj12, Fj13, Fj14,
         0.,  1.,  Fj22, Fj23, Fj24,
         0.,  0.,  0.,    1.,    0.,
@@ -274,139 +220,39 @@ void EKF::Prediction(double delta_t) {
 
 
 /**
- * Updates the state and the state covariance matrix using a laser measurement.
- * This function just uses the simple linear Kalman filter equations becasuse
- * the measurement equations are linear (we measure the position states directly).
+ * Updates the state with the Kalman filter equations linearized around the
+ * predicted state by the Jacobian of the measurement model. For the linear
+ * lidar model these are the plain Kalman filter equations.
  * @param {MeasurementPackage} meas_package
  */
-void EKF::UpdateLidar(MeasurementPackage meas_package) {
-  /**
-  TODO:
-
-  Complete this function! Use lidar data to update the belief about the object's
-  position. Modify the state vector, x_, and covariance, P_.
-
-  You'll also need to calculate the lidar NIS.
-  */
+template <class Model>
+bool EKF::UpdateLinearized(const MeasurementPackage& meas_package) {
   if (verbose_)
-    cout << "UpdateLidar step" << endl;
-
-  VectorXd y = meas_package.raw_measurements_ - H_laser_ * x_;
-  MatrixXd Ht = H_laser_.transpose();
-  MatrixXd S = H_laser_ * P_ * Ht + R_lidar_;
-  MatrixXd Si = S.inverse();
-  MatrixXd PHt = P_ * Ht;
-  MatrixXd K = PHt * Si;
-  MatrixXd I = MatrixXd::Identity(n_x_, n_x_);
-
-  //new estimate
-  x_ = x_ + (K * y);
-  P_ = (I - K * H_laser_) * P_;
+    cout << "Update " << Model::Name() << " step" << endl;
 
-  nis_laser_ = y.transpose() * Si * y;
-  if (nis_laser_ > CHI_SQ_2)
-    nis_laser_counter_++;
-
-  if (verbose_) {
-    cout << "NIS(laser): ";
-    cout << 100.0 * nis_laser_counter_ / timestep_ << "% (" << nis_laser_counter_ << " samples out of " << timestep_ << ") are out of 95% NIS range!" << endl;
-  }
+  return LinearizedUpdate(this, Model(), meas_package);
 }
 
 
+// update of every sensor type
+const EKF::UpdateFunction EKF::kUpdates[MeasurementPackage::SENSOR_TYPES] = {
+  &EKF::UpdateLinearized<LidarModel>,
+  &EKF::UpdateLinearized<RadarModel>
+};
 
-/**
-* Measurement equation for radar update
-*/
-MatrixXd EKF::h_radar(void) {
-  VectorXd z_pred = VectorXd(3);
-  double px, py, v, yaw, yawd;
-  px = x_(0);
-  py = x_(1);
-  v = x_(2);
-  yaw = x_(3);
-  yawd = x_(4);
-
-  z_pred(0) = sqrt(px*px + py*py);
-
-  if (fabs(px) <= std::numeric_limits<float>::epsilon())
-    px = std::numeric_limits<float>::epsilon();
-  if (fabs(py) <= std::numeric_limits<float>::epsilon())
-    py = std::numeric_limits<float>::epsilon();
-
-  z_pred(1) = fmod(atan2(py, px), 2.*M_PI);
-  z_pred(2) = (px*v*cos(yaw) + py*v*sin(yaw)) / z_pred(0);
-
-  return z_pred;
-}
 
-/**
- * Updates the state and the state covariance matrix using a radar measurement.
- * @param {MeasurementPackage} meas_package
- */
-void EKF::UpdateRadar(MeasurementPackage meas_package) {
-  /**
-  TODO:
-
-  Complete this function! Use radar data to update the belief about the object's
-  position. Modify the state vector, x_, and covariance, P_.
-
-  You'll also need to calculate the radar NIS.
-  */
-  if (verbose_)
-    cout << "UpdateRadar step" << endl;
-
-  // Vector / Matrix output format
-  Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
-
-  int n_z = 3; // measurement dimension
-  double px, py, v, yaw, yawd, norm, px_2, py_2, H11, H12, H21, H22, H31, H32, H34;
-
-  px = x_(0);
-  py = x_(1);
-  v = x_(2);
-  yaw = x_(3);
-  yawd = x_(4);
-  px_2 = px*px;
-  py_2 = py*py;
-  norm = sqrt(px_2 + py_2);
-
-  H11 = px / norm;
-  H12 = py / norm;
-  H21 = - py / (px_2 * (1. + py_2 / px_2));
-  H22 = 1. / (px * (1. + py_2 / px_2));
-  H31 = v * cos(yaw) / (norm - px/pow(norm, 3)) * (v*px*cos(yaw) + v*py*sin(yaw));
-  H32 = v * sin(yaw) / (norm - py/pow(norm, 3)) * (v*px*cos(yaw) + v*py*sin(yaw));
-  H34 = 1. / norm * (px * cos(yaw) + py * sin(yaw));
-  H_radar_ << H11,   H12,    0,    0,      0,
-              H21,   H22,    0,    0,      0,
-              H31,   H32,    0,    H34,    0;
-
-  // don't update measurement if we can't compute the jacobian
-  if (H_radar_.isZero(0)){
-    cerr << "H matrix of radar is zero" << endl;
-    return;
-  }
+bool EKF::Update(const MeasurementPackage& meas_package) {
+  if (!UsesSensor(meas_package.sensor_type_))
+    return false;
+  return (this->*kUpdates[meas_package.sensor_type_])(meas_package);
+}
 
-  // residual
-  VectorXd z_diff = meas_package.raw_measurements_ - h_radar();
-  MatrixXd I = MatrixXd::Identity(x_.size(), x_.size());
-  MatrixXd H_radar_t = H_radar_.transpose();
-  MatrixXd S = H_radar_ * P_ * H_radar_t + R_radar_;
-  MatrixXd Si = S.inverse();
-  MatrixXd PHt = P_ * H_radar_t;
-  MatrixXd K = PHt * Si;
 
-  //new estimate
-  x_ = x_ + (K * z_diff);
-  P_ = (I - K * H_radar_) * P_;
+void EKF::UpdateLidar(const MeasurementPackage& meas_package) {
+  UpdateLinearized<LidarModel>(meas_package);
+}
 
-  nis_radar_ = z_diff.transpose() * S.inverse() * z_diff;
-  if (nis_radar_ > CHI_SQ_3)
-    nis_radar_counter_++;
 
-  if (verbose_) {
-    cout << "NIS(radar): ";
-    cout << 100.0 * nis_radar_counter_ / timestep_ << "% (" << nis_radar_counter_ << " samples out of " << timestep_ << ") are out of 95% NIS range!" << endl;
-  }
+void EKF::UpdateRadar(const MeasurementPackage& meas_package) {
+  UpdateLinearized<RadarModel>(meas_package);
 }
@@ -35,7 +35,7 @@ public:
    * ProcessMeasurement
    * @param meas_package The latest measurement data of either radar or laser
    */
-  void ProcessMeasurement(MeasurementPackage meas_package);
+  void ProcessMeasurement(const MeasurementPackage& meas_package);
 
   /**
    * Prediction Predicts sigma points, the state, and the state covariance
@@ -50,20 +50,32 @@ public:
    * the measurement equations are linear (we measure the position states directly).
    * @param {MeasurementPackage} meas_package
    */
-  void UpdateLidar(MeasurementPackage meas_package);
-
+  void UpdateLidar(const MeasurementPackage& meas_package);
 
   /**
-  * Measurement equation for radar update
-  */
-  MatrixXd h_radar(void);
+   * Updates the state and the state covariance matrix using a radar measurement
+   * @param meas_package The measurement at k+1
+   */
+  void UpdateRadar(const MeasurementPackage& meas_package);
 
+  /**
+   * Updates the state with a measurement of any sensor type by the update
+   * table
+   * @return false if the measurement was not applied
+   */
+  bool Update(const MeasurementPackage& meas_package);
 
   /**
-   * Updates the state and the state covariance matrix using a radar measurement
-   * @param meas_package The measurement at k+1
+   * Extended Kalman filter update of one sensor type, instantiated per
+   * measurement model
    */
-  void UpdateRadar(MeasurementPackage meas_package);
+  template <class Model> bool UpdateLinearized(const MeasurementPackage& meas_package);
+
+private:
+  typedef bool (EKF::*UpdateFunction)(const MeasurementPackage& meas_package);
+
+  ///* update of every sensor type, indexed by MeasurementPackage::SensorType
+  static const UpdateFunction kUpdates[MeasurementPackage::SENSOR_TYPES];
 };
 
 #endif /* EKF_H */
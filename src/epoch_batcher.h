@@ -0,0 +1,60 @@
+#ifndef EPOCH_BATCHER_H_
+#define EPOCH_BATCHER_H_
+
+#include "filter.h"
+#include "measurement_package.h"
+#include <vector>
+
+/**
+ * Groups a time ordered measurement stream into fusion epochs for
+ * Filter::ProcessMeasurements. A measurement joins the open epoch while it is
+ * at most tolerance_us later than the first measurement of the epoch and the
+ * epoch has room left. A negative tolerance disables batching, every
+ * measurement is then emitted on its own right away.
+ *
+ * Epochs are emitted by calling emit(const MeasurementPackage* batch, int n).
+ * The batch is only valid during the call.
+ */
+class EpochBatcher {
+public:
+  explicit EpochBatcher(long tolerance_us, int max_size = kMaxEpochMeasurements)
+    : tolerance_us_(tolerance_us),
+      max_size_(max_size < 1 ? 1 : max_size) {
+    epoch_.reserve(max_size_);
+  }
+
+  /**
+   * Adds a measurement, which may complete the open epoch first
+   */
+  template <class Emit>
+  void Add(const MeasurementPackage& meas, Emit emit) {
+    if (tolerance_us_ < 0) {
+      emit(&meas, 1);
+      return;
+    }
+    // late measurements never join an epoch, the filter sees them in order
+    if (!epoch_.empty() && (static_cast<int>(epoch_.size()) == max_size_ ||
+                            meas.timestamp_ < epoch_.back().timestamp_ ||
+                            meas.timestamp_ - epoch_.front().timestamp_ > tolerance_us_))
+      Flush(emit);
+    epoch_.push_back(meas);
+  }
+
+  /**
+   * Emits the open epoch, called at the end of the stream
+   */
+  template <class Emit>
+  void Flush(Emit emit) {
+    if (epoch_.empty())
+      return;
+    emit(epoch_.data(), static_cast<int>(epoch_.size()));
+    epoch_.clear();
+  }
+
+private:
+  long tolerance_us_;
+  int max_size_;
+  std::vector<MeasurementPackage> epoch_;
+};
+
+#endif /* EPOCH_BATCHER_H_ */
@@ -0,0 +1,243 @@
+#include "filter.h"
+#include "measurement_model.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+
+namespace {
+
+FilterModelConfig MakeDefaultModel() {
+  FilterModelConfig model;
+
+  //DO NOT MODIFY measurement noise values below these are provided by the sensor manufacturer.
+  // Laser measurement noise standard deviation position1 in m
+  model.std_laspx = 0.15;
+
+  // Laser measurement noise standard deviation position2 in m
+  model.std_laspy = 0.15;
+
+  // Radar measurement noise standard deviation radius in m
+  model.std_radr = 0.3;
+
+  // Radar measurement noise standard deviation angle in rad
+  model.std_radphi = 0.03;
+
+  // Radar measurement noise standard deviation radius change in m/s
+  model.std_radrd = 0.3;
+  //DO NOT MODIFY measurement noise values above these are provided by the sensor manufacturer.
+
+  // measurement matrix for linear kalman filter update from laser scanner data
+  model.H_laser << 1,    0,    0,    0,  0,
+                   0,    1,    0,    0,  0;
+
+  model.R_radar << model.std_radr*model.std_radr,  0,                               0,
+                   0,                              model.std_radphi*model.std_radphi, 0,
+                   0,                              0,                               model.std_radrd*model.std_radrd;
+  model.R_lidar << model.std_laspx*model.std_laspx,  0,
+                   0,                                model.std_laspy*model.std_laspy;
+
+  //set weights
+  const int n_aug = CTRV::kAugStateDim;
+  model.lambda = 3 - n_aug;
+  model.weights(0) = model.lambda / (model.lambda + n_aug);
+  for (int i = 1; i < CTRV::kSigmaPoints; i++)
+    model.weights(i) = 1 / (2*(model.lambda + n_aug));
+  return model;
+}
+
+}
+
+
+const FilterModelConfig& FilterModelConfig::Default() {
+  // built once on first use, the initialization of a function static is thread safe
+  static const FilterModelConfig model = MakeDefaultModel();
+  return model;
+}
+
+
+namespace {
+
+const int kNisGatePercent[] = {0, 95, 99, 999};
+
+}
+
+
+int NisGatePercent(NisGate gate) {
+  return kNisGatePercent[gate];
+}
+
+
+bool ParseNisGate(int percent, NisGate* gate) {
+  for (int g = NIS_GATE_OFF; g <= NIS_GATE_999; g++) {
+    if (kNisGatePercent[g] == percent) {
+      *gate = static_cast<NisGate>(g);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void Filter::SaveState(FilterState* state) const {
+  state->x                 = x_;
+  state->P                 = P_;
+  state->time_us           = time_us_;
+  state->state_us          = state_us_;
+  state->is_initialized    = is_initialized_;
+  state->timestep          = timestep_;
+  state->nis_laser         = nis_laser_;
+  state->nis_radar         = nis_radar_;
+  state->nis_laser_counter = nis_laser_counter_;
+  state->nis_radar_counter = nis_radar_counter_;
+  state->gated_laser_counter = gated_laser_counter_;
+  state->gated_radar_counter = gated_radar_counter_;
+  state->gated_run = gated_run_;
+}
+
+
+void Filter::RestoreState(const FilterState& state) {
+  x_                 = state.x;
+  P_                 = state.P;
+  time_us_           = state.time_us;
+  state_us_          = state.state_us;
+  is_initialized_    = state.is_initialized;
+  timestep_          = state.timestep;
+  nis_laser_         = state.nis_laser;
+  nis_radar_         = state.nis_radar;
+  nis_laser_counter_ = state.nis_laser_counter;
+  nis_radar_counter_ = state.nis_radar_counter;
+  gated_laser_counter_ = state.gated_laser_counter;
+  gated_radar_counter_ = state.gated_radar_counter;
+  gated_run_ = state.gated_run;
+}
+
+
+void Filter::ProcessMeasurements(const MeasurementPackage* batch, int n) {
+  // measurements are processed one by one until the filter is initialized
+  int first = 0;
+  while (first < n && !is_initialized_)
+    ProcessMeasurement(batch[first++]);
+  if (n - first == 1)
+    ProcessMeasurement(batch[first]);
+  if (n - first <= 1)
+    return;
+
+  long long epoch_us = time_us_;
+  bool used = !lazy_prediction_;
+  for (int i = first; i < n; i++) {
+    epoch_us = std::max<long long>(epoch_us, batch[i].timestamp_);
+    used = used || UsesSensor(batch[i].sensor_type_);
+  }
+  time_us_ = epoch_us;
+  timestep_ += n - first;
+
+  // a lazy filter leaves an epoch without used or accepted measurements pending
+  if (!used)
+    return;
+  FilterState prior;
+  if (lazy_prediction_)
+    SaveState(&prior);
+  PredictTo(epoch_us);
+  if (!UpdateEpoch(batch + first, n - first) && lazy_prediction_)
+    DiscardPrediction(prior);
+}
+
+
+void Filter::DiscardPrediction(const FilterState& prior) {
+  FilterState state;
+  SaveState(&state);
+  state.x = prior.x;
+  state.P = prior.P;
+  state.state_us = prior.state_us;
+  RestoreState(state);
+}
+
+
+void Filter::PredictTo(long long timestamp_us) {
+  if (lazy_prediction_) {
+    while (timestamp_us - state_us_ > kLazyMaxStepUs) {
+      Prediction(kLazyMaxStepUs / 1.0e6);
+      state_us_ += kLazyMaxStepUs;
+    }
+  }
+  Prediction((timestamp_us - state_us_) / 1.0e6); //time in seconds
+  state_us_ = timestamp_us;
+}
+
+
+const StateVector& Filter::StateAt(long long timestamp_us) {
+  if (is_initialized_ && timestamp_us > state_us_) {
+    PredictTo(timestamp_us);
+    time_us_ = std::max(time_us_, timestamp_us);
+  }
+  return x_;
+}
+
+
+const StateMatrix& Filter::CovarianceAt(long long timestamp_us) {
+  StateAt(timestamp_us);
+  return P_;
+}
+
+
+bool Filter::UpdateEpoch(const MeasurementPackage* batch, int n) {
+  bool applied = false;
+  for (int i = 0; i < n; i++)
+    if (UsesSensor(batch[i].sensor_type_))
+      applied = Update(batch[i]) || applied;
+  return applied;
+}
+
+
+namespace {
+
+// use flag of every sensor type
+bool Filter::* const use_sensor[MeasurementPackage::SENSOR_TYPES] = {
+  &Filter::use_laser_,
+  &Filter::use_radar_
+};
+
+template <class Model>
+void InitializeFrom(const MeasurementPackage::RawVector& z, StateVector* x) {
+  Model().Initialize(z, x);
+}
+
+// state initialization by the measurement model of every sensor type
+typedef void (*InitializeFunction)(const MeasurementPackage::RawVector& z, StateVector* x);
+const InitializeFunction initializers[MeasurementPackage::SENSOR_TYPES] = {
+  &InitializeFrom<LidarModel>,
+  &InitializeFrom<RadarModel>
+};
+
+const char* const sensor_names[MeasurementPackage::SENSOR_TYPES] = {
+  LidarModel::Name(),
+  RadarModel::Name()
+};
+
+static_assert(LidarModel::kSensor == 0 && RadarModel::kSensor == 1,
+              "the tables are indexed by sensor type");
+
+}
+
+
+bool Filter::UsesSensor(MeasurementPackage::SensorType sensor) const {
+  if (sensor < 0 || sensor >= MeasurementPackage::SENSOR_TYPES)
+    return false;
+  return this->*use_sensor[sensor];
+}
+
+
+bool Filter::InitializeState(const MeasurementPackage& meas_package) {
+  if (!UsesSensor(meas_package.sensor_type_))
+    return false;
+  if (verbose_)
+    cout << "Initial " << sensor_names[meas_package.sensor_type_] << " measurement received!" << endl;
+
+  initializers[meas_package.sensor_type_](meas_package.raw_measurements_, &x_);
+
+  // done initializing, no need to predict or update
+  is_initialized_ = true;
+  return true;
+}
@@ -2,6 +2,7 @@
 #define FILTER_H
 
 #include "measurement_package.h"
+#include "trig.h"
 #include <Eigen/Dense>
 #include <vector>
 #include <string>
@@ -11,8 +12,163 @@ using Eigen::MatrixXd;
 using Eigen::VectorXd;
 using std::vector;
 
+/**
+ * Compile time dimensions of the filter core. All vectors and matrices used in
+ * the predict / update cycle are fixed size Eigen types derived from the
+ * state dimension NX and the augmented state dimension NAUG, so no heap
+ * allocation takes place while filtering.
+ */
+template <int NX, int NAUG>
+struct FilterDimensions {
+  enum {
+    kStateDim     = NX,
+    kAugStateDim  = NAUG,
+    kSigmaPoints  = 2 * NAUG + 1
+  };
+
+  typedef Eigen::Matrix<double, NX, 1>                 StateVector;
+  typedef Eigen::Matrix<double, NX, NX>                StateMatrix;
+  typedef Eigen::Matrix<double, NAUG, 1>               AugStateVector;
+  typedef Eigen::Matrix<double, NAUG, NAUG>            AugStateMatrix;
+  // sigma point matrices are row major, so every row holds one component of
+  // all sigma points contiguously as expected by the CTRV kernels
+  typedef Eigen::Matrix<double, NX, kSigmaPoints, Eigen::RowMajor>    SigmaMatrix;
+  typedef Eigen::Matrix<double, NAUG, kSigmaPoints, Eigen::RowMajor>  AugSigmaMatrix;
+  typedef Eigen::Matrix<double, kSigmaPoints, 1>       WeightVector;
+  // single precision sigma points of CTRV_PRECISION_FLOAT
+  typedef Eigen::Matrix<float, NX, kSigmaPoints, Eigen::RowMajor>     SigmaMatrixF;
+  typedef Eigen::Matrix<float, NAUG, kSigmaPoints, Eigen::RowMajor>   AugSigmaMatrixF;
+
+  /**
+   * Types of a measurement with NZ dimensions
+   */
+  template <int NZ>
+  struct Measurement {
+    enum { kDim = NZ };
+    typedef Eigen::Matrix<double, NZ, 1>               Vector;
+    typedef Eigen::Matrix<double, NZ, NZ>              CovMatrix;
+    typedef Eigen::Matrix<double, NZ, NX>              ObsMatrix;
+    typedef Eigen::Matrix<double, NX, NZ>              GainMatrix;
+    typedef Eigen::Matrix<double, NZ, kSigmaPoints, Eigen::RowMajor>  SigmaMatrix;
+  };
+
+  /**
+   * Types of several measurements stacked into one vector of at most MAXNZ
+   * dimensions. The size is set at runtime within the fixed storage.
+   */
+  template <int MAXNZ>
+  struct StackedMeasurement {
+    enum { kMaxDim = MAXNZ };
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, Eigen::ColMajor, MAXNZ, 1>                Vector;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor, MAXNZ, MAXNZ> CovMatrix;
+    typedef Eigen::Matrix<double, NX, Eigen::Dynamic, Eigen::ColMajor, NX, MAXNZ>              GainMatrix;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, kSigmaPoints, Eigen::RowMajor, MAXNZ, kSigmaPoints> SigmaMatrix;
+  };
+};
+
+///* CTRV model: [pos1 pos2 vel_abs yaw_angle yaw_rate] augmented by [nu_a nu_yawdd]
+typedef FilterDimensions<5, 7> CTRV;
+typedef CTRV::StateVector StateVector;
+typedef CTRV::StateMatrix StateMatrix;
+
+///* lidar measures [pos1 pos2], radar measures [range bearing range_rate]
+typedef CTRV::Measurement<2> LaserMeasurement;
+typedef CTRV::Measurement<3> RadarMeasurement;
+
+///* measurements of one fusion epoch, processed with a single prediction
+enum { kMaxEpochMeasurements = 4 };
+typedef CTRV::StackedMeasurement<kMaxEpochMeasurements * RadarMeasurement::kDim> EpochMeasurement;
+
+/**
+ * Constants of the sensor and sigma point models. They are the same for every
+ * filter instance, so all filters reference one shared Default() instead of
+ * carrying their own copies, which keeps a track at its mutable state.
+ */
+struct FilterModelConfig {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  ///* Laser measurement noise standard deviations of position1 and position2 in m
+  double std_laspx;
+  double std_laspy;
+
+  ///* Radar measurement noise standard deviations of radius in m, angle in rad
+  ///* and radius change in m/s
+  double std_radr;
+  double std_radphi;
+  double std_radrd;
+
+  ///* measurement matrix for the linear kalman filter update from laser data
+  LaserMeasurement::ObsMatrix H_laser;
+
+  ///* Measurement noise matrices
+  LaserMeasurement::CovMatrix R_lidar;
+  RadarMeasurement::CovMatrix R_radar;
+
+  ///* Sigma point spreading parameter and weights of the sigma points
+  double lambda;
+  CTRV::WeightVector weights;
+
+  /**
+   * The model of the sensor manufacturer values, built on first use
+   */
+  static const FilterModelConfig& Default();
+};
+
+/**
+ * Gate on the NIS of a measurement. Measurements beyond the chi-square value
+ * of the gate probability are rejected before the gain is formed, they leave
+ * the state and the covariance unchanged.
+ */
+enum NisGate {
+  NIS_GATE_OFF = 0,
+  NIS_GATE_95,
+  NIS_GATE_99,
+  NIS_GATE_999
+};
+
+/**
+ * Gate probability in percent as used on the command line: 0, 95, 99 or 999
+ * for 99.9
+ */
+int NisGatePercent(NisGate gate);
+
+/**
+ * The gate of a percent value of NisGatePercent
+ * @return false for any other value
+ */
+bool ParseNisGate(int percent, NisGate* gate);
+
+/**
+ * The part of a filter which changes while filtering. Restoring it puts the
+ * filter back to the point where it was saved.
+ */
+struct FilterState {
+  StateVector x;
+  StateMatrix P;
+  long long time_us;
+  long long state_us;
+  bool is_initialized;
+  int timestep;
+  double nis_laser;
+  double nis_radar;
+  int nis_laser_counter;
+  int nis_radar_counter;
+  int gated_laser_counter;
+  int gated_radar_counter;
+  int gated_run;
+};
+
+///* longest single prediction step of a lazy filter, in us
+const long long kLazyMaxStepUs = 100000;
+
+///* measurements rejected in a row by the NIS gate before it lets them pass
+const int kMaxGatedRun = 4;
+
 class Filter {
 public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  virtual ~Filter() {}
 
   ///* initially set to false, set to true in first call of ProcessMeasurement
   bool is_initialized_;
@@ -24,23 +180,24 @@ public:
   bool use_radar_;
 
   ///* state vector: [pos1 pos2 vel_abs yaw_angle yaw_rate] in SI units and rad
-  VectorXd x_;
+  StateVector x_;
 
   ///* state covariance matrix
-  MatrixXd P_;
+  StateMatrix P_;
 
-  //measurement matrix for linear kalman filter update from laser scanner data
-  MatrixXd H_laser_;
+  ///* shared sensor noise, measurement matrix and sigma point weights
+  const FilterModelConfig* model_;
 
-  // jacobian containing the measurement matrix for radar measurements
-  MatrixXd H_radar_;
+  ///* timestamp of the latest measurement, in us
+  long long time_us_;
 
-  // Measurement noise matricies
-  MatrixXd R_lidar_;
-  MatrixXd R_radar_;
+  ///* time when x_ and P_ are true, in us. It lags time_us_ while a lazy
+  ///* prediction is pending.
+  long long state_us_;
 
-  ///* time when the state is true, in us
-  long long time_us_;
+  ///* if this is true, the prediction is deferred until an update or a query
+  ///* through StateAt needs the state
+  bool lazy_prediction_;
 
   ///* Process noise standard deviation longitudinal acceleration in m/s^2
   double std_a_;
@@ -48,21 +205,6 @@ public:
   ///* Process noise standard deviation yaw acceleration in rad/s^2
   double std_yawdd_;
 
-  ///* Laser measurement noise standard deviation position1 in m
-  double std_laspx_;
-
-  ///* Laser measurement noise standard deviation position2 in m
-  double std_laspy_;
-
-  ///* Radar measurement noise standard deviation radius in m
-  double std_radr_;
-
-  ///* Radar measurement noise standard deviation angle in rad
-  double std_radphi_;
-
-  ///* Radar measurement noise standard deviation radius change in m/s
-  double std_radrd_ ;
-
   ///* State dimension
   int n_x_;
 
@@ -81,6 +223,21 @@ public:
   int nis_laser_counter_;
   int nis_radar_counter_;
 
+  //* Gaussian log-likelihood of the innovation of the last applied update,
+  //* from the same factorization of S as the gain and the NIS. A stacked
+  //* update gives the joint value of all its measurements.
+  double log_likelihood_;
+
+  //* Gate on the NIS, the number of measurements it rejected per sensor and
+  //* the number of measurements rejected since the last one within the gate
+  NisGate nis_gate_;
+  int gated_laser_counter_;
+  int gated_radar_counter_;
+  int gated_run_;
+
+  //* Evaluation of the sine and cosine of the process model
+  TrigMode trig_mode_;
+
 
   /**
    * Filter initialization
@@ -92,7 +249,16 @@ public:
    * ProcessMeasurement
    * @param meas_package The latest measurement data of either radar or laser
    */
-  virtual void ProcessMeasurement(MeasurementPackage meas_package) = 0;
+  virtual void ProcessMeasurement(const MeasurementPackage& meas_package) = 0;
+
+  /**
+   * Processes the measurements of one fusion epoch. The filter is predicted
+   * once to the latest timestamp of the epoch and then updated with all of
+   * them by UpdateEpoch. A single measurement is passed to ProcessMeasurement.
+   * @param batch Measurements in time order
+   * @param n Number of measurements
+   */
+  virtual void ProcessMeasurements(const MeasurementPackage* batch, int n);
 
   /**
    * Prediction Predicts sigma points, the state, and the state covariance
@@ -107,13 +273,74 @@ public:
    * the measurement equations are linear (we measure the position states directly).
    * @param {MeasurementPackage} meas_package
    */
-  virtual void UpdateLidar(MeasurementPackage meas_package) = 0;
+  virtual void UpdateLidar(const MeasurementPackage& meas_package) = 0;
 
   /**
    * Updates the state and the state covariance matrix using a radar measurement
    * @param meas_package The measurement at k+1
    */
-  virtual void UpdateRadar(MeasurementPackage meas_package) = 0;
+  virtual void UpdateRadar(const MeasurementPackage& meas_package) = 0;
+
+  /**
+   * Updates the state and the state covariance matrix with a measurement of
+   * any sensor type, looked up in the update table of the filter
+   * @param meas_package The measurement at k+1
+   * @return false if the measurement was not applied: its sensor is not
+   * used, it failed the NIS gate or its model could not be linearized
+   */
+  virtual bool Update(const MeasurementPackage& meas_package) = 0;
+
+  /**
+   * Returns whether measurements of a sensor type are used for updates.
+   * Unknown sensor types are never used.
+   */
+  bool UsesSensor(MeasurementPackage::SensorType sensor) const;
+
+  /**
+   * Initializes the state from the first measurement of a used sensor type
+   * with the measurement model of that sensor
+   * @return true if the measurement initialized the filter
+   */
+  bool InitializeState(const MeasurementPackage& meas_package);
+
+  /**
+   * Updates the predicted state with all measurements of an epoch. The
+   * default applies Update to them one after the other.
+   * @param batch Measurements of the epoch
+   * @param n Number of measurements
+   * @return true if any measurement was applied
+   */
+  virtual bool UpdateEpoch(const MeasurementPackage* batch, int n);
+
+  /**
+   * Puts x_, P_ and state_us_ back to the values of prior, which was saved
+   * before a prediction. A lazy filter uses it when all measurements which
+   * needed the prediction were rejected, so their time stays pending.
+   */
+  void DiscardPrediction(const FilterState& prior);
+
+  /**
+   * Predicts x_ and P_ from state_us_ to timestamp_us. In lazy mode the
+   * pending time is folded into as few steps as possible, at most
+   * kLazyMaxStepUs each, because the CTRV model holds the turn rate and the
+   * noise accelerations constant over a step.
+   */
+  void PredictTo(long long timestamp_us);
+
+  /**
+   * State and covariance at timestamp_us. A pending prediction up to
+   * timestamp_us is carried out first, which moves the filter to that time
+   * like a measurement without an update. Earlier timestamps return the
+   * current estimate.
+   */
+  const StateVector& StateAt(long long timestamp_us);
+  const StateMatrix& CovarianceAt(long long timestamp_us);
+
+  /**
+   * Saves and restores the time dependent state of the filter
+   */
+  virtual void SaveState(FilterState* state) const;
+  virtual void RestoreState(const FilterState& state);
 };
 
 #endif /* FILTER_H */
@@ -0,0 +1,74 @@
+#include "filter_history.h"
+
+using namespace std;
+
+
+FilterHistory::FilterHistory(Filter* filter, size_t capacity)
+  : filter_(filter),
+    ring_(capacity < 1 ? 1 : capacity),
+    first_(0),
+    size_(0),
+    complete_(true),
+    rewinds_(0),
+    replayed_(0),
+    dropped_(0) {
+  suffix_.reserve(ring_.size());
+}
+
+
+void FilterHistory::Clear() {
+  first_ = 0;
+  size_ = 0;
+  // the state before the filter was changed can not be restored anymore
+  complete_ = false;
+}
+
+
+void FilterHistory::Process(const MeasurementPackage& meas_package) {
+  if (size_ == ring_.size()) {
+    // the oldest entry is overwritten, it can not be rewound anymore
+    first_ = (first_ + 1) % ring_.size();
+    size_--;
+    complete_ = false;
+  }
+  Entry& entry = At(size_++);
+  filter_->SaveState(&entry.state);
+  entry.meas_package = meas_package;
+  filter_->ProcessMeasurement(meas_package);
+}
+
+
+bool FilterHistory::ProcessMeasurement(const MeasurementPackage& meas_package) {
+  // in order, the common case
+  if (size_ == 0 || meas_package.timestamp_ >= At(size_ - 1).meas_package.timestamp_) {
+    Process(meas_package);
+    return true;
+  }
+
+  // first entry which is newer than the late measurement
+  size_t k = size_ - 1;
+  while (k > 0 && At(k - 1).meas_package.timestamp_ > meas_package.timestamp_)
+    k--;
+  if (k == 0 && !complete_) {
+    // the state before the oldest entry is still known, but not whether
+    // older measurements were applied before it
+    if (At(0).state.is_initialized && meas_package.timestamp_ < At(0).state.time_us) {
+      dropped_++;
+      return false;
+    }
+  }
+
+  // rewind to the state before entry k and replay in order
+  suffix_.clear();
+  for (size_t i = k; i < size_; i++)
+    suffix_.push_back(At(i).meas_package);
+  filter_->RestoreState(At(k).state);
+  size_ = k;
+
+  rewinds_++;
+  replayed_ += suffix_.size();
+  Process(meas_package);
+  for (size_t i = 0; i < suffix_.size(); i++)
+    Process(suffix_[i]);
+  return true;
+}
@@ -0,0 +1,73 @@
+#ifndef FILTER_HISTORY_H_
+#define FILTER_HISTORY_H_
+
+#include "filter.h"
+#include <vector>
+
+/**
+ * Out of sequence measurement handling for a filter.
+ *
+ * A fixed capacity ring keeps the last processed measurements together with
+ * the filter state right before each of them. A measurement which is older
+ * than the filter time rewinds the filter to the state before the first newer
+ * measurement and replays the late measurement and the newer ones in
+ * timestamp order. Only the suffix behind the late measurement is processed
+ * again, the result is the same as if all measurements had arrived in order.
+ *
+ * Measurements older than the oldest entry of a full ring can not be applied
+ * anymore and are dropped.
+ */
+class FilterHistory {
+public:
+  /**
+   * @param filter filter which processes the measurements, the caller keeps ownership
+   * @param capacity number of measurements that can be rewound
+   */
+  FilterHistory(Filter* filter, size_t capacity = 64);
+
+  /**
+   * Processes a measurement in timestamp order
+   * @return false if the measurement was too old and dropped
+   */
+  bool ProcessMeasurement(const MeasurementPackage& meas_package);
+
+  /**
+   * Forgets all entries, e.g. after the filter state was changed directly
+   */
+  void Clear();
+
+  Filter* GetFilter() const { return filter_; }
+  size_t Capacity() const { return ring_.size(); }
+  size_t Size() const { return size_; }
+
+  ///* number of rewinds, of measurements processed again by them and of dropped measurements
+  long Rewinds() const { return rewinds_; }
+  long Replayed() const { return replayed_; }
+  long Dropped() const { return dropped_; }
+
+private:
+  struct Entry {
+    FilterState state;            // filter state before the measurement
+    MeasurementPackage meas_package;
+  };
+
+  Filter* filter_;
+  std::vector<Entry> ring_;
+  size_t first_;                  // ring index of the oldest entry
+  size_t size_;
+
+  ///* true while the ring holds every measurement since the filter was created
+  bool complete_;
+
+  ///* measurements behind a late one, reused to keep rewinds allocation free
+  std::vector<MeasurementPackage> suffix_;
+
+  long rewinds_;
+  long replayed_;
+  long dropped_;
+
+  Entry& At(size_t i) { return ring_[(first_ + i) % ring_.size()]; }
+  void Process(const MeasurementPackage& meas_package);
+};
+
+#endif /* FILTER_HISTORY_H_ */
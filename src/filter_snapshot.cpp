@@ -0,0 +1,161 @@
+#include "filter_snapshot.h"
+#include "mapped_records.h"
+#include "ukf.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+namespace {
+
+SnapshotFilter FilterType(const Filter& filter) {
+  return (dynamic_cast<const UKF*>(&filter) != NULL) ? SNAPSHOT_FILTER_UKF : SNAPSHOT_FILTER_EKF;
+}
+
+}
+
+
+void ToSnapshotRecord(int track_id, const Filter& filter, FilterSnapshotRecord* record) {
+  FilterState state;
+  filter.SaveState(&state);
+  memset(record, 0, sizeof(FilterSnapshotRecord));
+  record->track_id       = track_id;
+  record->filter         = FilterType(filter);
+  record->is_initialized = state.is_initialized;
+  record->timestep       = state.timestep;
+  record->time_us        = state.time_us;
+  record->state_us       = state.state_us;
+  Eigen::Map<StateVector>(record->x) = state.x;
+  Eigen::Map<Eigen::Matrix<double, 5, 5, Eigen::RowMajor> >(record->P) = state.P;
+  record->nis_laser           = state.nis_laser;
+  record->nis_radar           = state.nis_radar;
+  record->nis_laser_counter   = state.nis_laser_counter;
+  record->nis_radar_counter   = state.nis_radar_counter;
+  record->gated_laser_counter = state.gated_laser_counter;
+  record->gated_radar_counter = state.gated_radar_counter;
+  record->gated_run           = state.gated_run;
+}
+
+
+bool FromSnapshotRecord(const FilterSnapshotRecord& record, Filter* filter) {
+  if (record.filter != FilterType(*filter))
+    return false;
+  FilterState state;
+  state.is_initialized = record.is_initialized != 0;
+  state.timestep       = record.timestep;
+  state.time_us        = record.time_us;
+  state.state_us       = record.state_us;
+  state.x = Eigen::Map<const StateVector>(record.x);
+  state.P = Eigen::Map<const Eigen::Matrix<double, 5, 5, Eigen::RowMajor> >(record.P);
+  state.nis_laser           = record.nis_laser;
+  state.nis_radar           = record.nis_radar;
+  state.nis_laser_counter   = record.nis_laser_counter;
+  state.nis_radar_counter   = record.nis_radar_counter;
+  state.gated_laser_counter = record.gated_laser_counter;
+  state.gated_radar_counter = record.gated_radar_counter;
+  state.gated_run           = record.gated_run;
+  filter->RestoreState(state);
+  return true;
+}
+
+
+FilterSnapshotWriter::FilterSnapshotWriter() : file_(NULL), record_count_(0) {}
+
+
+FilterSnapshotWriter::~FilterSnapshotWriter() {
+  Close();
+}
+
+
+bool FilterSnapshotWriter::Open(const string& path) {
+  Close();
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == NULL)
+    return false;
+  // reserve space for the header, it is written with the final count on Close
+  FilterSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  record_count_ = 0;
+  return fwrite(&header, sizeof(header), 1, file_) == 1;
+}
+
+
+bool FilterSnapshotWriter::Write(int track_id, const Filter& filter) {
+  FilterSnapshotRecord record;
+  ToSnapshotRecord(track_id, filter, &record);
+  if (fwrite(&record, sizeof(record), 1, file_) != 1)
+    return false;
+  record_count_++;
+  return true;
+}
+
+
+bool FilterSnapshotWriter::Close() {
+  if (file_ == NULL)
+    return true;
+  FilterSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FILTER_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version      = FILTER_SNAPSHOT_VERSION;
+  header.record_size  = sizeof(FilterSnapshotRecord);
+  header.record_count = record_count_;
+  bool ok = fseek(file_, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file_) == 1;
+  ok = (fclose(file_) == 0) && ok;
+  file_ = NULL;
+  return ok;
+}
+
+
+MappedFilterSnapshot::MappedFilterSnapshot() : data_(NULL), length_(0), records_(NULL), size_(0) {}
+
+
+MappedFilterSnapshot::~MappedFilterSnapshot() {
+  Close();
+}
+
+
+bool MappedFilterSnapshot::Open(const string& path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FilterSnapshotHeader)) {
+    close(fd);
+    return false;
+  }
+  length_ = st.st_size;
+  data_ = mmap(NULL, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = NULL;
+    return false;
+  }
+  // a restore reads every record once, front to back
+  madvise(data_, length_, MADV_SEQUENTIAL);
+
+  const FilterSnapshotHeader* header = static_cast<const FilterSnapshotHeader*>(data_);
+  if (!IsValidMappedHeader(*header, length_, FILTER_SNAPSHOT_MAGIC, FILTER_SNAPSHOT_VERSION,
+                           sizeof(FilterSnapshotRecord))) {
+    Close();
+    return false;
+  }
+  records_ = reinterpret_cast<const FilterSnapshotRecord*>(header + 1);
+  size_ = header->record_count;
+  return true;
+}
+
+
+void MappedFilterSnapshot::Close() {
+  if (data_ != NULL)
+    munmap(data_, length_);
+  data_ = NULL;
+  length_ = 0;
+  records_ = NULL;
+  size_ = 0;
+}
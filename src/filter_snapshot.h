@@ -0,0 +1,117 @@
+#ifndef FILTER_SNAPSHOT_H_
+#define FILTER_SNAPSHOT_H_
+
+#include "filter.h"
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+
+/**
+ * Binary snapshot of filters for warm restarts.
+ *
+ * A snapshot is a FilterSnapshotHeader followed by record_count fixed size
+ * FilterSnapshotRecords, one per track, in native byte order like the binary
+ * sensor logs. A record holds the FilterState of a filter, everything else is
+ * either configuration or derived from it: the UKF draws new sigma points from
+ * the restored covariance on its next prediction. The file is memory mapped
+ * and restored in place, so thousands of tracks restore in milliseconds.
+ */
+#define FILTER_SNAPSHOT_MAGIC    "UKFSNAP"
+#define FILTER_SNAPSHOT_VERSION  1
+
+enum SnapshotFilter {
+  SNAPSHOT_FILTER_UKF = 0,
+  SNAPSHOT_FILTER_EKF
+};
+
+struct FilterSnapshotHeader {
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  record_size;
+  uint64_t  record_count;
+};
+
+struct FilterSnapshotRecord {
+  int32_t   track_id;
+  int32_t   filter;           // SnapshotFilter
+  int32_t   is_initialized;
+  int32_t   timestep;
+  int64_t   time_us;
+  int64_t   state_us;
+  double    x[5];
+  double    P[25];            // row major
+  double    nis_laser;
+  double    nis_radar;
+  int32_t   nis_laser_counter;
+  int32_t   nis_radar_counter;
+  int32_t   gated_laser_counter;
+  int32_t   gated_radar_counter;
+  int32_t   gated_run;
+  int32_t   reserved;
+};
+
+static_assert(sizeof(FilterSnapshotRecord) == 312, "the snapshot record layout is part of the file format");
+
+/**
+ * Conversion between records and filters
+ */
+void ToSnapshotRecord(int track_id, const Filter& filter, FilterSnapshotRecord* record);
+
+/**
+ * Restores the filter from a record
+ * @return false if the record is of another filter type
+ */
+bool FromSnapshotRecord(const FilterSnapshotRecord& record, Filter* filter);
+
+/**
+ * Writes filters into a snapshot. The record count in the header is written
+ * on Close.
+ */
+class FilterSnapshotWriter {
+public:
+  FilterSnapshotWriter();
+  virtual ~FilterSnapshotWriter();
+
+  bool Open(const std::string& path);
+  bool Write(int track_id, const Filter& filter);
+  bool Close();
+
+private:
+  FILE* file_;
+  uint64_t record_count_;
+};
+
+/**
+ * Read only memory mapped view of a snapshot
+ */
+class MappedFilterSnapshot {
+public:
+  MappedFilterSnapshot();
+  virtual ~MappedFilterSnapshot();
+
+  /**
+   * Maps the snapshot, returns false if the file can't be mapped or is no
+   * valid snapshot of this version
+   */
+  bool Open(const std::string& path);
+  void Close();
+
+  size_t Size() const { return size_; }
+  const FilterSnapshotRecord& Record(size_t i) const { return records_[i]; }
+
+  /**
+   * Restores filter from record i
+   * @return false if the record is of another filter type
+   */
+  bool Restore(size_t i, Filter* filter) const {
+    return FromSnapshotRecord(records_[i], filter);
+  }
+
+private:
+  void* data_;
+  size_t length_;
+  const FilterSnapshotRecord* records_;
+  size_t size_;
+};
+
+#endif /* FILTER_SNAPSHOT_H_ */
@@ -1,19 +1,32 @@
 #include <uWS/uWS.h>
 #include <iostream>
 #include <cstdlib>
-#include "json.hpp"
 #include <math.h>
 #include "filter.h"
 #include "ukf.h"
 #include "ekf.h"
 #include "tools.h"
+#include "sensor_log.h"
+#include "output_writer.h"
+#include "replay.h"
+#include "sweep.h"
+#include "monte_carlo.h"
+#include "batch_replay.h"
+#include "tracking_pipeline.h"
+#include "async_filter.h"
+#include "filter_history.h"
+#include "filter_snapshot.h"
+#include "epoch_batcher.h"
+#include "telemetry.h"
+#include "stats.h"
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <sstream>
 #include <getopt.h>
 
 using namespace std;
 
-// for convenience
-using json = nlohmann::json;
-
 
 bool verbose = false;
 bool use_laser = true;
@@ -22,29 +35,41 @@ bool use_simulator = true;
 string inputDataFile  = "../data/obj_pose-laser-radar-synthetic-input.txt";
 string outputDataFile = "../data/obj_pose-fused-output.txt";
 string filter_choice  = "ukf";
+CtrvKernel ctrv_kernel = CTRV_KERNEL_AUTO;
+string convertLogFile = "";
+string saveStateFile = "";
+string loadStateFile = "";
+string outputFormat = "csv";
+long flushEvery = 0;
+string sweepMode = "";
+string sweepStdA = "0.2:2.0:10";
+string sweepStdYawdd = "0.1:1.0:10";
+string sweepFilters = "";
+string sweepSensors = "both";
+int sweepSamples = 100;
+unsigned sweepSeed = 1;
+int threads = 0;
+bool use_pipeline = false;
+bool use_async = false;
+int queue_size = 1024;
+int history = 0;
+long epoch_tolerance = -1;
+bool fast_trig = false;
+bool float_sigma = false;
+bool lazy_prediction = false;
+NisGate nis_gate = NIS_GATE_OFF;
+double stats_interval = 0;
+int mcTrials = 0;
+unsigned long mcSeed = 1;
+string mcFilters = "ukf,ekf";
+string batchInput = "";
+string batchOutputDir = "";
 
 // The following UKF process noise values achieve an RMSE of 
 // [0.0638, 0.084, 0.332, 0.217] in px, py, vx, vy.
 double std_a = 0.6;
 double std_yawdd = 0.4;
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-std::string hasData(std::string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.find_first_of("]");
-  if (found_null != std::string::npos) {
-    return "";
-  }
-  else if (b1 != std::string::npos && b2 != std::string::npos) {
-    return s.substr(b1, b2 - b1 + 1);
-  }
-  return "";
-}
-
-
 void PrintHelp() {
     std::cout <<
             "Help:\n"
@@ -57,6 +82,35 @@ void PrintHelp() {
             "  --use_simulator  <0|1>:      Use simulator for input and output or instead an input output csv file, default: "<< use_simulator<<"\n"
             "  --input_file     <path>:     Path to input csv file (only possible when simulator mode is not set), default: "<<inputDataFile<<"\n" 
             "  --output_file    <path>:     Path to output csv file (only possible when simulator mode is not set), default: "<<outputDataFile<<"\n"
+            "  --output_format  <csv|bin>:  Write the output file as csv text or as binary records, default: "<<outputFormat<<"\n"
+            "  --flush_every    <rows>:     Write the output file every <rows> rows instead of only when the buffer is full (0), default: "<<flushEvery<<"\n"
+            "  --sweep          <grid|random>: Replay the input file with many std_a/std_yawdd configurations in parallel and exit\n"
+            "  --sweep_std_a    <min:max:n>: std_a values of the sweep, n grid steps, default: "<<sweepStdA<<"\n"
+            "  --sweep_std_yawdd <min:max:n>: std_yawdd values of the sweep, n grid steps, default: "<<sweepStdYawdd<<"\n"
+            "  --sweep_samples  <num>:      Random samples per filter and sensor combination, default: "<<sweepSamples<<"\n"
+            "  --sweep_seed     <num>:      Seed of the random sweep, default: "<<sweepSeed<<"\n"
+            "  --sweep_filters  <ukf,ekf>:  Filters of the sweep, default: value of --filter\n"
+            "  --sweep_sensors  <both,laser,radar>: Sensor combinations of the sweep, default: "<<sweepSensors<<"\n"
+            "  --monte_carlo    <trials>:   Replay the ground truth of the input file with <trials> sets of synthesized measurements in parallel and exit\n"
+            "  --mc_seed        <num>:      Seed of the synthesized measurement noise, default: "<<mcSeed<<"\n"
+            "  --mc_filters     <ukf,ekf>:  Filters of the Monte Carlo evaluation, default: "<<mcFilters<<"\n"
+            "  --batch          <manifest|glob>: Replay every log of a manifest file or a quoted glob pattern in parallel, print the merged statistics and exit\n"
+            "  --batch_output_dir <dir>:    Write the fused output of every log of --batch and a summary.csv into <dir>, default: no output\n"
+            "  --threads        <num>:      Worker threads of the sweep, the batch and the pipeline, 0 uses all cores, default: "<<threads<<"\n"
+            "  --pipeline       <0|1>:      Track all objects of the input file with one filter per track id in parallel and print a summary per track, default: "<<use_pipeline<<"\n"
+            "  --async          <0|1>:      Run the filter on its own thread in simulator mode, default: "<<use_async<<"\n"
+            "  --queue_size     <num>:      Size of the measurement and estimate queues of --async, default: "<<queue_size<<"\n"
+            "  --history        <num>:      Apply out of sequence measurements by rewinding up to <num> measurements, 0 disables, default: "<<history<<"\n"
+            "  --epoch_tolerance <us>:      Fuse measurements up to <us> apart with a single prediction in csv mode, -1 disables, default: "<<epoch_tolerance<<"\n"
+            "  --fast_trig      <0|1>:      Approximate the sine and cosine of the process model by polynomials (abs. error < "<<TRIG_FAST_MAX_ERROR<<"), default: "<<fast_trig<<"\n"
+            "  --float_sigma    <0|1>:      Propagate the UKF sigma points in single precision, the mean and covariance stay double, default: "<<float_sigma<<"\n"
+            "  --lazy_prediction <0|1>:     Defer the prediction until a used measurement or an output needs the state, default: "<<lazy_prediction<<"\n"
+            "  --nis_gate       <0|95|99|999>: Reject measurements whose NIS is beyond the 95%, 99% or 99.9% chi-square value, 0 disables, default: "<<NisGatePercent(nis_gate)<<"\n"
+            "  --stats_interval <s>:        Print the timers and gauges every <s> seconds to stderr, needs a UKF_STATS build, 0 disables, default: "<<stats_interval<<"\n"
+            "  --convert_log    <path>:     Convert the input csv file into a binary sensor log at <path> and exit\n"
+            "  --save_state     <path>:     Write a snapshot of the filter, or of all tracks with --pipeline, to <path> at the end\n"
+            "  --load_state     <path>:     Start from the snapshot at <path>, measurements up to its time are skipped in csv mode\n"
+            "  --ctrv_kernel    <auto|scalar|avx2|avx512|neon>: UKF sigma point prediction kernel, default: "<<CtrvKernelName(ctrv_kernel)<<"\n"
             "  --help:                      Show help\n";
     exit(1);
 }
@@ -76,6 +130,35 @@ void ParseArgs(int argc, char *argv[])
           {"input_file",    1, nullptr, 'i'},
           {"output_file",   1, nullptr, 'o'},
           {"filter",        1, nullptr, 'f'},           
+          {"ctrv_kernel",   1, nullptr, 'k'},
+          {"convert_log",   1, nullptr, 'c'},
+          {"save_state",    1, nullptr, 'B'},
+          {"load_state",    1, nullptr, 'L'},
+          {"output_format", 1, nullptr, 't'},
+          {"flush_every",   1, nullptr, 'e'},
+          {"sweep",         1, nullptr, 'w'},
+          {"sweep_std_a",   1, nullptr, 'A'},
+          {"sweep_std_yawdd", 1, nullptr, 'Y'},
+          {"sweep_samples", 1, nullptr, 'N'},
+          {"sweep_seed",    1, nullptr, 'R'},
+          {"sweep_filters", 1, nullptr, 'F'},
+          {"sweep_sensors", 1, nullptr, 'S'},
+          {"monte_carlo",   1, nullptr, 'M'},
+          {"mc_seed",       1, nullptr, 'm'},
+          {"mc_filters",    1, nullptr, 'g'},
+          {"batch",         1, nullptr, 'b'},
+          {"batch_output_dir", 1, nullptr, 'd'},
+          {"threads",       1, nullptr, 'j'},
+          {"pipeline",      1, nullptr, 'p'},
+          {"async",         1, nullptr, 'q'},
+          {"queue_size",    1, nullptr, 'Q'},
+          {"history",       1, nullptr, 'H'},
+          {"epoch_tolerance", 1, nullptr, 'E'},
+          {"fast_trig",     1, nullptr, 'T'},
+          {"float_sigma",   1, nullptr, 'x'},
+          {"lazy_prediction", 1, nullptr, 'z'},
+          {"nis_gate",      1, nullptr, 'G'},
+          {"stats_interval", 1, nullptr, 'D'},
           {"help",          0, nullptr, 'h'},
           {nullptr,         0, nullptr, 0}
   };
@@ -116,6 +199,99 @@ void ParseArgs(int argc, char *argv[])
       case 'f':
         filter_choice = string(optarg);
         break;
+      case 'c':
+        convertLogFile = string(optarg);
+        break;
+      case 'B':
+        saveStateFile = string(optarg);
+        break;
+      case 'L':
+        loadStateFile = string(optarg);
+        break;
+      case 't':
+        outputFormat = string(optarg);
+        if (outputFormat != "csv" && outputFormat != "bin")
+          PrintHelp();
+        break;
+      case 'e':
+        flushEvery = atol(optarg);
+        break;
+      case 'w':
+        sweepMode = string(optarg);
+        if (sweepMode != "grid" && sweepMode != "random")
+          PrintHelp();
+        break;
+      case 'A':
+        sweepStdA = string(optarg);
+        break;
+      case 'Y':
+        sweepStdYawdd = string(optarg);
+        break;
+      case 'N':
+        sweepSamples = stoi(optarg);
+        break;
+      case 'R':
+        sweepSeed = stoul(optarg);
+        break;
+      case 'F':
+        sweepFilters = string(optarg);
+        break;
+      case 'S':
+        sweepSensors = string(optarg);
+        break;
+      case 'j':
+        threads = stoi(optarg);
+        break;
+      case 'p':
+        use_pipeline = (stoi(optarg) > 0) ? true : false;
+        break;
+      case 'q':
+        use_async = (stoi(optarg) > 0) ? true : false;
+        break;
+      case 'Q':
+        queue_size = stoi(optarg);
+        break;
+      case 'H':
+        history = max(0, stoi(optarg));
+        break;
+      case 'E':
+        epoch_tolerance = stol(optarg);
+        break;
+      case 'T':
+        fast_trig = (stoi(optarg) > 0) ? true : false;
+        break;
+      case 'x':
+        float_sigma = (stoi(optarg) > 0) ? true : false;
+        break;
+      case 'z':
+        lazy_prediction = (stoi(optarg) > 0) ? true : false;
+        break;
+      case 'G':
+        if (!ParseNisGate(stoi(optarg), &nis_gate))
+          PrintHelp();
+        break;
+      case 'M':
+        mcTrials = max(0, stoi(optarg));
+        break;
+      case 'm':
+        mcSeed = stoul(optarg);
+        break;
+      case 'g':
+        mcFilters = optarg;
+        break;
+      case 'b':
+        batchInput = string(optarg);
+        break;
+      case 'd':
+        batchOutputDir = string(optarg);
+        break;
+      case 'D':
+        stats_interval = stod(optarg);
+        break;
+      case 'k':
+        if (!CtrvParseKernel(optarg, &ctrv_kernel))
+          PrintHelp();
+        break;
       case 'h':
       default:
         PrintHelp();
@@ -125,81 +301,321 @@ void ParseArgs(int argc, char *argv[])
 }
 
 
-MeasurementPackage getMeasurement(string &sensor_measurement)
-{
-  MeasurementPackage meas_package;
-  istringstream iss(sensor_measurement);
-  long long timestamp;
-  float px, py, ro, theta, ro_dot, x_gt, y_gt, vx_gt, vy_gt, yaw_gt, yawrate_gt;
-
-  // reads first element from the current line
-  string sensor_type;
-  iss >> sensor_type;
-  meas_package.ground_truth_ = VectorXd(6);
-
-  if (sensor_type.compare("L") == 0) {
-        meas_package.sensor_type_ = MeasurementPackage::LASER;
-        meas_package.raw_measurements_ = VectorXd(2);
-        iss >> px;
-        iss >> py;
-        meas_package.raw_measurements_ << px, py;
-        iss >> timestamp;
-        meas_package.timestamp_ = timestamp;
-  } else if (sensor_type.compare("R") == 0) {
-        meas_package.sensor_type_ = MeasurementPackage::RADAR;
-        meas_package.raw_measurements_ = VectorXd(3);
-        iss >> ro;
-        iss >> theta;
-        iss >> ro_dot;
-        meas_package.raw_measurements_ << ro,theta, ro_dot;
-        iss >> timestamp;
-        meas_package.timestamp_ = timestamp;
+vector<string> SplitList(const string& list) {
+  vector<string> items;
+  stringstream ss(list);
+  string item;
+  while (getline(ss, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+
+// Parses the input file once and replays it with all sweep configurations
+int RunSweepMode() {
+  SweepSpec spec;
+  spec.filters = SplitList(sweepFilters.empty() ? filter_choice : sweepFilters);
+  spec.sensors = SplitList(sweepSensors);
+  spec.random = (sweepMode == "random");
+  spec.samples = sweepSamples;
+  spec.seed = sweepSeed;
+  spec.ctrv_kernel = ctrv_kernel;
+  spec.ctrv_precision = float_sigma ? CTRV_PRECISION_FLOAT : CTRV_PRECISION_DOUBLE;
+  spec.trig_mode = fast_trig ? TRIG_FAST : TRIG_EXACT;
+  spec.lazy_prediction = lazy_prediction;
+  spec.nis_gate = nis_gate;
+  if (!ParseSweepRange(sweepStdA, &spec.std_a) || !ParseSweepRange(sweepStdYawdd, &spec.std_yawdd)) {
+    cerr << "Invalid sweep range, expected <min:max:steps>" << endl;
+    return EXIT_FAILURE;
+  }
+  vector<FilterConfig> configs;
+  if (!SweepConfigs(spec, &configs)) {
+    cerr << "Invalid sweep filters or sensors: " << sweepFilters << " / " << sweepSensors << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<MeasurementPackage> measurements;
+  if (!LoadMeasurements(inputDataFile, &measurements)) {
+    cerr << "Cannot open input file: " << inputDataFile << endl;
+    return EXIT_FAILURE;
   }
 
-  iss >> x_gt;
-  iss >> y_gt;
-  iss >> vx_gt;
-  iss >> vy_gt;
-  iss >> yaw_gt;
-  iss >> yawrate_gt;
-  meas_package.ground_truth_ << x_gt, y_gt, vx_gt, vy_gt, yaw_gt, yawrate_gt;
-  return meas_package;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<ReplayResult> results = RunSweep(configs, measurements, threads);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  PrintSweep(configs, results);
+  cout << configs.size() << " configurations over " << measurements.size() << " measurements in "
+       << seconds << " s" << endl;
+  return 0;
 }
 
 
+// Evaluates the filters over many sets of measurements synthesized from the
+// ground truth of the input file
+int RunMonteCarloMode() {
+  vector<FilterConfig> configs;
+  vector<string> filters = SplitList(mcFilters);
+  for (size_t i = 0; i < filters.size(); i++) {
+    if (filters[i] != "ukf" && filters[i] != "ekf") {
+      cerr << "Invalid Monte Carlo filter: " << filters[i] << endl;
+      return EXIT_FAILURE;
+    }
+    FilterConfig config;
+    config.filter = filters[i];
+    config.std_a = std_a;
+    config.std_yawdd = std_yawdd;
+    config.use_laser = use_laser;
+    config.use_radar = use_radar;
+    config.ctrv_kernel = ctrv_kernel;
+    config.ctrv_precision = float_sigma ? CTRV_PRECISION_FLOAT : CTRV_PRECISION_DOUBLE;
+    config.trig_mode = fast_trig ? TRIG_FAST : TRIG_EXACT;
+    config.lazy_prediction = lazy_prediction;
+    config.nis_gate = nis_gate;
+    config.epoch_tolerance_us = epoch_tolerance;
+    configs.push_back(config);
+  }
+
+  // all filters assume the same sensor noise, the first one provides it
+  MonteCarloSpec spec;
+  spec.trials = mcTrials;
+  spec.seed = mcSeed;
+  if (configs.empty() || !MonteCarloSensorNoise(configs[0], &spec)) {
+    cerr << "No Monte Carlo filters given" << endl;
+    return EXIT_FAILURE;
+  }
+
+  vector<MeasurementPackage> truth;
+  if (!LoadMeasurements(inputDataFile, &truth)) {
+    cerr << "Cannot open input file: " << inputDataFile << endl;
+    return EXIT_FAILURE;
+  }
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<MonteCarloResult> results = RunMonteCarlo(spec, configs, truth, threads);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  PrintMonteCarlo(configs, results);
+  cout << mcTrials << " trials of " << truth.size() << " measurements with " << configs.size()
+       << " filters in " << seconds << " s" << endl;
+  return 0;
+}
+
+
+// Replays many logs of a manifest or a glob pattern with one filter each
+int RunBatchMode(const FilterConfig& config) {
+  BatchSpec spec;
+  const bool pattern = batchInput.find_first_of("*?[") != string::npos;
+  if (pattern ? !ExpandGlob(batchInput, &spec.inputs) : !ReadManifest(batchInput, &spec.inputs)) {
+    cerr << "No input files in " << (pattern ? "pattern: " : "manifest: ") << batchInput << endl;
+    return EXIT_FAILURE;
+  }
+  spec.output_dir = batchOutputDir;
+  spec.output_format = outputFormat;
+  spec.flush_every = flushEvery;
+  spec.threads = threads;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  int workers = 0;
+  vector<BatchFileResult> results = RunBatch(config, spec, &workers);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  PrintBatchSummary(results, seconds, workers);
+  size_t replayed = 0;
+  for (size_t i = 0; i < results.size(); i++)
+    replayed += results[i].ok ? 1 : 0;
+  if (!batchOutputDir.empty()) {
+    const string summary = batchOutputDir + "/summary.csv";
+    if (!WriteBatchSummary(summary, results)) {
+      cerr << "Failed to write batch summary: " << summary << endl;
+      return EXIT_FAILURE;
+    }
+    cout << "Wrote " << replayed << " outputs and " << summary << endl;
+  }
+  return (replayed == results.size()) ? 0 : EXIT_FAILURE;
+}
+
+
+// Publishes the RMSE to the stats gauges
+void RecordRmseGauges(const RmseVector& rmse) {
+  STATS_GAUGE(STATS_RMSE_PX, rmse(0));
+  STATS_GAUGE(STATS_RMSE_PY, rmse(1));
+  STATS_GAUGE(STATS_RMSE_VX, rmse(2));
+  STATS_GAUGE(STATS_RMSE_VY, rmse(3));
+}
+
+
+// Sends an estimate marker with the current RMSE to the simulator
+void SendEstimate(uWS::WebSocket<uWS::SERVER> ws, const FilterEstimate& estimate) {
+  char msg[TELEMETRY_MAX_REPLY];
+  size_t length = FormatEstimateReply(estimate, msg);
+  ws.send(msg, length, uWS::OpCode::TEXT);
+}
+
+
+void PrintAsyncStats(const AsyncFilterStats& stats) {
+  cout << "Async filter: " << stats.submitted << " submitted, " << stats.dropped << " dropped, "
+       << stats.processed << " processed, " << stats.estimates_dropped << " estimates dropped, queue depth "
+       << stats.input_depth << " (max " << stats.max_input_depth << "), " << stats.output_depth
+       << " estimates pending" << endl;
+  if (history > 0)
+    cout << "Out of sequence: " << stats.rewinds << " rewinds, " << stats.replayed << " measurements replayed, "
+         << stats.history_dropped << " dropped" << endl;
+}
+
+
+// Streams the input file into a TrackingPipeline with one filter per track id
+int RunPipelineMode(const FilterConfig& config) {
+  TrackingPipeline pipeline(config, threads);
+  if (!loadStateFile.empty()) {
+    long restored = pipeline.LoadSnapshot(loadStateFile);
+    if (restored < 0) {
+      cerr << "Invalid " << config.filter << " snapshot: " << loadStateFile << endl;
+      return EXIT_FAILURE;
+    }
+    cout << "Restored " << restored << " tracks from " << loadStateFile << endl;
+  }
+  MeasurementPackage meas_package;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  long count = 0;
+  if (IsBinarySensorLog(inputDataFile)) {
+    MappedSensorLog log;
+    if (!log.Open(inputDataFile)) {
+      cerr << "Invalid binary sensor log: " << inputDataFile << endl;
+      return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < log.Size(); i++, count++) {
+      log.Get(i, &meas_package);
+      pipeline.Push(meas_package);
+    }
+  } else {
+    TextLogReader reader;
+    if (!reader.Open(inputDataFile)) {
+      cerr << "Cannot open input file: " << inputDataFile << endl;
+      return EXIT_FAILURE;
+    }
+    for (; reader.Next(&meas_package); count++)
+      pipeline.Push(meas_package);
+  }
+  pipeline.Flush();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  vector<TrackingPipeline::TrackSummary> summary = pipeline.Summary();
+  for (size_t i = 0; i < summary.size(); i++) {
+    const TrackingPipeline::TrackSummary& t = summary[i];
+    const double steps = max(1, t.timestep);
+    cout << "Track " << t.track_id << ": " << t.measurements << " measurements, " << t.dropped << " dropped, "
+         << "RMSE=[" << t.rmse(0) << ", " << t.rmse(1) << ", " << t.rmse(2) << ", " << t.rmse(3) << "], "
+         << "NIS(laser)=" << 100.0 * t.nis_laser_counter / steps << "%, "
+         << "NIS(radar)=" << 100.0 * t.nis_radar_counter / steps << "%";
+    if (config.nis_gate != NIS_GATE_OFF)
+      cout << ", gated=" << t.gated_laser_counter << "/" << t.gated_radar_counter;
+    cout << endl;
+  }
+  cout << count << " measurements of " << summary.size() << " tracks on " << pipeline.Threads()
+       << " threads in " << seconds << " s (" << pipeline.Steals() << " steals)" << endl;
+  if (!saveStateFile.empty()) {
+    if (!pipeline.SaveSnapshot(saveStateFile)) {
+      cerr << "Failed to write snapshot: " << saveStateFile << endl;
+      return EXIT_FAILURE;
+    }
+    cout << "Saved " << summary.size() << " tracks to " << saveStateFile << endl;
+  }
+  return 0;
+}
+
 
 int main(int argc, char *argv[])
 {
   // Parse cmd args
   ParseArgs(argc, argv);
 
+  if (!convertLogFile.empty()) {
+    long count = ConvertTextLog(inputDataFile, convertLogFile);
+    if (count < 0) {
+      cerr << "Failed to convert " << inputDataFile << " into " << convertLogFile << endl;
+      exit(EXIT_FAILURE);
+    }
+    cout << "Converted " << count << " measurements into binary sensor log " << convertLogFile << endl;
+    return 0;
+  }
+
+#ifdef UKF_STATS
+  // dumps the stats periodically and once more at the end of main
+  std::unique_ptr<StatsDumper> stats_dumper;
+  if (stats_interval > 0)
+    stats_dumper.reset(new StatsDumper(stderr, stats_interval));
+#else
+  if (stats_interval > 0)
+    cerr << "--stats_interval needs a build with -DUKF_STATS=ON, ignored" << endl;
+#endif
+
+  if (!sweepMode.empty())
+    return RunSweepMode();
+  if (mcTrials > 0)
+    return RunMonteCarloMode();
+
   cout << "========== Filter config ==========" << endl << "filter_choice="<< filter_choice << ", use_laser="<<use_laser<< ", use_radar="<<use_radar <<
           ", verbose="<<verbose << ", std_a="<<std_a << ", std_yawdd="<<std_yawdd << endl;
   if (!use_simulator)
     cout << "CSV input file: " << inputDataFile << endl << "CSV output file: " << outputDataFile << endl;
 
   // Create a generic filter
-  Filter* filter;
-  
-  if (filter_choice.compare("ukf") == 0) {
-    filter = new UKF(verbose, use_laser, use_radar, std_a, std_yawdd);
-  } else {
-    filter = new EKF(verbose, use_laser, use_radar, std_a, std_yawdd);
+  FilterConfig config;
+  config.filter = (filter_choice.compare("ukf") == 0) ? "ukf" : "ekf";
+  config.std_a = std_a;
+  config.std_yawdd = std_yawdd;
+  config.use_laser = use_laser;
+  config.use_radar = use_radar;
+  config.verbose = verbose;
+  config.ctrv_kernel = ctrv_kernel;
+  config.ctrv_precision = float_sigma ? CTRV_PRECISION_FLOAT : CTRV_PRECISION_DOUBLE;
+  config.trig_mode = fast_trig ? TRIG_FAST : TRIG_EXACT;
+  config.lazy_prediction = lazy_prediction;
+  config.nis_gate = nis_gate;
+  config.history = history;
+  config.epoch_tolerance_us = epoch_tolerance;
+  if (!batchInput.empty())
+    return RunBatchMode(config);
+  Filter* filter = CreateFilter(config);
+  // a warm start continues from the snapshot, older measurements of the
+  // input file are skipped
+  long long restored_us = numeric_limits<long long>::min();
+  if (!loadStateFile.empty() && !(use_pipeline && !use_simulator)) {
+    MappedFilterSnapshot snapshot;
+    if (!snapshot.Open(loadStateFile) || snapshot.Size() == 0 || !snapshot.Restore(0, filter)) {
+      cerr << "Invalid " << config.filter << " snapshot: " << loadStateFile << endl;
+      exit(EXIT_FAILURE);
+    }
+    restored_us = filter->time_us_;
+    cout << "Restored filter state at " << restored_us << " us from " << loadStateFile << endl;
+  }
+  if (config.filter == "ukf")
+    cout << "CTRV kernel: " << CtrvKernelName(CtrvResolveKernel(ctrv_kernel)) << ", "
+         << CtrvPrecisionName(config.ctrv_precision) << " sigma points" << endl;
+  if (use_pipeline && !use_simulator) {
+    delete filter;
+    return RunPipelineMode(config);
   }
 
-  // used to compute the RMSE later
-  Tools tools;
-  vector<VectorXd> estimations;
-  vector<VectorXd> ground_truth;
-  VectorXd RMSE;
-  ifstream in_file(inputDataFile.c_str(), ifstream::in);
-  ofstream out_file(outputDataFile.c_str(), ofstream::out);
+  // used to compute the RMSE later, updated in constant time per measurement
+  RmseAccumulator rmse;
 
-  if (!in_file.is_open()) {
-    cerr << "Cannot open input file: " << inputDataFile << endl;
-    exit(EXIT_FAILURE);
-  }
-  if (!out_file.is_open()) {
+  // late measurements are rewound into the filter instead of being applied
+  // with a negative time step. An AsyncFilter keeps its own history on the
+  // filter thread and reports it with its statistics.
+  const bool async_mode = use_simulator && use_async;
+  FilterHistory* filter_history = (history > 0 && !async_mode) ? new FilterHistory(filter, history) : NULL;
+
+  // fused output rows are collected in a large buffer and written in blocks
+  BufferedOutputWriter* out_file;
+  if (outputFormat == "bin")
+    out_file = new BinaryOutputWriter(1 << 20, flushEvery);
+  else
+    out_file = new CsvOutputWriter(1 << 20, flushEvery);
+
+  if (!out_file->Open(outputDataFile)) {
     cerr << "Cannot open output file: " << outputDataFile << endl;
     exit(EXIT_FAILURE);
   }
@@ -208,63 +624,76 @@ int main(int argc, char *argv[])
   if (use_simulator)
   {
     uWS::Hub h;
-    h.onMessage([filter, &tools, &estimations, &ground_truth](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode)
+
+    // with --async the socket thread only decodes messages, the filter runs on
+    // its own thread and its estimates are sent with the next answer
+    AsyncFilter* async_filter = async_mode ? new AsyncFilter(filter, queue_size, history) : NULL;
+    FilterEstimate last_estimate;
+    bool have_estimate = false;
+
+    h.onMessage([filter, filter_history, &rmse, async_filter, &last_estimate, &have_estimate](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode)
     {
-      // "42" at the start of the message means there's a websocket message event.
-      // The 4 signifies a websocket message
-      // The 2 signifies a websocket event
-      if (length > 2 && data[0] == '4' && data[1] == '2')
-      {
-        auto s = hasData(std::string(data));
-        if (s != "") {
-          auto j = json::parse(s);
-          std::string event = j[0].get<std::string>();
-          
-          if (event == "telemetry")
-          {
-            // j[1] is the data JSON object
-            string sensor_measurement = j[1]["sensor_measurement"];
-            MeasurementPackage meas_package = getMeasurement(sensor_measurement);
-
-            //Call ProcessMeasurment(meas_package) for Kalman filter
-            filter->ProcessMeasurement(meas_package);    	  
-
-            //Push the current estimated x,y positon from the Kalman filter's state vector
-            VectorXd estimate(4);
-            double p_x = filter->x_(0);
-            double p_y = filter->x_(1);
-            double v   = filter->x_(2);
-            double yaw = filter->x_(3);
-            double v1  = cos(yaw)*v;
-            double v2  = sin(yaw)*v;
-            estimate << p_x, p_y, v1, v2;
-            estimations.push_back(estimate);
-            ground_truth.push_back(meas_package.ground_truth_.head(4));
-
-            VectorXd RMSE = tools.CalculateRMSE(estimations, ground_truth);
-
-            json msgJson;
-            msgJson["estimate_x"] = p_x;
-            msgJson["estimate_y"] = p_y;
-            msgJson["rmse_x"] =  RMSE(0);
-            msgJson["rmse_y"] =  RMSE(1);
-            msgJson["rmse_vx"] = RMSE(2);
-            msgJson["rmse_vy"] = RMSE(3);
-            auto msg = "42[\"estimate_marker\"," + msgJson.dump() + "]";
-            // std::cout << msg << std::endl;
-            ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-          }
-        } else {
-          std::string msg = "42[\"manual\",{}]";
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+      // the frame is decoded in place, the reply is written into a stack buffer
+      MeasurementPackage meas_package;
+      TelemetryFrame frame = ParseTelemetryFrame(data, length, &meas_package);
+      if (frame == TELEMETRY_MANUAL) {
+        ws.send(kManualReply, kManualReplyLength, uWS::OpCode::TEXT);
+        return;
+      }
+      if (frame != TELEMETRY_MEASUREMENT)
+        return;
+
+      if (async_filter != NULL) {
+        async_filter->Submit(meas_package);
+        bool sent = false;
+        while (async_filter->PollEstimate(&last_estimate)) {
+          SendEstimate(ws, last_estimate);
+          have_estimate = sent = true;
+        }
+        // the simulator waits for an answer, repeat the newest estimate
+        // while the filter thread is behind
+        if (!sent) {
+          if (have_estimate)
+            SendEstimate(ws, last_estimate);
+          else
+            ws.send(kManualReply, kManualReplyLength, uWS::OpCode::TEXT);
         }
+        return;
       }
+
+      //Call ProcessMeasurment(meas_package) for Kalman filter
+      if (filter_history != NULL)
+        filter_history->ProcessMeasurement(meas_package);
+      else
+        filter->ProcessMeasurement(meas_package);
+
+      //Push the current estimated x,y positon from the Kalman filter's state vector
+      const StateVector& x = filter->StateAt(meas_package.timestamp_);
+      rmse.Add(CartesianEstimate(x), meas_package.ground_truth_);
+
+      FilterEstimate estimate;
+      estimate.timestamp = meas_package.timestamp_;
+      estimate.x = x(0);
+      estimate.y = x(1);
+      estimate.rmse = rmse.Rmse();
+      RecordRmseGauges(estimate.rmse);
+      SendEstimate(ws, estimate);
     });
 
     // We don't need this since we're not using HTTP but if it's removed the program
     // doesn't compile :-(
     h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data, size_t, size_t) {
       const std::string s = "<h1>Hello world!</h1>";
+#ifdef UKF_STATS
+      // scrape endpoint of the timers and gauges
+      uWS::Header url = req.getUrl();
+      if (url.valueLength == 6 && std::string(url.value, url.valueLength) == "/stats") {
+        std::string stats;
+        Stats::Global().Format(&stats);
+        res->end(stats.data(), stats.length());
+        return;
+      }
+#endif
       if (req.getUrl().valueLength == 1)
       {
         res->end(s.data(), s.length());
@@ -280,9 +709,11 @@ int main(int argc, char *argv[])
       std::cout << "Connected!!!" << std::endl;
     });
 
-    h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+    h.onDisconnection([&h, async_filter](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
       ws.close();
       std::cout << "Disconnected" << std::endl;
+      if (async_filter != NULL)
+        PrintAsyncStats(async_filter->Stats());
     });
 
     int port = 4567;
@@ -296,46 +727,76 @@ int main(int argc, char *argv[])
       return -1;
     }
     h.run();
+    if (async_filter != NULL) {
+      // the final statistics below read the filter, so its thread has to end
+      async_filter->Stop();
+      rmse.Merge(async_filter->Rmse());
+      PrintAsyncStats(async_filter->Stats());
+      delete async_filter;
+    }
   }
   else
   {
     // In this case we don't use the simulator for measurement input and RMSE output,
     // instead we read measurement input from a csv file and write out filtered data
     // and ground truth out into another csv file.
-    string seperator = ", ";
-    Eigen::IOFormat CSVFormat(Eigen::StreamPrecision, Eigen::DontAlignCols, ", ", seperator, "", "", "", "");
-    string line = "# px,  py,  v,  yaw,  yawrate,  nis_laser,  nis_radar,  " 
-                  "px_true,  py_true,  vx_true,  vy_true,  yaw_true,  yawrate_true,  "
-                  "rmse_px,  rmse_py,  rmse_vx,  rmse_vy";
-    out_file << line << endl;
-
-    while (getline(in_file, line)) {
-      string sensor_type;
-      MeasurementPackage meas_package = getMeasurement(line);
-
-      //Call ProcessMeasurment(meas_package) for Kalman filter
-      filter->ProcessMeasurement(meas_package);       
-
+    FusedRecord record;
+    auto write_row = [&](const MeasurementPackage& meas_package) {
       //Push the current estimated x,y positon from the Kalman filter's state vector
-      VectorXd estimate(4);
-      double p_x = filter->x_(0);
-      double p_y = filter->x_(1);
-      double v   = filter->x_(2);
-      double yaw = filter->x_(3);
-      double v1  = cos(yaw)*v;
-      double v2  = sin(yaw)*v;
-      estimate << p_x, p_y, v1, v2;
-      estimations.push_back(estimate);
-      ground_truth.push_back(meas_package.ground_truth_.head(4));
-      RMSE = tools.CalculateRMSE(estimations, ground_truth);
-      out_file << filter->x_.format(CSVFormat) << seperator << filter->nis_laser_  << seperator << filter->nis_radar_ << seperator
-              << meas_package.ground_truth_.format(CSVFormat) << seperator << RMSE.format(CSVFormat) << endl;
+      rmse.Add(CartesianEstimate(filter->StateAt(meas_package.timestamp_)), meas_package.ground_truth_);
+      RmseVector current = rmse.Rmse();
+      RecordRmseGauges(current);
+      MakeFusedRecord(*filter, meas_package, current, &record);
+      out_file->Write(record);
+    };
+    // measurements of one fusion epoch share a prediction, every one of them
+    // still gets its own output row with the state after the epoch
+    auto process_epoch = [&](const MeasurementPackage* batch, int n) {
+      filter->ProcessMeasurements(batch, n);
+      for (int k = 0; k < n; k++)
+        write_row(batch[k]);
+    };
+    EpochBatcher batcher((filter_history != NULL) ? -1 : epoch_tolerance);
+    auto process = [&](const MeasurementPackage& meas_package) {
+      if (meas_package.timestamp_ <= restored_us)
+        return;
+      //Call ProcessMeasurment(meas_package) for Kalman filter
+      if (filter_history != NULL) {
+        filter_history->ProcessMeasurement(meas_package);
+        write_row(meas_package);
+      } else {
+        batcher.Add(meas_package, process_epoch);
+      }
+    };
+
+    if (IsBinarySensorLog(inputDataFile)) {
+      // binary logs are memory mapped and replayed without any parsing
+      MappedSensorLog log;
+      if (!log.Open(inputDataFile)) {
+        cerr << "Invalid binary sensor log: " << inputDataFile << endl;
+        exit(EXIT_FAILURE);
+      }
+      MeasurementPackage meas_package;
+      for (size_t i = 0; i < log.Size(); i++) {
+        log.Get(i, &meas_package);
+        process(meas_package);
+      }
+    } else {
+      // text logs are parsed in place from a large read buffer
+      TextLogReader reader;
+      if (!reader.Open(inputDataFile)) {
+        cerr << "Cannot open input file: " << inputDataFile << endl;
+        exit(EXIT_FAILURE);
+      }
+      MeasurementPackage meas_package;
+      while (reader.Next(&meas_package)) {
+        process(meas_package);
+      }
     }
+    batcher.Flush(process_epoch);
 
-    if (out_file.is_open())
-      out_file.close();
-    if (in_file.is_open())
-      in_file.close();
+    if (!out_file->Close())
+      cerr << "Failed to write output file: " << outputDataFile << endl;
   }
 
   cout << "Final NIS(laser): ";
@@ -344,8 +805,25 @@ int main(int argc, char *argv[])
   cout << "Final NIS(radar): ";
   cout << 100.0 * filter->nis_radar_counter_ / filter->timestep_ << "% (" << filter->nis_radar_counter_ << " samples out of " 
        << filter->timestep_ << ") are out of 95% NIS range!" << endl;
+  if (nis_gate != NIS_GATE_OFF)
+    cout << "NIS gate " << NisGatePercent(nis_gate) << ": " << filter->gated_laser_counter_ << " laser and "
+         << filter->gated_radar_counter_ << " radar measurements rejected" << endl;
+  RmseVector RMSE = rmse.Rmse();
   cout << "Final RMSE:" << endl << "RMSE(px)="<< RMSE(0) << ", RMSE(py)="<<RMSE(1) << endl <<
           "RMSE(vx)="<<RMSE(2) << ", RMSE(vy)="<<RMSE(3) << endl;
 
+  if (!saveStateFile.empty()) {
+    FilterSnapshotWriter writer;
+    if (!writer.Open(saveStateFile) || !writer.Write(0, *filter) || !writer.Close())
+      cerr << "Failed to write snapshot: " << saveStateFile << endl;
+    else
+      cout << "Saved filter state at " << filter->time_us_ << " us to " << saveStateFile << endl;
+  }
+
+  if (filter_history != NULL)
+    cout << "Out of sequence: " << filter_history->Rewinds() << " rewinds, " << filter_history->Replayed()
+         << " measurements replayed, " << filter_history->Dropped() << " dropped" << endl;
+  delete filter_history;
+  delete out_file;
   delete filter;
 }
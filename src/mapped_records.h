@@ -0,0 +1,27 @@
+#ifndef MAPPED_RECORDS_H_
+#define MAPPED_RECORDS_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * Checks the header of a memory mapped file of fixed size records. The binary
+ * sensor logs and the filter snapshots share the header layout: magic,
+ * version, record_size and record_count. The count comes from the file, so it
+ * is bounded by division, a product could wrap around for a corrupt header
+ * and let the records run past the end of the mapping.
+ * @param length size of the mapping in bytes, including the header
+ * @return true if the header matches and all records fit into the mapping
+ */
+template <class Header>
+bool IsValidMappedHeader(const Header& header, size_t length, const char* magic, uint32_t version,
+                         size_t record_size) {
+  return length >= sizeof(Header) &&
+         memcmp(header.magic, magic, sizeof(header.magic)) == 0 &&
+         header.version == version &&
+         header.record_size == record_size &&
+         header.record_count <= (length - sizeof(Header)) / record_size;
+}
+
+#endif /* MAPPED_RECORDS_H_ */
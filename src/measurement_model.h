@@ -0,0 +1,253 @@
+#ifndef MEASUREMENT_MODEL_H_
+#define MEASUREMENT_MODEL_H_
+
+#include "filter.h"
+#include "measurement_package.h"
+#include "stats.h"
+#include "trig.h"
+#include <Eigen/Dense>
+#include <cmath>
+#include <iostream>
+
+/**
+ * Compile time measurement models. A model describes one sensor type and the
+ * filter cores instantiate their updates for it statically, so a new sensor
+ * needs a model and an entry in the update tables of the filters instead of
+ * new virtual methods. A model provides
+ *  - kSensor, the MeasurementPackage::SensorType it handles
+ *  - kAngleRow, the row of an angle which is normalized, -1 for none
+ *  - the fixed size matrix types of its NZ dimensions
+ *  - operator()(x, z), the measurement function z = h(x) of one state
+ *  - Jacobian(x, H), the derivative of h used by the linearized update.
+ *    Returns false if it can not be computed for x.
+ *  - Initialize(z, x), the state after the first measurement
+ *  - Noise(filter), Nis(filter), NisCounter(filter) and GatedCounter(filter),
+ *    which select the members of the sensor in Filter, ChiSquare95() of its
+ *    NIS and ChiSquare(gate), the NIS limit of a NisGate
+ */
+template <int NZ>
+struct MeasurementModel {
+  enum { kDim = NZ };
+  typedef CTRV::Measurement<NZ>     Types;
+  typedef typename Types::Vector     Vector;
+  typedef typename Types::CovMatrix  CovMatrix;
+  typedef typename Types::ObsMatrix  ObsMatrix;
+  typedef typename Types::GainMatrix GainMatrix;
+};
+
+
+/**
+ * Lidar measures the position [px py] directly
+ */
+struct LidarModel : MeasurementModel<2> {
+  enum { kSensor = MeasurementPackage::LASER, kAngleRow = -1 };
+
+  static const char* Name() { return "lidar"; }
+
+  template <class X>
+  void operator()(const Eigen::MatrixBase<X>& x, Vector* z) const {
+    (*z)(0) = x(0);
+    (*z)(1) = x(1);
+  }
+
+  bool Jacobian(const StateVector&, ObsMatrix* H) const {
+    *H << 1,    0,    0,    0,  0,
+          0,    1,    0,    0,  0;
+    return true;
+  }
+
+  void Initialize(const MeasurementPackage::RawVector& z, StateVector* x) const {
+    *x << z(0), z(1), 0.0, 0.0, 0.0;
+  }
+
+  static const CovMatrix& Noise(const Filter& filter) { return filter.model_->R_lidar; }
+  static double& Nis(Filter& filter) { return filter.nis_laser_; }
+  static int& NisCounter(Filter& filter) { return filter.nis_laser_counter_; }
+  static int& GatedCounter(Filter& filter) { return filter.gated_laser_counter_; }
+  // chi-square distribution with 2 degrees of freedom
+  static double ChiSquare95() { return 5.991; }
+  static double ChiSquare(NisGate gate) {
+    static const double limits[] = {HUGE_VAL, 5.991, 9.210, 13.816};
+    return limits[gate];
+  }
+};
+
+
+/**
+ * Radar measures range, bearing and range rate [rho phi rhodot]
+ */
+struct RadarModel : MeasurementModel<3> {
+  enum { kSensor = MeasurementPackage::RADAR, kAngleRow = 1 };
+
+  static const char* Name() { return "radar"; }
+
+  template <class X>
+  void operator()(const Eigen::MatrixBase<X>& x, Vector* z) const {
+    // extract values for better readibility
+    double p_x = x(0);
+    double p_y = x(1);
+    double v   = x(2);
+    double sin_yaw, cos_yaw;
+    SinCosExact(x(3), &sin_yaw, &cos_yaw);
+
+    // measurement model
+    (*z)(0) = sqrt(p_x*p_x + p_y*p_y);                            //r
+    (*z)(1) = atan2(p_y,p_x);                                     //phi
+    (*z)(2) = (p_x*v*cos_yaw + p_y*v*sin_yaw) / (*z)(0);          //r_dot
+  }
+
+  bool Jacobian(const StateVector& x, ObsMatrix* H) const {
+    double px = x(0);
+    double py = x(1);
+    double v = x(2);
+    double sin_yaw, cos_yaw;
+    SinCosExact(x(3), &sin_yaw, &cos_yaw);
+    double px_2 = px*px;
+    double py_2 = py*py;
+    double norm = sqrt(px_2 + py_2);
+
+    double H11 = px / norm;
+    double H12 = py / norm;
+    double H21 = - py / (px_2 * (1. + py_2 / px_2));
+    double H22 = 1. / (px * (1. + py_2 / px_2));
+    double H31 = v * cos_yaw / (norm - px/pow(norm, 3)) * (v*px*cos_yaw + v*py*sin_yaw);
+    double H32 = v * sin_yaw / (norm - py/pow(norm, 3)) * (v*px*cos_yaw + v*py*sin_yaw);
+    double H34 = 1. / norm * (px * cos_yaw + py * sin_yaw);
+    *H << H11,   H12,    0,    0,      0,
+          H21,   H22,    0,    0,      0,
+          H31,   H32,    0,    H34,    0;
+
+    // don't update measurement if we can't compute the jacobian
+    if (H->isZero(0)) {
+      std::cerr << "H matrix of radar is zero" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void Initialize(const MeasurementPackage::RawVector& z, StateVector* x) const {
+    // convert from polar to cartesian coordinates
+    double rho = z(0);
+    double phi = z(1);
+    double sin_phi, cos_phi;
+    SinCosExact(phi, &sin_phi, &cos_phi);
+    *x << rho * cos_phi, rho * sin_phi, 0.0, 0.0, 0.0;
+  }
+
+  static const CovMatrix& Noise(const Filter& filter) { return filter.model_->R_radar; }
+  static double& Nis(Filter& filter) { return filter.nis_radar_; }
+  static int& NisCounter(Filter& filter) { return filter.nis_radar_counter_; }
+  static int& GatedCounter(Filter& filter) { return filter.gated_radar_counter_; }
+  // chi-square distribution with 3 degrees of freedom
+  static double ChiSquare95() { return 7.8; }
+  static double ChiSquare(NisGate gate) {
+    static const double limits[] = {HUGE_VAL, 7.815, 11.345, 16.266};
+    return limits[gate];
+  }
+};
+
+
+/**
+ * Stores the NIS of a measurement and counts it if it is out of the 95% range
+ */
+template <class Model>
+void RecordNis(Filter* filter, double nis) {
+  Model::Nis(*filter) = nis;
+  int& counter = Model::NisCounter(*filter);
+  if (nis > Model::ChiSquare95())
+    counter++;
+  STATS_GAUGE(STATS_NIS_LASER + Model::kSensor, nis);
+  STATS_GAUGE(STATS_NIS_LASER_OUT + Model::kSensor, 100.0 * counter / filter->timestep_);
+
+  if (filter->verbose_) {
+    std::cout << "NIS(" << Model::Name() << "): ";
+    std::cout << 100.0 * counter / filter->timestep_ << "% (" << counter << " samples out of " << filter->timestep_
+              << ") are out of 95% NIS range!" << std::endl;
+  }
+}
+
+
+/**
+ * Gaussian log-likelihood of an innovation with covariance S, given its NIS
+ * and the factorization of S which the NIS was solved with:
+ * -0.5 * (NIS + ln det S + n_z ln 2pi)
+ */
+template <class Ldlt>
+double LogLikelihood(const Ldlt& S_ldlt, double nis) {
+  return -0.5 * (nis + S_ldlt.vectorD().array().log().sum() + S_ldlt.rows() * log(2.0*M_PI));
+}
+
+
+/**
+ * Checks the NIS of a measurement against the gate of the filter. A rejected
+ * measurement is counted and its NIS is recorded like the one of an applied
+ * measurement. After kMaxGatedRun rejections in a row the filter has most
+ * likely lost the object rather than seen clutter, so measurements pass again
+ * until one is within the gate.
+ * @return true if the measurement may be applied
+ */
+template <class Model>
+bool PassesGate(Filter* filter, double nis) {
+  if (!(nis > Model::ChiSquare(filter->nis_gate_))) {
+    filter->gated_run_ = 0;
+    return true;
+  }
+  if (filter->gated_run_ >= kMaxGatedRun)
+    return true;
+  filter->gated_run_++;
+  Model::GatedCounter(*filter)++;
+  RecordNis<Model>(filter, nis);
+  if (filter->verbose_)
+    std::cout << Model::Name() << " measurement rejected by the NIS gate" << std::endl;
+  return false;
+}
+
+
+/**
+ * Updates the filter with the Kalman filter equations linearized around the
+ * current state. For a linear model like lidar these are the plain Kalman
+ * filter equations. The NIS is computed from the innovation first, a
+ * measurement which fails the gate returns before the gain is formed.
+ * @return false if the measurement was not applied
+ */
+template <class Model>
+bool LinearizedUpdate(Filter* filter, const Model& model, const MeasurementPackage& meas_package) {
+  STATS_TIMER(STATS_UPDATE_LASER + Model::kSensor);
+  typedef typename Model::Vector     Vector;
+  typedef typename Model::CovMatrix  CovMatrix;
+  typedef typename Model::ObsMatrix  ObsMatrix;
+  typedef typename Model::GainMatrix GainMatrix;
+
+  ObsMatrix H;
+  if (!model.Jacobian(filter->x_, &H))
+    return false;
+
+  // residual
+  Vector z_pred;
+  model(filter->x_, &z_pred);
+  Vector y = meas_package.raw_measurements_ - z_pred;
+  if (Model::kAngleRow >= 0)
+    y(Model::kAngleRow) = NormalizeAngle(y(Model::kAngleRow));
+
+  GainMatrix Ht = H.transpose();
+  CovMatrix S = H * filter->P_ * Ht + Model::Noise(*filter);
+  // S is symmetric positive definite, so K = P*H^T*S^-1 and the NIS are
+  // computed by solving with its factorization instead of inverting it
+  Eigen::LDLT<CovMatrix> S_ldlt(S);
+  const double nis = y.dot(S_ldlt.solve(y));
+  if (!PassesGate<Model>(filter, nis))
+    return false;
+  GainMatrix PHt = filter->P_ * Ht;
+  GainMatrix K = S_ldlt.solve(PHt.transpose()).transpose();
+  StateMatrix I = StateMatrix::Identity();
+
+  //new estimate
+  filter->x_ = filter->x_ + (K * y);
+  filter->P_ = (I - K * H) * filter->P_;
+
+  filter->log_likelihood_ = LogLikelihood(S_ldlt, nis);
+  RecordNis<Model>(filter, nis);
+  return true;
+}
+
+#endif /* MEASUREMENT_MODEL_H_ */
@@ -5,15 +5,26 @@
 
 class MeasurementPackage {
 public:
+  MeasurementPackage() : timestamp_(0), track_id_(0) {}
+
   long timestamp_;
 
+  ///* object the measurement belongs to, 0 for single object logs
+  int track_id_;
+
   enum SensorType{
     LASER,
-    RADAR
+    RADAR,
+    SENSOR_TYPES  // number of sensor types, sizes the update tables of the filters
   } sensor_type_;
 
-  Eigen::VectorXd raw_measurements_;
-  Eigen::VectorXd ground_truth_;
+  ///* measurement payloads are stored inline: at most 3 values (radar), and
+  ///* ground truth [px py vx vy yaw yawrate], so copies never allocate
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, Eigen::ColMajor, 3, 1> RawVector;
+  typedef Eigen::Matrix<double, 6, 1> GroundTruthVector;
+
+  RawVector raw_measurements_;
+  GroundTruthVector ground_truth_;
 };
 
 #endif /* MEASUREMENT_PACKAGE_H_ */
@@ -0,0 +1,151 @@
+#include "monte_carlo.h"
+#include "counter_rng.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+
+namespace {
+
+// counter words of the noise blocks of one measurement
+enum { kNoisePosition = 0, kNoiseRangeRate = 1 };
+
+MonteCarloDistribution Summarize(vector<double> values) {
+  MonteCarloDistribution d;
+  size_t total = values.size();
+  values.erase(remove_if(values.begin(), values.end(), [](double v) { return !std::isfinite(v); }),
+               values.end());
+  d.diverged = static_cast<long>(total - values.size());
+  d.mean = d.stddev = d.p05 = d.p50 = d.p95 = 0;
+  if (values.empty())
+    return d;
+
+  double sum = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    sum += values[i];
+  d.mean = sum / values.size();
+  double sum_sq = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    sum_sq += (values[i] - d.mean) * (values[i] - d.mean);
+  d.stddev = (values.size() > 1) ? sqrt(sum_sq / (values.size() - 1)) : 0;
+
+  sort(values.begin(), values.end());
+  const size_t last = values.size() - 1;
+  d.p05 = values[static_cast<size_t>(0.05 * last)];
+  d.p50 = values[static_cast<size_t>(0.50 * last)];
+  d.p95 = values[static_cast<size_t>(0.95 * last)];
+  return d;
+}
+
+void PrintDistribution(const char* name, const MonteCarloDistribution& d) {
+  printf("  %-12s %10.5f %10.5f %10.5f %10.5f %10.5f %8ld\n", name, d.mean, d.stddev, d.p05, d.p50, d.p95,
+         d.diverged);
+}
+
+}
+
+
+bool MonteCarloSensorNoise(const FilterConfig& config, MonteCarloSpec* spec) {
+  Filter* filter = CreateFilter(config);
+  if (filter == NULL)
+    return false;
+  const FilterModelConfig& model = *filter->model_;
+  spec->std_laspx  = model.std_laspx;
+  spec->std_laspy  = model.std_laspy;
+  spec->std_radr   = model.std_radr;
+  spec->std_radphi = model.std_radphi;
+  spec->std_radrd  = model.std_radrd;
+  delete filter;
+  return true;
+}
+
+
+void SynthesizeMeasurements(const MonteCarloSpec& spec, int trial, const vector<MeasurementPackage>& truth,
+                            vector<MeasurementPackage>* measurements) {
+  CounterRng rng(spec.seed);
+  *measurements = truth;
+  for (size_t i = 0; i < measurements->size(); i++) {
+    MeasurementPackage& meas = (*measurements)[i];
+    const MeasurementPackage::GroundTruthVector& gt = meas.ground_truth_;
+    const uint32_t index = static_cast<uint32_t>(i);
+    double n0, n1;
+    rng.Normal2(trial, index, kNoisePosition, &n0, &n1);
+
+    if (meas.sensor_type_ == MeasurementPackage::LASER) {
+      meas.raw_measurements_.resize(2);
+      meas.raw_measurements_ << gt(0) + spec.std_laspx * n0,
+                                gt(1) + spec.std_laspy * n1;
+    } else if (meas.sensor_type_ == MeasurementPackage::RADAR) {
+      double n2, unused;
+      rng.Normal2(trial, index, kNoiseRangeRate, &n2, &unused);
+      double px = gt(0), py = gt(1), vx = gt(2), vy = gt(3);
+      double rho = sqrt(px*px + py*py);
+      // the bearing stays within [-pi, pi] like the one of the sensor
+      double phi = atan2(py, px) + spec.std_radphi * n1;
+      phi = atan2(sin(phi), cos(phi));
+      double rho_dot = (rho > 0) ? (px*vx + py*vy) / rho : 0.0;
+      meas.raw_measurements_.resize(3);
+      meas.raw_measurements_ << rho + spec.std_radr * n0,
+                                phi,
+                                rho_dot + spec.std_radrd * n2;
+    }
+  }
+}
+
+
+vector<MonteCarloResult> RunMonteCarlo(const MonteCarloSpec& spec, const vector<FilterConfig>& configs,
+                                       const vector<MeasurementPackage>& truth, int threads) {
+  vector<MonteCarloResult> results(configs.size());
+  for (size_t c = 0; c < configs.size(); c++)
+    results[c].trials.resize(spec.trials);
+
+  {
+    ThreadPool pool(threads);
+    for (int trial = 0; trial < spec.trials; trial++) {
+      // every task writes only the result slots of its trial
+      pool.Submit([&spec, &configs, &truth, &results, trial] {
+        vector<MeasurementPackage> measurements;
+        SynthesizeMeasurements(spec, trial, truth, &measurements);
+        for (size_t c = 0; c < configs.size(); c++)
+          results[c].trials[trial] = Replay(configs[c], measurements);
+      });
+    }
+    pool.Wait();
+  }
+
+  vector<double> values(spec.trials);
+  for (size_t c = 0; c < configs.size(); c++) {
+    MonteCarloResult& r = results[c];
+    for (int k = 0; k < 4; k++) {
+      for (int t = 0; t < spec.trials; t++)
+        values[t] = r.trials[t].rmse(k);
+      r.rmse[k] = Summarize(values);
+    }
+    for (int t = 0; t < spec.trials; t++)
+      values[t] = r.trials[t].nis_laser_percent;
+    r.nis_laser_percent = Summarize(values);
+    for (int t = 0; t < spec.trials; t++)
+      values[t] = r.trials[t].nis_radar_percent;
+    r.nis_radar_percent = Summarize(values);
+  }
+  return results;
+}
+
+
+void PrintMonteCarlo(const vector<FilterConfig>& configs, const vector<MonteCarloResult>& results) {
+  static const char* const rmse_names[4] = {"rmse_px", "rmse_py", "rmse_vx", "rmse_vy"};
+  for (size_t c = 0; c < configs.size(); c++) {
+    const FilterConfig& config = configs[c];
+    const MonteCarloResult& r = results[c];
+    printf("%s, sensors=%s, std_a=%g, std_yawdd=%g, %zu trials\n", config.filter.c_str(), SensorName(config),
+           config.std_a, config.std_yawdd, r.trials.size());
+    printf("  %-12s %10s %10s %10s %10s %10s %8s\n", "", "mean", "stddev", "p05", "p50", "p95", "diverged");
+    for (int k = 0; k < 4; k++)
+      PrintDistribution(rmse_names[k], r.rmse[k]);
+    PrintDistribution("nis_laser%", r.nis_laser_percent);
+    PrintDistribution("nis_radar%", r.nis_radar_percent);
+  }
+}
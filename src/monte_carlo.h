@@ -0,0 +1,76 @@
+#ifndef MONTE_CARLO_H_
+#define MONTE_CARLO_H_
+
+#include "replay.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Monte Carlo evaluation over the ground truth of a measurement log. Every
+ * trial replaces the measurements by new ones synthesized from the ground
+ * truth with the sensor noise the filters assume, and replays them with every
+ * filter configuration. All configurations of a trial see the same noise, so
+ * their results can be compared pairwise. The noise comes from a counter
+ * based generator keyed by the seed, so the results only depend on the seed
+ * and not on the number of threads.
+ */
+struct MonteCarloSpec {
+  int trials;
+  uint64_t seed;
+  // sensor noise standard deviations of the synthesized measurements
+  double std_laspx;
+  double std_laspy;
+  double std_radr;
+  double std_radphi;
+  double std_radrd;
+};
+
+/**
+ * Distribution of one metric over all trials. Trials where the metric is not
+ * finite are counted as diverged and left out of the statistics.
+ */
+struct MonteCarloDistribution {
+  double mean;
+  double stddev;
+  double p05;
+  double p50;
+  double p95;
+  long diverged;
+};
+
+/**
+ * Results of one filter configuration over all trials
+ */
+struct MonteCarloResult {
+  std::vector<ReplayResult> trials;
+  MonteCarloDistribution rmse[4];
+  MonteCarloDistribution nis_laser_percent;
+  MonteCarloDistribution nis_radar_percent;
+};
+
+/**
+ * Fills the sensor noise of the spec with the values the filter of config
+ * uses in Init
+ * @return false for an unknown filter name
+ */
+bool MonteCarloSensorNoise(const FilterConfig& config, MonteCarloSpec* spec);
+
+/**
+ * Replaces the raw measurements of truth by noisy ones of trial, the sensor
+ * types, timestamps and ground truth are kept
+ */
+void SynthesizeMeasurements(const MonteCarloSpec& spec, int trial, const std::vector<MeasurementPackage>& truth,
+                            std::vector<MeasurementPackage>* measurements);
+
+/**
+ * Runs all trials on a thread pool, one task per trial
+ */
+std::vector<MonteCarloResult> RunMonteCarlo(const MonteCarloSpec& spec, const std::vector<FilterConfig>& configs,
+                                            const std::vector<MeasurementPackage>& truth, int threads);
+
+/**
+ * Prints the distributions of every configuration
+ */
+void PrintMonteCarlo(const std::vector<FilterConfig>& configs, const std::vector<MonteCarloResult>& results);
+
+#endif /* MONTE_CARLO_H_ */
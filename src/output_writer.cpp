@@ -0,0 +1,276 @@
+#include "output_writer.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+namespace {
+
+const double pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+char* AppendFallback(char* p, double v, int precision) {
+  return p + snprintf(p, 32, "%.*g", precision, v);
+}
+
+char* AppendChars(char* p, const char* s, size_t n) {
+  memcpy(p, s, n);
+  return p + n;
+}
+
+}
+
+
+char* AppendDouble(char* p, double v, int precision) {
+  if (precision < 1 || precision > 9 || !std::isfinite(v))
+    return AppendFallback(p, v, precision);
+  if (v == 0) {
+    if (std::signbit(v))
+      *p++ = '-';
+    *p++ = '0';
+    return p;
+  }
+
+  double a = fabs(v);
+  // decimal exponent of a, estimated from the binary one. The estimate is
+  // either exact or one too low.
+  int e2;
+  frexp(a, &e2);
+  int e = static_cast<int>(floor((e2 - 1) * 0.30102999566398120));
+  int k = precision - 1 - e;
+  if (k < -21 || k > 22)
+    return AppendFallback(p, v, precision);
+
+  // scale to `precision` integer digits with one correctly rounded operation
+  double scaled = (k >= 0) ? a * pow10[k] : a / pow10[-k];
+  if (scaled >= pow10[precision]) {
+    e++;
+    k--;
+    scaled = (k >= 0) ? a * pow10[k] : a / pow10[-k];
+  }
+
+  // values which are this close to a rounding tie can round differently than
+  // the exact decimal expansion, leave those to printf
+  double integral = floor(scaled);
+  double frac = scaled - integral;
+  if (fabs(frac - 0.5) <= scaled * 4e-16)
+    return AppendFallback(p, v, precision);
+  unsigned long m = static_cast<unsigned long>(integral) + (frac > 0.5 ? 1 : 0);
+  if (m >= static_cast<unsigned long>(pow10[precision])) {
+    m /= 10;
+    e++;
+  }
+
+  char digits[10];
+  for (int i = precision - 1; i >= 0; i--) {
+    digits[i] = static_cast<char>('0' + m % 10);
+    m /= 10;
+  }
+  // %g removes trailing zeros of the fraction
+  int n = precision;
+  while (n > 1 && digits[n - 1] == '0')
+    n--;
+
+  if (v < 0)
+    *p++ = '-';
+  if (e >= precision || e < -4) {
+    // scientific notation d.ddde+XX
+    *p++ = digits[0];
+    if (n > 1) {
+      *p++ = '.';
+      p = AppendChars(p, digits + 1, n - 1);
+    }
+    *p++ = 'e';
+    *p++ = (e < 0) ? '-' : '+';
+    int ae = (e < 0) ? -e : e;
+    *p++ = static_cast<char>('0' + ae / 10);
+    *p++ = static_cast<char>('0' + ae % 10);
+  } else if (e >= 0) {
+    p = AppendChars(p, digits, e + 1);
+    if (n > e + 1) {
+      *p++ = '.';
+      p = AppendChars(p, digits + e + 1, n - e - 1);
+    }
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    for (int i = 0; i < -e - 1; i++)
+      *p++ = '0';
+    p = AppendChars(p, digits, n);
+  }
+  return p;
+}
+
+
+void MakeFusedRecord(const Filter& filter, const MeasurementPackage& meas_package,
+                     const RmseVector& rmse, FusedRecord* record) {
+  for (int i = 0; i < 5; i++)
+    record->x[i] = filter.x_(i);
+  record->nis_laser = filter.nis_laser_;
+  record->nis_radar = filter.nis_radar_;
+  for (int i = 0; i < 6; i++)
+    record->ground_truth[i] = meas_package.ground_truth_(i);
+  for (int i = 0; i < 4; i++)
+    record->rmse[i] = rmse(i);
+}
+
+
+BufferedOutputWriter::BufferedOutputWriter(size_t buffer_size, size_t flush_interval)
+  : buffer_(buffer_size < 4096 ? 4096 : buffer_size),
+    used_(0),
+    fd_(-1),
+    flush_interval_(flush_interval),
+    rows_since_flush_(0) {
+}
+
+
+BufferedOutputWriter::~BufferedOutputWriter() {
+  Close();
+}
+
+
+bool BufferedOutputWriter::Open(const string& path) {
+  Close();
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0)
+    return false;
+  used_ = 0;
+  rows_since_flush_ = 0;
+  return WriteHeader(false);
+}
+
+
+bool BufferedOutputWriter::Flush() {
+  if (fd_ < 0)
+    return false;
+  size_t done = 0;
+  while (done < used_) {
+    ssize_t n = write(fd_, buffer_.data() + done, used_ - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    done += n;
+  }
+  used_ = 0;
+  rows_since_flush_ = 0;
+  return true;
+}
+
+
+bool BufferedOutputWriter::Close() {
+  if (fd_ < 0)
+    return true;
+  bool ok = Flush() && WriteHeader(true);
+  ok = (close(fd_) == 0) && ok;
+  fd_ = -1;
+  return ok;
+}
+
+
+bool BufferedOutputWriter::Reserve(size_t n) {
+  if (used_ + n <= buffer_.size())
+    return true;
+  return Flush();
+}
+
+
+bool BufferedOutputWriter::RowWritten() {
+  if (flush_interval_ > 0 && ++rows_since_flush_ >= flush_interval_)
+    return Flush();
+  return true;
+}
+
+
+CsvOutputWriter::CsvOutputWriter(size_t buffer_size, size_t flush_interval, int precision)
+  : BufferedOutputWriter(buffer_size, flush_interval),
+    precision_(precision) {
+}
+
+
+CsvOutputWriter::~CsvOutputWriter() {
+  Close();
+}
+
+
+bool CsvOutputWriter::WriteHeader(bool final) {
+  if (final)
+    return true;
+  static const char line[] =
+    "# px,  py,  v,  yaw,  yawrate,  nis_laser,  nis_radar,  "
+    "px_true,  py_true,  vx_true,  vy_true,  yaw_true,  yawrate_true,  "
+    "rmse_px,  rmse_py,  rmse_vx,  rmse_vy\n";
+  memcpy(buffer_.data() + used_, line, sizeof(line) - 1);
+  used_ += sizeof(line) - 1;
+  return true;
+}
+
+
+bool CsvOutputWriter::Write(const FusedRecord& record) {
+  // 17 numbers of at most 32 characters plus their separators
+  const size_t max_row = 17 * 34 + 1;
+  if (!Reserve(max_row))
+    return false;
+
+  const double* values = &record.x[0];
+  char* p = buffer_.data() + used_;
+  for (int i = 0; i < 17; i++) {
+    if (i > 0) {
+      *p++ = ',';
+      *p++ = ' ';
+    }
+    p = AppendDouble(p, values[i], precision_);
+  }
+  *p++ = '\n';
+  used_ = p - buffer_.data();
+  return RowWritten();
+}
+
+
+BinaryOutputWriter::BinaryOutputWriter(size_t buffer_size, size_t flush_interval)
+  : BufferedOutputWriter(buffer_size, flush_interval),
+    record_count_(0) {
+}
+
+
+BinaryOutputWriter::~BinaryOutputWriter() {
+  // closed here, the base class destructor can not patch the header anymore
+  Close();
+}
+
+
+bool BinaryOutputWriter::WriteHeader(bool final) {
+  FusedOutputHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FUSED_OUTPUT_MAGIC, sizeof(header.magic));
+  header.version = FUSED_OUTPUT_VERSION;
+  header.record_size = sizeof(FusedRecord);
+  header.record_count = final ? record_count_ : 0;
+
+  if (!final) {
+    record_count_ = 0;
+    memcpy(buffer_.data() + used_, &header, sizeof(header));
+    used_ += sizeof(header);
+    return true;
+  }
+  // the number of records is only known at the end
+  return pwrite(fd_, &header, sizeof(header), 0) == sizeof(header);
+}
+
+
+bool BinaryOutputWriter::Write(const FusedRecord& record) {
+  if (!Reserve(sizeof(record)))
+    return false;
+  memcpy(buffer_.data() + used_, &record, sizeof(record));
+  used_ += sizeof(record);
+  record_count_++;
+  return RowWritten();
+}
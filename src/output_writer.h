@@ -0,0 +1,135 @@
+#ifndef OUTPUT_WRITER_H_
+#define OUTPUT_WRITER_H_
+
+#include "filter.h"
+#include "tools.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * One row of the fused output: filter state, NIS values, ground truth and
+ * the RMSE so far. Plain doubles so it can be written as binary record.
+ */
+struct FusedRecord {
+  double x[5];
+  double nis_laser;
+  double nis_radar;
+  double ground_truth[6];
+  double rmse[4];
+};
+
+void MakeFusedRecord(const Filter& filter, const MeasurementPackage& meas_package,
+                     const RmseVector& rmse, FusedRecord* record);
+
+/**
+ * Destination of fused output rows
+ */
+class OutputSink {
+public:
+  virtual ~OutputSink() {}
+
+  virtual bool Write(const FusedRecord& record) = 0;
+
+  /**
+   * Writes all buffered rows to the file
+   */
+  virtual bool Flush() = 0;
+
+  virtual bool Close() = 0;
+};
+
+/**
+ * Base class for sinks which collect their output in one large buffer and
+ * only write it when the buffer is full, every flush_interval rows (if not
+ * zero) and on Close. Derived classes have to call Close in their destructor
+ * so their final header is still written.
+ */
+class BufferedOutputWriter : public OutputSink {
+public:
+  BufferedOutputWriter(size_t buffer_size, size_t flush_interval);
+  virtual ~BufferedOutputWriter();
+
+  bool Open(const std::string& path);
+  bool Flush();
+  bool Close();
+
+protected:
+  std::vector<char> buffer_;
+  size_t used_;
+
+  /**
+   * Makes sure that at least n bytes are free in the buffer
+   */
+  bool Reserve(size_t n);
+
+  /**
+   * Counts a written row and flushes on the configured interval
+   */
+  bool RowWritten();
+
+  /**
+   * Called before the file is closed and at the start of a file
+   */
+  virtual bool WriteHeader(bool final) { return true; }
+
+  int fd_;
+
+private:
+  size_t flush_interval_;
+  size_t rows_since_flush_;
+};
+
+/**
+ * Writes the fused output as comma separated text. Numbers are formatted by
+ * AppendDouble with the same significant digits as the previous ofstream
+ * output.
+ */
+class CsvOutputWriter : public BufferedOutputWriter {
+public:
+  CsvOutputWriter(size_t buffer_size = 1 << 20, size_t flush_interval = 0, int precision = 6);
+  ~CsvOutputWriter();
+
+  bool Write(const FusedRecord& record);
+
+protected:
+  bool WriteHeader(bool final);
+
+private:
+  int precision_;
+};
+
+/**
+ * Writes the fused output as fixed size binary records behind a header
+ */
+#define FUSED_OUTPUT_MAGIC    "UKFFOUT"
+#define FUSED_OUTPUT_VERSION  1
+
+struct FusedOutputHeader {
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  record_size;
+  uint64_t  record_count;
+};
+
+class BinaryOutputWriter : public BufferedOutputWriter {
+public:
+  BinaryOutputWriter(size_t buffer_size = 1 << 20, size_t flush_interval = 0);
+  ~BinaryOutputWriter();
+
+  bool Write(const FusedRecord& record);
+
+protected:
+  bool WriteHeader(bool final);
+
+private:
+  uint64_t record_count_;
+};
+
+/**
+ * Appends v with `precision` significant digits in the format of printf's %g
+ * and returns the new end. p needs room for 32 characters.
+ */
+char* AppendDouble(char* p, double v, int precision = 6);
+
+#endif /* OUTPUT_WRITER_H_ */
@@ -0,0 +1,120 @@
+#include "replay.h"
+#include "ukf.h"
+#include "ekf.h"
+#include "sensor_log.h"
+#include "filter_history.h"
+#include "epoch_batcher.h"
+
+using namespace std;
+
+
+namespace {
+
+// creates the filter on the heap if storage is NULL
+Filter* NewFilter(const FilterConfig& config, FilterStorage* storage) {
+  Filter* filter = NULL;
+  if (config.filter == "ukf") {
+    UKF* ukf = storage ? new (storage) UKF(config.verbose, config.use_laser, config.use_radar, config.std_a, config.std_yawdd)
+                       : new UKF(config.verbose, config.use_laser, config.use_radar, config.std_a, config.std_yawdd);
+    ukf->ctrv_kernel_ = config.ctrv_kernel;
+    ukf->ctrv_precision_ = config.ctrv_precision;
+    filter = ukf;
+  } else if (config.filter == "ekf") {
+    filter = storage ? new (storage) EKF(config.verbose, config.use_laser, config.use_radar, config.std_a, config.std_yawdd)
+                     : new EKF(config.verbose, config.use_laser, config.use_radar, config.std_a, config.std_yawdd);
+  }
+  if (filter) {
+    filter->trig_mode_ = config.trig_mode;
+    filter->lazy_prediction_ = config.lazy_prediction;
+    filter->nis_gate_ = config.nis_gate;
+  }
+  return filter;
+}
+
+}
+
+
+const char* SensorName(const FilterConfig& config) {
+  if (config.use_laser && config.use_radar)
+    return "both";
+  return config.use_laser ? "laser" : "radar";
+}
+
+
+Filter* CreateFilter(const FilterConfig& config) {
+  return NewFilter(config, NULL);
+}
+
+
+Filter* CreateFilter(const FilterConfig& config, FilterStorage* storage) {
+  return NewFilter(config, storage);
+}
+
+
+bool LoadMeasurements(const string& path, vector<MeasurementPackage>* measurements) {
+  measurements->clear();
+  MeasurementPackage meas_package;
+  if (IsBinarySensorLog(path)) {
+    MappedSensorLog log;
+    if (!log.Open(path))
+      return false;
+    measurements->reserve(log.Size());
+    for (size_t i = 0; i < log.Size(); i++) {
+      log.Get(i, &meas_package);
+      measurements->push_back(meas_package);
+    }
+    return true;
+  }
+  TextLogReader reader;
+  if (!reader.Open(path))
+    return false;
+  while (reader.Next(&meas_package))
+    measurements->push_back(meas_package);
+  return true;
+}
+
+
+ReplayResult Replay(const FilterConfig& config, const vector<MeasurementPackage>& measurements) {
+  ReplayResult result;
+  result.rmse.setZero();
+  result.nis_laser_percent = 0;
+  result.nis_radar_percent = 0;
+  result.gated_laser = 0;
+  result.gated_radar = 0;
+  result.measurements = 0;
+  result.dropped = 0;
+
+  Filter* filter = CreateFilter(config);
+  if (filter == NULL)
+    return result;
+
+  RmseAccumulator rmse;
+  FilterHistory history(filter, config.history);
+  EpochBatcher batcher(config.epoch_tolerance_us);
+  auto process_epoch = [&](const MeasurementPackage* batch, int n) {
+    filter->ProcessMeasurements(batch, n);
+    for (int k = 0; k < n; k++)
+      rmse.Add(CartesianEstimate(filter->StateAt(batch[k].timestamp_)), batch[k].ground_truth_);
+  };
+  for (size_t i = 0; i < measurements.size(); i++) {
+    if (config.history > 0) {
+      history.ProcessMeasurement(measurements[i]);
+      rmse.Add(CartesianEstimate(filter->StateAt(measurements[i].timestamp_)), measurements[i].ground_truth_);
+    } else {
+      batcher.Add(measurements[i], process_epoch);
+    }
+  }
+  batcher.Flush(process_epoch);
+  result.dropped = history.Dropped();
+
+  result.rmse = rmse.Rmse();
+  if (filter->timestep_ > 0) {
+    result.nis_laser_percent = 100.0 * filter->nis_laser_counter_ / filter->timestep_;
+    result.nis_radar_percent = 100.0 * filter->nis_radar_counter_ / filter->timestep_;
+  }
+  result.gated_laser = filter->gated_laser_counter_;
+  result.gated_radar = filter->gated_radar_counter_;
+  result.measurements = measurements.size();
+  delete filter;
+  return result;
+}
@@ -0,0 +1,87 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include "filter.h"
+#include "ukf.h"
+#include "ekf.h"
+#include "ctrv_kernel.h"
+#include "tools.h"
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Everything needed to create a filter
+ */
+struct FilterConfig {
+  std::string filter;   // "ukf" or "ekf"
+  double std_a;
+  double std_yawdd;
+  bool use_laser;
+  bool use_radar;
+  bool verbose;
+  CtrvKernel ctrv_kernel;
+  CtrvPrecision ctrv_precision;  // precision of the UKF sigma point propagation
+  TrigMode trig_mode;   // sine and cosine of the process model
+  bool lazy_prediction; // defer the prediction until an update or a query needs it
+  NisGate nis_gate;     // measurements beyond the gate are rejected
+  size_t history;       // out of sequence measurements which can be rewound, 0 disables
+  long epoch_tolerance_us;  // measurements this close are fused with one prediction, -1 disables
+
+  FilterConfig()
+    : filter("ukf"), std_a(0.6), std_yawdd(0.4), use_laser(true), use_radar(true),
+      verbose(false), ctrv_kernel(CTRV_KERNEL_AUTO), ctrv_precision(CTRV_PRECISION_DOUBLE),
+      trig_mode(TRIG_EXACT), lazy_prediction(false), nis_gate(NIS_GATE_OFF),
+      history(0), epoch_tolerance_us(-1) {}
+};
+
+/**
+ * Name of the sensors the configuration uses: "laser", "radar" or "both"
+ */
+const char* SensorName(const FilterConfig& config);
+
+/**
+ * Creates the configured filter, the caller owns it. Returns NULL for an
+ * unknown filter name.
+ */
+Filter* CreateFilter(const FilterConfig& config);
+
+/**
+ * Storage for any filter of CreateFilter, used to keep a filter inside the
+ * object which owns it
+ */
+typedef std::aligned_union<0, UKF, EKF>::type FilterStorage;
+
+/**
+ * Creates the configured filter in storage instead of on the heap. It is
+ * destroyed by calling its destructor, filter->~Filter(). Returns NULL for an
+ * unknown filter name.
+ */
+Filter* CreateFilter(const FilterConfig& config, FilterStorage* storage);
+
+/**
+ * Summary of one replay of a measurement log
+ */
+struct ReplayResult {
+  RmseVector rmse;
+  double nis_laser_percent;   // share of all timesteps outside the 95% NIS range
+  double nis_radar_percent;
+  long gated_laser;           // measurements rejected by the NIS gate
+  long gated_radar;
+  long measurements;
+  long dropped;               // out of sequence measurements that were too old
+};
+
+/**
+ * Reads all measurements of a text or binary sensor log into memory
+ * @return false if the file can not be read
+ */
+bool LoadMeasurements(const std::string& path, std::vector<MeasurementPackage>* measurements);
+
+/**
+ * Runs a new filter with the given configuration over all measurements. The
+ * epoch tolerance is not used together with the history.
+ */
+ReplayResult Replay(const FilterConfig& config, const std::vector<MeasurementPackage>& measurements);
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,436 @@
+#include "sensor_log.h"
+#include "mapped_records.h"
+#include "stats.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+namespace {
+
+inline const char* SkipSpace(const char* p, const char* end) {
+  while (p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+  return p;
+}
+
+inline bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+/**
+ * Parses a decimal floating point number at p and advances p behind it.
+ * Numbers with at most 15 significant digits and a decimal exponent below 23
+ * are converted exactly with one multiplication or division of two exactly
+ * representable doubles (the fast path of Clinger's algorithm), which covers
+ * everything written by the logging tools. All other numbers are handed to
+ * strtod, so the result is always correctly rounded.
+ */
+bool ParseDouble(const char*& p, const char* end, double* value) {
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  p = SkipSpace(p, end);
+  const char* start = p;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+
+  unsigned long long mantissa = 0;
+  int digits = 0;       // significant digits in the mantissa
+  int exponent = 0;     // decimal exponent of the mantissa
+  bool any_digit = false;
+  for (; p != end && IsDigit(*p); p++) {
+    any_digit = true;
+    if (mantissa == 0 && *p == '0')
+      continue;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits++;
+    } else {
+      exponent++;
+    }
+  }
+  if (p != end && *p == '.') {
+    for (p++; p != end && IsDigit(*p); p++) {
+      any_digit = true;
+      if (mantissa == 0 && *p == '0') {
+        exponent--;
+        continue;
+      }
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits++;
+        exponent--;
+      }
+    }
+  }
+  if (!any_digit) {
+    p = start;
+    return false;
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool exp_negative = false;
+    if (q != end && (*q == '-' || *q == '+')) {
+      exp_negative = (*q == '-');
+      q++;
+    }
+    if (q != end && IsDigit(*q)) {
+      int e = 0;
+      for (; q != end && IsDigit(*q); q++)
+        if (e < 10000)
+          e = e * 10 + (*q - '0');
+      exponent += exp_negative ? -e : e;
+      p = q;
+    }
+  }
+
+  if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+    double v = static_cast<double>(mantissa);
+    v = (exponent < 0) ? v / pow10[-exponent] : v * pow10[exponent];
+    *value = negative ? -v : v;
+    return true;
+  }
+
+  // slow path for long or extreme numbers, strtod needs a terminated copy
+  char token[128];
+  size_t length = p - start;
+  if (length >= sizeof(token))
+    return false;
+  memcpy(token, start, length);
+  token[length] = '\0';
+  *value = strtod(token, NULL);
+  return true;
+}
+
+bool ParseInteger(const char*& p, const char* end, long long* value) {
+  p = SkipSpace(p, end);
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  if (p == end || !IsDigit(*p))
+    return false;
+  long long v = 0;
+  for (; p != end && IsDigit(*p); p++)
+    v = v * 10 + (*p - '0');
+  *value = negative ? -v : v;
+  return true;
+}
+
+}
+
+
+bool ParseMeasurement(const char* begin, const char* end, MeasurementPackage* meas_package)
+{
+  STATS_TIMER(STATS_PARSE);
+  const char* p = SkipSpace(begin, end);
+  if (p == end)
+    return false;
+
+  // optional track id in front of the sensor type
+  meas_package->track_id_ = 0;
+  if (IsDigit(*p)) {
+    long long track_id;
+    if (!ParseInteger(p, end, &track_id))
+      return false;
+    meas_package->track_id_ = static_cast<int>(track_id);
+    p = SkipSpace(p, end);
+    if (p == end)
+      return false;
+  }
+
+  // reads first element from the current line
+  int n_raw;
+  if (*p == 'L') {
+    meas_package->sensor_type_ = MeasurementPackage::LASER;
+    n_raw = 2;
+  } else if (*p == 'R') {
+    meas_package->sensor_type_ = MeasurementPackage::RADAR;
+    n_raw = 3;
+  } else {
+    return false;
+  }
+  p++;
+
+  meas_package->raw_measurements_.resize(n_raw);
+  for (int i = 0; i < n_raw; i++)
+    if (!ParseDouble(p, end, &meas_package->raw_measurements_(i)))
+      return false;
+
+  long long timestamp;
+  if (!ParseInteger(p, end, &timestamp))
+    return false;
+  meas_package->timestamp_ = timestamp;
+
+  // x_gt, y_gt, vx_gt, vy_gt, yaw_gt, yawrate_gt
+  for (int i = 0; i < 6; i++)
+    if (!ParseDouble(p, end, &meas_package->ground_truth_(i)))
+      return false;
+  return true;
+}
+
+
+bool IsValidRecord(const SensorLogRecord& record) {
+  switch (record.sensor_type) {
+    case MeasurementPackage::LASER: return record.n_raw == 2;
+    case MeasurementPackage::RADAR: return record.n_raw == 3;
+    default:                        return false;
+  }
+}
+
+
+MeasurementPackage getMeasurement(const string &sensor_measurement)
+{
+  MeasurementPackage meas_package;
+  const char* begin = sensor_measurement.data();
+  if (!ParseMeasurement(begin, begin + sensor_measurement.size(), &meas_package))
+    cerr << "Invalid measurement: " << sensor_measurement << endl;
+  return meas_package;
+}
+
+
+void ToRecord(const MeasurementPackage& meas_package, SensorLogRecord* record) {
+  memset(record, 0, sizeof(SensorLogRecord));
+  record->timestamp   = meas_package.timestamp_;
+  record->sensor_type = meas_package.sensor_type_;
+  record->n_raw       = meas_package.raw_measurements_.size();
+  record->track_id    = meas_package.track_id_;
+  for (int i = 0; i < record->n_raw; i++)
+    record->raw[i] = meas_package.raw_measurements_(i);
+  for (int i = 0; i < 6; i++)
+    record->ground_truth[i] = meas_package.ground_truth_(i);
+}
+
+
+void FromRecord(const SensorLogRecord& record, MeasurementPackage* meas_package) {
+  meas_package->timestamp_   = record.timestamp;
+  meas_package->sensor_type_ = static_cast<MeasurementPackage::SensorType>(record.sensor_type);
+  meas_package->track_id_    = record.track_id;
+  meas_package->raw_measurements_ = Eigen::Map<const Eigen::VectorXd>(record.raw, record.n_raw);
+  meas_package->ground_truth_     = Eigen::Map<const MeasurementPackage::GroundTruthVector>(record.ground_truth);
+}
+
+
+bool IsBinarySensorLog(const string& path) {
+  char magic[8] = {0};
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL)
+    return false;
+  size_t n = fread(magic, 1, sizeof(magic), file);
+  fclose(file);
+  return n == sizeof(magic) && memcmp(magic, SENSOR_LOG_MAGIC, sizeof(magic)) == 0;
+}
+
+
+long ConvertTextLog(const string& text_path, const string& binary_path) {
+  TextLogReader reader;
+  if (!reader.Open(text_path)) {
+    cerr << "Cannot open input file: " << text_path << endl;
+    return -1;
+  }
+  SensorLogWriter writer;
+  if (!writer.Open(binary_path)) {
+    cerr << "Cannot open output file: " << binary_path << endl;
+    return -1;
+  }
+
+  long count = 0;
+  MeasurementPackage meas_package;
+  while (reader.Next(&meas_package)) {
+    if (!writer.Write(meas_package))
+      return -1;
+    count++;
+  }
+  return writer.Close() ? count : -1;
+}
+
+
+TextLogReader::TextLogReader(size_t buffer_size)
+  : file_(NULL), buffer_(buffer_size), begin_(0), end_(0), eof_(true) {}
+
+
+TextLogReader::~TextLogReader() {
+  Close();
+}
+
+
+bool TextLogReader::Open(const string& path) {
+  Close();
+  file_ = fopen(path.c_str(), "rb");
+  begin_ = end_ = 0;
+  eof_ = (file_ == NULL);
+  return file_ != NULL;
+}
+
+
+void TextLogReader::Close() {
+  if (file_ != NULL)
+    fclose(file_);
+  file_ = NULL;
+  eof_ = true;
+}
+
+
+bool TextLogReader::NextLine(const char** line_begin, const char** line_end) {
+  while (true) {
+    const char* data = buffer_.data();
+    const char* newline = static_cast<const char*>(memchr(data + begin_, '\n', end_ - begin_));
+    if (newline != NULL) {
+      *line_begin = data + begin_;
+      *line_end = newline;
+      begin_ = newline - data + 1;
+      return true;
+    }
+    if (eof_) {
+      // last line without a trailing newline
+      if (begin_ == end_)
+        return false;
+      *line_begin = data + begin_;
+      *line_end = data + end_;
+      begin_ = end_;
+      return true;
+    }
+
+    // move the incomplete line to the front and refill the buffer behind it
+    size_t rest = end_ - begin_;
+    if (begin_ > 0)
+      memmove(buffer_.data(), buffer_.data() + begin_, rest);
+    else if (rest == buffer_.size())
+      buffer_.resize(2 * buffer_.size());
+    begin_ = 0;
+    end_ = rest;
+    size_t n = fread(buffer_.data() + end_, 1, buffer_.size() - end_, file_);
+    end_ += n;
+    if (n == 0)
+      eof_ = true;
+  }
+}
+
+
+bool TextLogReader::Next(MeasurementPackage* meas_package) {
+  const char* line_begin;
+  const char* line_end;
+  while (NextLine(&line_begin, &line_end)) {
+    if (ParseMeasurement(line_begin, line_end, meas_package))
+      return true;
+  }
+  return false;
+}
+
+
+SensorLogWriter::SensorLogWriter() : file_(NULL), record_count_(0) {}
+
+
+SensorLogWriter::~SensorLogWriter() {
+  Close();
+}
+
+
+bool SensorLogWriter::Open(const string& path) {
+  Close();
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == NULL)
+    return false;
+  // reserve space for the header, it is written with the final count on Close
+  SensorLogHeader header;
+  memset(&header, 0, sizeof(header));
+  record_count_ = 0;
+  return fwrite(&header, sizeof(header), 1, file_) == 1;
+}
+
+
+bool SensorLogWriter::Write(const MeasurementPackage& meas_package) {
+  SensorLogRecord record;
+  ToRecord(meas_package, &record);
+  if (fwrite(&record, sizeof(record), 1, file_) != 1)
+    return false;
+  record_count_++;
+  return true;
+}
+
+
+bool SensorLogWriter::Close() {
+  if (file_ == NULL)
+    return true;
+  SensorLogHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SENSOR_LOG_MAGIC, sizeof(header.magic));
+  header.version      = SENSOR_LOG_VERSION;
+  header.record_size  = sizeof(SensorLogRecord);
+  header.record_count = record_count_;
+  bool ok = fseek(file_, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file_) == 1;
+  ok = (fclose(file_) == 0) && ok;
+  file_ = NULL;
+  return ok;
+}
+
+
+MappedSensorLog::MappedSensorLog() : data_(NULL), length_(0), records_(NULL), size_(0) {}
+
+
+MappedSensorLog::~MappedSensorLog() {
+  Close();
+}
+
+
+bool MappedSensorLog::Open(const string& path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SensorLogHeader)) {
+    close(fd);
+    return false;
+  }
+  length_ = st.st_size;
+  data_ = mmap(NULL, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = NULL;
+    return false;
+  }
+  // records are read front to back during a replay
+  madvise(data_, length_, MADV_SEQUENTIAL);
+
+  const SensorLogHeader* header = static_cast<const SensorLogHeader*>(data_);
+  if (!IsValidMappedHeader(*header, length_, SENSOR_LOG_MAGIC, SENSOR_LOG_VERSION, sizeof(SensorLogRecord))) {
+    Close();
+    return false;
+  }
+  records_ = reinterpret_cast<const SensorLogRecord*>(header + 1);
+  size_ = header->record_count;
+  // a corrupt or foreign log is rejected as a whole, so Get never sees an
+  // invalid record
+  for (size_t i = 0; i < size_; i++) {
+    if (!IsValidRecord(records_[i])) {
+      cerr << "Invalid record " << i << " in sensor log: " << path << endl;
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void MappedSensorLog::Close() {
+  if (data_ != NULL)
+    munmap(data_, length_);
+  data_ = NULL;
+  length_ = 0;
+  records_ = NULL;
+  size_ = 0;
+}
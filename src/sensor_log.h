@@ -0,0 +1,151 @@
+#ifndef SENSOR_LOG_H_
+#define SENSOR_LOG_H_
+
+#include "measurement_package.h"
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Binary sensor log format for fast offline replays.
+ *
+ * A log is a SensorLogHeader followed by record_count fixed size
+ * SensorLogRecords. All values are stored in native byte order, so a log can
+ * be memory mapped and read in place without any parsing.
+ */
+#define SENSOR_LOG_MAGIC    "UKFSLOG"
+#define SENSOR_LOG_VERSION  2
+
+struct SensorLogHeader {
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  record_size;
+  uint64_t  record_count;
+};
+
+struct SensorLogRecord {
+  int64_t   timestamp;
+  int32_t   sensor_type;
+  int32_t   n_raw;
+  int32_t   track_id;
+  int32_t   reserved;
+  double    raw[3];
+  double    ground_truth[6];
+};
+
+/**
+ * Parses one line [begin, end) of the tab separated text log format. Lines
+ * may start with an integer track id column for logs of multiple objects,
+ * without it the track id is 0. No memory is allocated and all values keep
+ * double precision.
+ * @return false if the line holds no valid measurement
+ */
+bool ParseMeasurement(const char* begin, const char* end, MeasurementPackage* meas_package);
+
+/**
+ * Convenience wrapper around ParseMeasurement for a single line
+ */
+MeasurementPackage getMeasurement(const std::string &sensor_measurement);
+
+/**
+ * Conversion between records and measurement packages. FromRecord expects a
+ * record which passed IsValidRecord.
+ */
+void ToRecord(const MeasurementPackage& meas_package, SensorLogRecord* record);
+void FromRecord(const SensorLogRecord& record, MeasurementPackage* meas_package);
+
+/**
+ * Returns true if the sensor type of the record is known and n_raw matches it
+ */
+bool IsValidRecord(const SensorLogRecord& record);
+
+/**
+ * Returns true if the file starts with the binary sensor log magic
+ */
+bool IsBinarySensorLog(const std::string& path);
+
+/**
+ * Converts a text log into the binary format
+ * @return number of converted records or -1 on error
+ */
+long ConvertTextLog(const std::string& text_path, const std::string& binary_path);
+
+/**
+ * Reads a text log through a large buffer and parses it line by line in place
+ */
+class TextLogReader {
+public:
+  TextLogReader(size_t buffer_size = 1 << 20);
+  virtual ~TextLogReader();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  /**
+   * Parses the next measurement, empty and invalid lines are skipped
+   * @return false at the end of the file
+   */
+  bool Next(MeasurementPackage* meas_package);
+
+private:
+  FILE* file_;
+  std::vector<char> buffer_;
+  size_t begin_;
+  size_t end_;
+  bool eof_;
+
+  bool NextLine(const char** line_begin, const char** line_end);
+};
+
+/**
+ * Writes measurement packages into a binary sensor log. The record count in
+ * the header is written on Close.
+ */
+class SensorLogWriter {
+public:
+  SensorLogWriter();
+  virtual ~SensorLogWriter();
+
+  bool Open(const std::string& path);
+  bool Write(const MeasurementPackage& meas_package);
+  bool Close();
+
+private:
+  FILE* file_;
+  uint64_t record_count_;
+};
+
+/**
+ * Read only memory mapped view of a binary sensor log
+ */
+class MappedSensorLog {
+public:
+  MappedSensorLog();
+  virtual ~MappedSensorLog();
+
+  /**
+   * Maps the log, returns false if the file can't be mapped or is no valid
+   * log. Every record is checked with IsValidRecord once here.
+   */
+  bool Open(const std::string& path);
+  void Close();
+
+  size_t Size() const { return size_; }
+  const SensorLogRecord& Record(size_t i) const { return records_[i]; }
+
+  /**
+   * Fills meas_package from record i, the package can be reused for all records
+   */
+  void Get(size_t i, MeasurementPackage* meas_package) const {
+    FromRecord(records_[i], meas_package);
+  }
+
+private:
+  void* data_;
+  size_t length_;
+  const SensorLogRecord* records_;
+  size_t size_;
+};
+
+#endif /* SENSOR_LOG_H_ */
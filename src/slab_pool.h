@@ -0,0 +1,111 @@
+#ifndef SLAB_POOL_H_
+#define SLAB_POOL_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Object pool which places objects of type T in slabs of kSlotsPerSlab slots.
+ *
+ * Every slot starts on a cache line, so an object never shares a line with
+ * its neighbours. Destroyed slots go to a free list and are reused by the
+ * next Create, both are O(1) and only the first use of a slab allocates. The
+ * slabs are never returned before the pool is destroyed, so objects under
+ * churn keep reusing the same memory. ForEach visits the live objects in
+ * memory order.
+ *
+ * The pool itself is not thread safe.
+ */
+template <class T, size_t kSlotsPerSlab = 64>
+class SlabPool {
+public:
+  SlabPool() : free_(NULL), size_(0) {}
+
+  ~SlabPool() {
+    ForEach([](T& value) { value.~T(); });
+    for (size_t s = 0; s < slabs_.size(); s++)
+      free(slabs_[s]);
+  }
+
+  /**
+   * Constructs an object in a free slot
+   */
+  template <class... Args>
+  T* Create(Args&&... args) {
+    if (free_ == NULL)
+      AddSlab();
+    Slot* slot = free_;
+    T* value = new (slot->storage) T(std::forward<Args>(args)...);
+    free_ = slot->next_free;
+    slot->live = true;
+    size_++;
+    return value;
+  }
+
+  /**
+   * Destroys an object of this pool and recycles its slot
+   */
+  void Destroy(T* value) {
+    // the storage is the first member of the slot
+    Slot* slot = reinterpret_cast<Slot*>(value);
+    value->~T();
+    slot->live = false;
+    slot->next_free = free_;
+    free_ = slot;
+    size_--;
+  }
+
+  /**
+   * Calls f(T&) for all live objects in memory order
+   */
+  template <class F>
+  void ForEach(F f) {
+    for (size_t s = 0; s < slabs_.size(); s++)
+      for (size_t i = 0; i < kSlotsPerSlab; i++)
+        if (slabs_[s][i].live)
+          f(*reinterpret_cast<T*>(slabs_[s][i].storage));
+  }
+
+  size_t Size() const { return size_; }
+  size_t Capacity() const { return slabs_.size() * kSlotsPerSlab; }
+
+  /**
+   * Bytes of one slot including the free list link and padding
+   */
+  static size_t SlotSize() { return sizeof(Slot); }
+
+private:
+  enum { kCacheLine = 64 };
+
+  struct Slot {
+    alignas(kCacheLine) unsigned char storage[sizeof(T)];
+    Slot* next_free;
+    bool live;
+  };
+
+  SlabPool(const SlabPool&);
+  SlabPool& operator=(const SlabPool&);
+
+  void AddSlab() {
+    void* memory = NULL;
+    if (posix_memalign(&memory, kCacheLine, kSlotsPerSlab * sizeof(Slot)) != 0)
+      throw std::bad_alloc();
+    Slot* slab = static_cast<Slot*>(memory);
+    slabs_.push_back(slab);
+    // the free list hands out the slots in memory order
+    for (size_t i = kSlotsPerSlab; i-- > 0;) {
+      slab[i].live = false;
+      slab[i].next_free = free_;
+      free_ = &slab[i];
+    }
+  }
+
+  std::vector<Slot*> slabs_;
+  Slot* free_;
+  size_t size_;
+};
+
+#endif /* SLAB_POOL_H_ */
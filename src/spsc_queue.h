@@ -0,0 +1,87 @@
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Bounded lock-free queue for exactly one producer and one consumer thread.
+ *
+ * The ring holds a power of two number of slots. head_ is only written by the
+ * consumer and tail_ only by the producer, each side keeps a cached copy of
+ * the other index so it touches the shared cache line only when the ring
+ * looks full (producer) or empty (consumer).
+ */
+template <class T>
+class SpscQueue {
+public:
+  /**
+   * @param capacity minimum number of elements, rounded up to a power of two
+   */
+  explicit SpscQueue(size_t capacity)
+    : head_(0), cached_tail_(0), tail_(0), cached_head_(0) {
+    size_t size = 2;
+    while (size < capacity)
+      size *= 2;
+    buffer_.resize(size);
+    mask_ = size - 1;
+  }
+
+  /**
+   * Producer side, returns false if the queue is full
+   */
+  bool TryPush(const T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_)
+        return false;
+    }
+    buffer_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Consumer side, returns false if the queue is empty
+   */
+  bool TryPop(T* value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_)
+        return false;
+    }
+    *value = buffer_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Number of queued elements, exact only when called by producer or consumer
+   * while the other side is idle
+   */
+  size_t Size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const { return mask_ + 1; }
+
+private:
+  std::vector<T> buffer_;
+  size_t mask_;
+
+  // consumer owned
+  alignas(64) std::atomic<size_t> head_;
+  size_t cached_tail_;
+
+  // producer owned
+  alignas(64) std::atomic<size_t> tail_;
+  size_t cached_head_;
+
+  // keeps the producer line free of whatever follows the queue
+  char padding_[64 - sizeof(size_t)];
+};
+
+#endif /* SPSC_QUEUE_H_ */
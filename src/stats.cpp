@@ -0,0 +1,130 @@
+#include "stats.h"
+
+#ifdef UKF_STATS
+
+#include "output_writer.h"
+
+using namespace std;
+
+
+namespace {
+
+const char* const timer_names[STATS_TIMERS] = {
+  "prediction", "update_laser", "update_radar", "update_epoch", "parse"
+};
+
+const char* const gauge_names[STATS_GAUGES] = {
+  "nis_laser", "nis_radar", "nis_laser_out_percent", "nis_radar_out_percent",
+  "rmse_px", "rmse_py", "rmse_vx", "rmse_vy"
+};
+
+void AppendNumber(string* out, double value) {
+  char buffer[32];
+  char* end = AppendDouble(buffer, value, 9);
+  out->append(buffer, end - buffer);
+}
+
+}
+
+
+void StatsHistogram::Reset() {
+  for (int b = 0; b < kBuckets; b++)
+    buckets_[b].store(0, memory_order_relaxed);
+  count_.store(0, memory_order_relaxed);
+  sum_ns_.store(0, memory_order_relaxed);
+  max_ns_.store(0, memory_order_relaxed);
+}
+
+
+Stats& Stats::Global() {
+  static Stats stats;
+  return stats;
+}
+
+
+Stats::Stats() {
+  for (int g = 0; g < STATS_GAUGES; g++)
+    gauges_[g].store(0.0, memory_order_relaxed);
+}
+
+
+void Stats::Reset() {
+  for (int t = 0; t < STATS_TIMERS; t++)
+    timers_[t].Reset();
+  for (int g = 0; g < STATS_GAUGES; g++)
+    gauges_[g].store(0.0, memory_order_relaxed);
+}
+
+
+void Stats::Format(string* out) const {
+  // cumulative buckets with their upper bound in ns, sum and count per timer
+  out->append("# TYPE ukf_duration_ns histogram\n");
+  for (int t = 0; t < STATS_TIMERS; t++) {
+    const StatsHistogram& h = timers_[t];
+    uint64_t cumulative = 0;
+    for (int b = 0; b < StatsHistogram::kBuckets; b++) {
+      uint64_t n = h.Bucket(b);
+      cumulative += n;
+      // empty buckets carry no information beyond their neighbours
+      if (n == 0 && b != StatsHistogram::kBuckets - 1)
+        continue;
+      out->append("ukf_duration_ns_bucket{stage=\"").append(timer_names[t]).append("\",le=\"");
+      if (b == StatsHistogram::kBuckets - 1)
+        out->append("+Inf");
+      else
+        AppendNumber(out, static_cast<double>(uint64_t(1) << b));
+      out->append("\"} ");
+      AppendNumber(out, static_cast<double>(cumulative));
+      out->append("\n");
+    }
+    out->append("ukf_duration_ns_sum{stage=\"").append(timer_names[t]).append("\"} ");
+    AppendNumber(out, static_cast<double>(h.Sum()));
+    out->append("\nukf_duration_ns_count{stage=\"").append(timer_names[t]).append("\"} ");
+    AppendNumber(out, static_cast<double>(h.Count()));
+    out->append("\nukf_duration_ns_max{stage=\"").append(timer_names[t]).append("\"} ");
+    AppendNumber(out, static_cast<double>(h.Max()));
+    out->append("\n");
+  }
+
+  out->append("# TYPE ukf_gauge gauge\n");
+  for (int g = 0; g < STATS_GAUGES; g++) {
+    out->append("ukf_").append(gauge_names[g]).append(" ");
+    AppendNumber(out, Gauge(g));
+    out->append("\n");
+  }
+}
+
+
+StatsDumper::StatsDumper(FILE* out, double interval_s)
+  : out_(out),
+    interval_(chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(interval_s))),
+    stop_(false),
+    thread_(&StatsDumper::Run, this) {
+}
+
+
+StatsDumper::~StatsDumper() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wakeup_.notify_one();
+  thread_.join();
+}
+
+
+void StatsDumper::Run() {
+  string text;
+  unique_lock<mutex> lock(mutex_);
+  bool stop = false;
+  while (!stop) {
+    // the last dump is written when stopping, so short runs report too
+    stop = wakeup_.wait_for(lock, interval_, [this] { return stop_; });
+    text.clear();
+    Stats::Global().Format(&text);
+    fwrite(text.data(), 1, text.size(), out_);
+    fflush(out_);
+  }
+}
+
+#endif /* UKF_STATS */
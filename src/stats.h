@@ -0,0 +1,162 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+/**
+ * Hot path instrumentation: latency histograms of the filter steps and the
+ * parser, and gauges of the latest NIS and RMSE values.
+ *
+ * It is compiled in with the CMake option UKF_STATS, which defines the macro
+ * of the same name. Without it the STATS_ macros expand to nothing and none
+ * of the code below exists, so a default build has no instrumentation at all.
+ *
+ *   STATS_TIMER(STATS_PREDICTION);       times the rest of the enclosing scope
+ *   STATS_GAUGE(STATS_NIS_LASER, nis);   stores the latest value of a gauge
+ *
+ * All recording is lock free and may happen on any thread.
+ */
+
+enum StatsTimer {
+  STATS_PREDICTION = 0,
+  STATS_UPDATE_LASER,     // one update timer per sensor type, in the order of
+  STATS_UPDATE_RADAR,     // MeasurementPackage::SensorType
+  STATS_UPDATE_EPOCH,     // stacked update of a whole fusion epoch
+  STATS_PARSE,            // one measurement line of a log or a telemetry frame
+  STATS_TIMERS
+};
+
+enum StatsGauge {
+  STATS_NIS_LASER = 0,    // NIS of the latest measurement, in the order of
+  STATS_NIS_RADAR,        // MeasurementPackage::SensorType
+  STATS_NIS_LASER_OUT,    // share of timesteps outside the 95% NIS range in %,
+  STATS_NIS_RADAR_OUT,    // in the same order
+  STATS_RMSE_PX,
+  STATS_RMSE_PY,
+  STATS_RMSE_VX,
+  STATS_RMSE_VY,
+  STATS_GAUGES
+};
+
+#ifdef UKF_STATS
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Histogram of durations with power of two buckets. Bucket b counts the
+ * durations in [2^(b-1), 2^b) ns, bucket 0 the durations below 1 ns and the
+ * last bucket everything above.
+ */
+class StatsHistogram {
+public:
+  enum { kBuckets = 32 };
+
+  StatsHistogram() { Reset(); }
+
+  void Add(uint64_t ns) {
+    int b = (ns == 0) ? 0 : 64 - __builtin_clzll(ns);
+    if (b >= kBuckets)
+      b = kBuckets - 1;
+    buckets_[b].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+  }
+
+  void Reset();
+
+  uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t Sum() const { return sum_ns_.load(std::memory_order_relaxed); }
+  uint64_t Max() const { return max_ns_.load(std::memory_order_relaxed); }
+  uint64_t Bucket(int b) const { return buckets_[b].load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_ns_;
+  std::atomic<uint64_t> max_ns_;
+};
+
+/**
+ * The process wide timers and gauges
+ */
+class Stats {
+public:
+  static Stats& Global();
+
+  void Record(int timer, uint64_t ns) { timers_[timer].Add(ns); }
+  void SetGauge(int gauge, double value) { gauges_[gauge].store(value, std::memory_order_relaxed); }
+
+  const StatsHistogram& Timer(int timer) const { return timers_[timer]; }
+  double Gauge(int gauge) const { return gauges_[gauge].load(std::memory_order_relaxed); }
+
+  void Reset();
+
+  /**
+   * Appends all timers and gauges in the Prometheus text format
+   */
+  void Format(std::string* out) const;
+
+private:
+  Stats();
+
+  StatsHistogram timers_[STATS_TIMERS];
+  std::atomic<double> gauges_[STATS_GAUGES];
+};
+
+/**
+ * Records the time from its construction to its destruction
+ */
+class ScopedStatsTimer {
+public:
+  explicit ScopedStatsTimer(int timer) : timer_(timer), start_(std::chrono::steady_clock::now()) {}
+
+  ~ScopedStatsTimer() {
+    std::chrono::steady_clock::duration d = std::chrono::steady_clock::now() - start_;
+    Stats::Global().Record(timer_, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+  }
+
+private:
+  int timer_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Writes Stats::Global() to a file every interval from its own thread and a
+ * last time when it is destroyed
+ */
+class StatsDumper {
+public:
+  StatsDumper(FILE* out, double interval_s);
+  ~StatsDumper();
+
+private:
+  void Run();
+
+  FILE* out_;
+  std::chrono::steady_clock::duration interval_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  bool stop_;
+  std::thread thread_;
+};
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_TIMER(timer) ScopedStatsTimer STATS_CONCAT(stats_timer_, __LINE__)(timer)
+#define STATS_GAUGE(gauge, value) Stats::Global().SetGauge((gauge), (value))
+
+#else
+
+#define STATS_TIMER(timer)
+#define STATS_GAUGE(gauge, value)
+
+#endif /* UKF_STATS */
+
+#endif /* STATS_H_ */
@@ -0,0 +1,136 @@
+#include "sweep.h"
+#include "thread_pool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+
+using namespace std;
+
+
+namespace {
+
+double GridValue(const SweepRange& range, int i) {
+  if (range.steps <= 1)
+    return range.min;
+  return range.min + (range.max - range.min) * i / (range.steps - 1);
+}
+
+}
+
+
+bool ParseSweepRange(const string& text, SweepRange* range) {
+  vector<string> parts;
+  stringstream ss(text);
+  string part;
+  while (getline(ss, part, ':'))
+    parts.push_back(part);
+  if (parts.empty() || parts.size() > 3)
+    return false;
+
+  char* end;
+  range->min = strtod(parts[0].c_str(), &end);
+  if (*end != '\0')
+    return false;
+  range->max = range->min;
+  range->steps = 1;
+  if (parts.size() > 1) {
+    range->max = strtod(parts[1].c_str(), &end);
+    if (*end != '\0')
+      return false;
+  }
+  if (parts.size() > 2) {
+    range->steps = static_cast<int>(strtol(parts[2].c_str(), &end, 10));
+    if (*end != '\0' || range->steps < 1)
+      return false;
+  }
+  return true;
+}
+
+
+bool SweepConfigs(const SweepSpec& spec, vector<FilterConfig>* configs) {
+  configs->clear();
+  mt19937 rng(spec.seed);
+  uniform_real_distribution<double> unit(0.0, 1.0);
+
+  for (size_t f = 0; f < spec.filters.size(); f++) {
+    if (spec.filters[f] != "ukf" && spec.filters[f] != "ekf")
+      return false;
+    for (size_t s = 0; s < spec.sensors.size(); s++) {
+      FilterConfig config;
+      config.filter = spec.filters[f];
+      config.ctrv_kernel = spec.ctrv_kernel;
+      config.ctrv_precision = spec.ctrv_precision;
+      config.trig_mode = spec.trig_mode;
+      config.lazy_prediction = spec.lazy_prediction;
+      config.nis_gate = spec.nis_gate;
+      if (spec.sensors[s] == "both") {
+        config.use_laser = config.use_radar = true;
+      } else if (spec.sensors[s] == "laser") {
+        config.use_laser = true;
+        config.use_radar = false;
+      } else if (spec.sensors[s] == "radar") {
+        config.use_laser = false;
+        config.use_radar = true;
+      } else {
+        return false;
+      }
+
+      if (spec.random) {
+        for (int i = 0; i < spec.samples; i++) {
+          config.std_a     = spec.std_a.min + (spec.std_a.max - spec.std_a.min) * unit(rng);
+          config.std_yawdd = spec.std_yawdd.min + (spec.std_yawdd.max - spec.std_yawdd.min) * unit(rng);
+          configs->push_back(config);
+        }
+      } else {
+        for (int i = 0; i < spec.std_a.steps; i++) {
+          for (int j = 0; j < spec.std_yawdd.steps; j++) {
+            config.std_a     = GridValue(spec.std_a, i);
+            config.std_yawdd = GridValue(spec.std_yawdd, j);
+            configs->push_back(config);
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
+vector<ReplayResult> RunSweep(const vector<FilterConfig>& configs,
+                              const vector<MeasurementPackage>& measurements, int threads) {
+  vector<ReplayResult> results(configs.size());
+  ThreadPool pool(threads);
+  for (size_t i = 0; i < configs.size(); i++) {
+    // every task writes only its own result slot
+    pool.Submit([&configs, &measurements, &results, i] {
+      results[i] = Replay(configs[i], measurements);
+    });
+  }
+  pool.Wait();
+  return results;
+}
+
+
+void PrintSweep(const vector<FilterConfig>& configs, const vector<ReplayResult>& results) {
+  printf("%5s %-4s %-6s %9s %9s %10s %10s %10s %10s %8s %8s\n", "#", "filt", "sensor", "std_a", "std_yawdd",
+         "rmse_px", "rmse_py", "rmse_vx", "rmse_vy", "nis_l%", "nis_r%");
+  size_t best = 0;
+  for (size_t i = 0; i < configs.size(); i++) {
+    const FilterConfig& c = configs[i];
+    const ReplayResult& r = results[i];
+    printf("%5zu %-4s %-6s %9.4f %9.4f %10.5f %10.5f %10.5f %10.5f %8.2f %8.2f\n", i, c.filter.c_str(),
+           SensorName(c), c.std_a, c.std_yawdd, r.rmse(0), r.rmse(1), r.rmse(2), r.rmse(3),
+           r.nis_laser_percent, r.nis_radar_percent);
+    // NaN sums never compare lower, so diverged runs are not picked
+    if (r.rmse.sum() < results[best].rmse.sum() || !(results[best].rmse.sum() == results[best].rmse.sum()))
+      best = i;
+  }
+  if (!configs.empty()) {
+    const FilterConfig& c = configs[best];
+    const ReplayResult& r = results[best];
+    printf("Best configuration #%zu: filter=%s, sensors=%s, std_a=%g, std_yawdd=%g, "
+           "RMSE=[%g, %g, %g, %g]\n", best, c.filter.c_str(), SensorName(c), c.std_a, c.std_yawdd,
+           r.rmse(0), r.rmse(1), r.rmse(2), r.rmse(3));
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+#include "replay.h"
+#include <string>
+#include <vector>
+
+/**
+ * Values of one swept parameter: `steps` evenly spaced values from min to max
+ * for a grid search, the interval [min, max] for a random search
+ */
+struct SweepRange {
+  double min;
+  double max;
+  int steps;
+};
+
+/**
+ * Parses "min:max:steps", "min:max" (steps = 1 for grids) or a single value
+ * @return false if the text is not a valid range
+ */
+bool ParseSweepRange(const std::string& text, SweepRange* range);
+
+/**
+ * Parameter sweep over filters, sensor combinations and process noise
+ */
+struct SweepSpec {
+  std::vector<std::string> filters;        // "ukf", "ekf"
+  std::vector<std::string> sensors;        // "both", "laser", "radar"
+  SweepRange std_a;
+  SweepRange std_yawdd;
+  bool random;                             // random instead of grid search
+  int samples;                             // random samples per filter and sensor combination
+  unsigned seed;
+  CtrvKernel ctrv_kernel;
+  CtrvPrecision ctrv_precision;
+  TrigMode trig_mode;
+  bool lazy_prediction;
+  NisGate nis_gate;
+};
+
+/**
+ * Expands the sweep into the list of filter configurations
+ * @return false if a filter or sensor name is unknown
+ */
+bool SweepConfigs(const SweepSpec& spec, std::vector<FilterConfig>* configs);
+
+/**
+ * Replays the measurements with every configuration, spread over a thread
+ * pool. The measurements are shared read only by all replays.
+ */
+std::vector<ReplayResult> RunSweep(const std::vector<FilterConfig>& configs,
+                                   const std::vector<MeasurementPackage>& measurements, int threads);
+
+/**
+ * Prints one line per configuration and the configuration with the lowest
+ * sum of RMSE values
+ */
+void PrintSweep(const std::vector<FilterConfig>& configs, const std::vector<ReplayResult>& results);
+
+#endif /* SWEEP_H_ */
@@ -0,0 +1,168 @@
+#include "telemetry.h"
+#include "sensor_log.h"
+#include "output_writer.h"
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+
+const char kManualReply[] = "42[\"manual\",{}]";
+const size_t kManualReplyLength = sizeof(kManualReply) - 1;
+
+
+namespace {
+
+// longest sensor measurement string that is decoded
+const size_t kMaxMeasurementLength = 1024;
+
+inline const char* SkipWhitespace(const char* p, const char* end) {
+  while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    p++;
+  return p;
+}
+
+inline bool Match(const char*& p, const char* end, const char* literal, size_t length) {
+  if (static_cast<size_t>(end - p) < length || memcmp(p, literal, length) != 0)
+    return false;
+  p += length;
+  return true;
+}
+
+inline int HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/**
+ * Decodes the JSON string starting behind the opening quote at p into out.
+ * Only escapes which can appear in a measurement are supported, \\uXXXX only
+ * for ASCII characters.
+ * @return length of the decoded string or -1
+ */
+long DecodeString(const char*& p, const char* end, char* out, size_t size) {
+  size_t n = 0;
+  while (p != end) {
+    char c = *p++;
+    if (c == '"')
+      return n;
+    if (c == '\\') {
+      if (p == end)
+        return -1;
+      char e = *p++;
+      switch (e) {
+        case 't':  c = '\t'; break;
+        case 'n':  c = '\n'; break;
+        case 'r':  c = '\r'; break;
+        case '"':  c = '"';  break;
+        case '\\': c = '\\'; break;
+        case '/':  c = '/';  break;
+        case 'u': {
+          if (end - p < 4)
+            return -1;
+          int v = 0;
+          for (int i = 0; i < 4; i++) {
+            int h = HexValue(p[i]);
+            if (h < 0)
+              return -1;
+            v = v * 16 + h;
+          }
+          if (v > 0x7f)
+            return -1;
+          c = static_cast<char>(v);
+          p += 4;
+          break;
+        }
+        default:
+          return -1;
+      }
+    }
+    if (n == size)
+      return -1;
+    out[n++] = c;
+  }
+  return -1;
+}
+
+char* AppendField(char* p, const char* name, size_t length, double value) {
+  memcpy(p, name, length);
+  p += length;
+  // JSON has no representation for nan and inf
+  if (!std::isfinite(value)) {
+    memcpy(p, "null", 4);
+    return p + 4;
+  }
+  // 9 significant digits round trip the single precision values of the simulator
+  return AppendDouble(p, value, 9);
+}
+
+}
+
+
+TelemetryFrame ParseTelemetryFrame(const char* data, size_t length, MeasurementPackage* meas_package) {
+  // "42" at the start of the message means there's a websocket message event.
+  // The 4 signifies a websocket message
+  // The 2 signifies a websocket event
+  if (length <= 2 || data[0] != '4' || data[1] != '2')
+    return TELEMETRY_IGNORE;
+  const char* p = data + 2;
+  const char* end = data + length;
+
+  p = SkipWhitespace(p, end);
+  if (!Match(p, end, "[", 1))
+    return TELEMETRY_MANUAL;
+  p = SkipWhitespace(p, end);
+  if (!Match(p, end, "\"telemetry\"", 11))
+    return TELEMETRY_IGNORE;
+  p = SkipWhitespace(p, end);
+  if (!Match(p, end, ",", 1))
+    return TELEMETRY_MANUAL;
+  p = SkipWhitespace(p, end);
+  if (p == end || *p != '{')
+    return TELEMETRY_MANUAL;   // null while the simulator is in manual mode
+
+  // find the sensor_measurement value at the top level of the object, the
+  // other fields are skipped without decoding
+  static const char key[] = "\"sensor_measurement\"";
+  const char* found = NULL;
+  for (const char* q = p + 1; q + sizeof(key) - 1 <= end; q++) {
+    if (*q == '"' && memcmp(q, key, sizeof(key) - 1) == 0) {
+      found = q + sizeof(key) - 1;
+      break;
+    }
+  }
+  if (found == NULL)
+    return TELEMETRY_MANUAL;
+  p = SkipWhitespace(found, end);
+  if (!Match(p, end, ":", 1))
+    return TELEMETRY_MANUAL;
+  p = SkipWhitespace(p, end);
+  if (!Match(p, end, "\"", 1))
+    return TELEMETRY_MANUAL;
+
+  char line[kMaxMeasurementLength];
+  long n = DecodeString(p, end, line, sizeof(line));
+  if (n < 0 || !ParseMeasurement(line, line + n, meas_package))
+    return TELEMETRY_MANUAL;
+  return TELEMETRY_MEASUREMENT;
+}
+
+
+size_t FormatEstimateReply(const FilterEstimate& estimate, char* buffer) {
+  // same fields and key order as the json object of the previous implementation
+  static const char head[] = "42[\"estimate_marker\",{";
+  char* p = buffer;
+  memcpy(p, head, sizeof(head) - 1);
+  p += sizeof(head) - 1;
+  p = AppendField(p, "\"estimate_x\":", 13, estimate.x);
+  p = AppendField(p, ",\"estimate_y\":", 14, estimate.y);
+  p = AppendField(p, ",\"rmse_vx\":", 11, estimate.rmse(2));
+  p = AppendField(p, ",\"rmse_vy\":", 11, estimate.rmse(3));
+  p = AppendField(p, ",\"rmse_x\":", 10, estimate.rmse(0));
+  p = AppendField(p, ",\"rmse_y\":", 10, estimate.rmse(1));
+  *p++ = '}';
+  *p++ = ']';
+  return p - buffer;
+}
@@ -0,0 +1,46 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include "measurement_package.h"
+#include "async_filter.h"
+#include <cstddef>
+
+/**
+ * Fast path for the socket.io frames of the simulator.
+ *
+ * The simulator only sends two kinds of events: 42["telemetry",{...}] with a
+ * "sensor_measurement" string in the text log format, and 42["telemetry",null]
+ * while it runs in manual mode. These are decoded directly from the receive
+ * buffer without building strings or a JSON document.
+ */
+enum TelemetryFrame {
+  TELEMETRY_IGNORE,        // no socket.io event or an event other than telemetry
+  TELEMETRY_MANUAL,        // event without data, answered with a manual message
+  TELEMETRY_MEASUREMENT    // a valid sensor measurement
+};
+
+/**
+ * Parses one websocket message
+ * @param meas_package filled for TELEMETRY_MEASUREMENT
+ */
+TelemetryFrame ParseTelemetryFrame(const char* data, size_t length, MeasurementPackage* meas_package);
+
+/**
+ * Maximum length of a reply written by the functions below
+ */
+#define TELEMETRY_MAX_REPLY 256
+
+/**
+ * Writes the 42["estimate_marker",{...}] reply into buffer, which has to hold
+ * TELEMETRY_MAX_REPLY characters
+ * @return length of the reply
+ */
+size_t FormatEstimateReply(const FilterEstimate& estimate, char* buffer);
+
+/**
+ * The reply to frames without data
+ */
+extern const char kManualReply[];
+extern const size_t kManualReplyLength;
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,118 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+
+namespace {
+
+// pool and worker index of the current thread, used to submit into the own deque
+thread_local const ThreadPool* current_pool = NULL;
+thread_local int current_worker = -1;
+
+}
+
+
+ThreadPool::ThreadPool(int threads)
+  : next_queue_(0),
+    steals_(0),
+    queued_(0),
+    pending_(0),
+    stop_(false) {
+  if (threads <= 0)
+    threads = max(1u, thread::hardware_concurrency());
+  for (int i = 0; i < threads; i++)
+    queues_.push_back(unique_ptr<WorkerQueue>(new WorkerQueue));
+  for (int i = 0; i < threads; i++)
+    workers_.push_back(thread(&ThreadPool::Run, this, i));
+}
+
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_ready_.notify_all();
+  for (size_t i = 0; i < workers_.size(); i++)
+    workers_[i].join();
+}
+
+
+void ThreadPool::Submit(const function<void()>& task) {
+  int queue;
+  if (current_pool == this)
+    queue = current_worker;
+  else
+    queue = next_queue_++ % queues_.size();
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    queued_++;
+    pending_++;
+  }
+  {
+    lock_guard<mutex> lock(queues_[queue]->mutex);
+    queues_[queue]->tasks.push_back(task);
+  }
+  task_ready_.notify_one();
+}
+
+
+void ThreadPool::Wait() {
+  unique_lock<mutex> lock(mutex_);
+  all_done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+
+bool ThreadPool::Pop(int worker, function<void()>* task) {
+  WorkerQueue& queue = *queues_[worker];
+  lock_guard<mutex> lock(queue.mutex);
+  if (queue.tasks.empty())
+    return false;
+  *task = queue.tasks.back();
+  queue.tasks.pop_back();
+  return true;
+}
+
+
+bool ThreadPool::Steal(int worker, function<void()>* task) {
+  const int n = static_cast<int>(queues_.size());
+  for (int i = 1; i < n; i++) {
+    WorkerQueue& queue = *queues_[(worker + i) % n];
+    lock_guard<mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = queue.tasks.front();
+      queue.tasks.pop_front();
+      steals_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void ThreadPool::Run(int worker) {
+  current_pool = this;
+  current_worker = worker;
+  while (true) {
+    function<void()> task;
+    if (Pop(worker, &task) || Steal(worker, &task)) {
+      queued_--;
+      task();
+      // the last finished task wakes up Wait
+      if (--pending_ == 0) {
+        lock_guard<mutex> lock(mutex_);
+        all_done_.notify_all();
+      }
+      continue;
+    }
+
+    // queued_ can be positive for a moment before the task is in its deque,
+    // the worker then just tries again
+    unique_lock<mutex> lock(mutex_);
+    task_ready_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_ && queued_ == 0)
+      return;
+  }
+}
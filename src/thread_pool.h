@@ -0,0 +1,74 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed size pool of worker threads with work stealing.
+ *
+ * Every worker owns a task deque. Tasks submitted by a worker go to the back
+ * of its own deque and are taken from there again (LIFO, the data is still in
+ * its cache), tasks submitted from other threads are spread round robin over
+ * the workers. A worker without tasks steals from the front of the other
+ * deques, so long running tasks do not leave cores idle.
+ */
+class ThreadPool {
+public:
+  /**
+   * @param threads number of worker threads, 0 uses one per hardware thread
+   */
+  explicit ThreadPool(int threads = 0);
+
+  /**
+   * Finishes all submitted tasks and joins the workers
+   */
+  ~ThreadPool();
+
+  void Submit(const std::function<void()>& task);
+
+  /**
+   * Blocks until all submitted tasks are finished, including tasks which are
+   * submitted by running tasks
+   */
+  void Wait();
+
+  int Size() const { return static_cast<int>(workers_.size()); }
+
+  /**
+   * Number of tasks that were taken from the deque of another worker
+   */
+  long Steals() const { return steals_.load(); }
+
+private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<WorkerQueue> > queues_;
+  std::atomic<unsigned> next_queue_;
+  std::atomic<long> steals_;
+
+  ///* tasks waiting in the deques and tasks which are not finished yet,
+  ///* both are only increased while mutex_ is held so no wakeup is lost
+  std::atomic<long> queued_;
+  std::atomic<long> pending_;
+  std::mutex mutex_;
+  std::condition_variable task_ready_;
+  std::condition_variable all_done_;
+  bool stop_;
+
+  bool Pop(int worker, std::function<void()>* task);
+  bool Steal(int worker, std::function<void()>* task);
+  void Run(int worker);
+};
+
+#endif /* THREAD_POOL_H_ */
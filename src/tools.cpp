@@ -10,41 +10,92 @@ Tools::Tools() {}
 Tools::~Tools() {}
 
 
-VectorXd Tools::CalculateRMSE(const vector<VectorXd> &estimations,
-                              const vector<VectorXd> &ground_truth) {
-	/**
-	TODO:
-	* Calculate the RMSE here.
-	*/
+RmseVector CartesianEstimate(const Eigen::Ref<const VectorXd>& x) {
+  double p_x = x(0);
+  double p_y = x(1);
+  double v   = x(2);
+  double yaw = x(3);
+  RmseVector estimate;
+  estimate << p_x, p_y, cos(yaw)*v, sin(yaw)*v;
+  return estimate;
+}
+
+
+RmseAccumulator::RmseAccumulator(size_t window)
+  : window_(window),
+    window_sq_(4, window) {
+  Reset();
+}
+
+
+void RmseAccumulator::Reset() {
+  sum_sq_.setZero();
+  count_ = 0;
+  window_pos_ = 0;
+  window_count_ = 0;
+  window_sq_.setZero();
+  window_sum_.setZero();
+}
+
+
+void RmseAccumulator::Add(const Eigen::Ref<const VectorXd>& estimation,
+                          const Eigen::Ref<const VectorXd>& ground_truth) {
+  RmseVector residual = estimation.head<4>() - ground_truth.head<4>();
+  residual = residual.array()*residual.array();
+  sum_sq_ += residual;
+  count_++;
+
+  if (window_ > 0) {
+    window_sum_ += residual - window_sq_.col(window_pos_);
+    window_sq_.col(window_pos_) = residual;
+    window_pos_++;
+    if (window_count_ < window_)
+      window_count_++;
+    if (window_pos_ == window_) {
+      // recompute the running sum once per window to cancel rounding drift
+      window_pos_ = 0;
+      window_sum_ = window_sq_.rowwise().sum();
+    }
+  }
+}
+
+
+void RmseAccumulator::Merge(const RmseAccumulator& other) {
+  sum_sq_ += other.sum_sq_;
+  count_ += other.count_;
+}
+
+
+RmseVector RmseAccumulator::Rmse() const {
+  if (count_ == 0)
+    return RmseVector::Zero();
+  return (sum_sq_ / count_).array().sqrt();
+}
 
-	VectorXd rmse = VectorXd::Zero(4);
 
+RmseVector RmseAccumulator::WindowRmse() const {
+  if (window_count_ == 0)
+    return RmseVector::Zero();
+  return (window_sum_ / window_count_).array().sqrt();
+}
+
+
+VectorXd Tools::CalculateRMSE(const vector<VectorXd> &estimations,
+                              const vector<VectorXd> &ground_truth) {
 	// check the validity of the following inputs:
 	//  * the estimation vector size should not be zero
 	//  * the estimation vector size should equal ground truth vector size
 	if (estimations.size() != ground_truth.size() || estimations.size() == 0)
 	{
 		cout << "Invalid estimation or ground_truth data" << endl;
-		return rmse;
+		return VectorXd::Zero(4);
 	}
 
 	//accumulate squared residuals
+	RmseAccumulator rmse;
 	for (unsigned int i=0; i < estimations.size(); ++i)
-	{
-
-		VectorXd residual = estimations[i] - ground_truth[i];
-
-		//coefficient-wise multiplication
-		residual = residual.array()*residual.array();
-		rmse += residual;
-	}
-
-	//calculate the mean
-	rmse = rmse/estimations.size();
-
-	//calculate the squared root
-	rmse = rmse.array().sqrt();
+		rmse.Add(estimations[i], ground_truth[i]);
 
 	//return the result
-	return rmse;
+	return rmse.Rmse();
 }
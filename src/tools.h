@@ -7,6 +7,60 @@ using Eigen::MatrixXd;
 using Eigen::VectorXd;
 using namespace std;
 
+///* estimate and ground truth vector [px py vx vy] used for the RMSE
+typedef Eigen::Matrix<double, 4, 1, Eigen::DontAlign> RmseVector;
+
+/**
+ * Converts a CTRV state [px py v yaw yawrate] into the cartesian estimate
+ * [px py vx vy] which is compared against the ground truth.
+ */
+RmseVector CartesianEstimate(const Eigen::Ref<const VectorXd>& x);
+
+/**
+ * Streaming RMSE with constant time updates and constant memory.
+ *
+ * Only the sums of squared residuals are kept, so partial results of
+ * independent runs can be merged. Optionally the RMSE over the last `window`
+ * samples is tracked as well, its running sum is recomputed every time the
+ * window wraps around so it does not drift.
+ */
+class RmseAccumulator {
+public:
+  RmseAccumulator(size_t window = 0);
+
+  void Add(const Eigen::Ref<const VectorXd>& estimation, const Eigen::Ref<const VectorXd>& ground_truth);
+
+  /**
+   * Adds the samples of another accumulator to the cumulative RMSE. The
+   * window of this accumulator is not changed.
+   */
+  void Merge(const RmseAccumulator& other);
+
+  void Reset();
+
+  size_t Count() const { return count_; }
+
+  /**
+   * RMSE over all samples, zero if there are none
+   */
+  RmseVector Rmse() const;
+
+  /**
+   * RMSE over the last `window` samples, zero if the window is disabled
+   */
+  RmseVector WindowRmse() const;
+
+private:
+  RmseVector sum_sq_;
+  size_t count_;
+
+  size_t window_;
+  size_t window_pos_;
+  size_t window_count_;
+  Eigen::Matrix<double, 4, Eigen::Dynamic> window_sq_;
+  RmseVector window_sum_;
+};
+
 class Tools {
 public:
   /**
@@ -26,4 +80,4 @@ public:
 
 };
 
-#endif /* TOOLS_H_ */
\ No newline at end of file
+#endif /* TOOLS_H_ */
@@ -0,0 +1,180 @@
+#include "tracking_pipeline.h"
+#include "filter_snapshot.h"
+#include <limits>
+
+using namespace std;
+
+
+TrackingPipeline::TrackingPipeline(const FilterConfig& config, int threads)
+  : config_(config),
+    pool_(threads) {
+}
+
+
+TrackingPipeline::~TrackingPipeline() {
+  // the tracks are destroyed by track_pool_
+  pool_.Wait();
+}
+
+
+TrackingPipeline::Track* TrackingPipeline::GetTrack(int track_id) {
+  lock_guard<mutex> lock(tracks_mutex_);
+  map<int, Track*>::iterator it = tracks_.find(track_id);
+  if (it != tracks_.end())
+    return it->second;
+
+  Track* track = track_pool_.Create();
+  track->track_id = track_id;
+  track->filter = CreateFilter(config_, &track->filter_storage);
+  track->history = (config_.history > 0) ? new FilterHistory(track->filter, config_.history) : NULL;
+  track->scheduled = false;
+  track->last_timestamp = 0;
+  track->restored_us = numeric_limits<long long>::min();
+  track->measurements = 0;
+  track->dropped = 0;
+  tracks_[track_id] = track;
+  return track;
+}
+
+
+void TrackingPipeline::Push(const MeasurementPackage& meas_package) {
+  Track* track = GetTrack(meas_package.track_id_);
+  bool schedule = false;
+  {
+    lock_guard<mutex> lock(track->mutex);
+    if (meas_package.timestamp_ <= track->restored_us)
+      return;
+    if (track->history == NULL && track->measurements > 0 && meas_package.timestamp_ < track->last_timestamp) {
+      track->dropped++;
+      return;
+    }
+    // keep the pending measurements sorted, they usually arrive in order
+    deque<MeasurementPackage>::iterator pos = track->pending.end();
+    while (pos != track->pending.begin() && (pos - 1)->timestamp_ > meas_package.timestamp_)
+      --pos;
+    track->pending.insert(pos, meas_package);
+    if (!track->scheduled) {
+      track->scheduled = true;
+      schedule = true;
+    }
+  }
+  if (schedule)
+    pool_.Submit([this, track] { Drain(track); });
+}
+
+
+void TrackingPipeline::Drain(Track* track) {
+  for (int i = 0; i < kBatchSize; i++) {
+    MeasurementPackage meas_package;
+    {
+      lock_guard<mutex> lock(track->mutex);
+      if (track->pending.empty()) {
+        track->scheduled = false;
+        return;
+      }
+      meas_package = track->pending.front();
+      track->pending.pop_front();
+      track->last_timestamp = max(track->last_timestamp, meas_package.timestamp_);
+      track->measurements++;
+    }
+
+    // only this task touches the filter of the track
+    if (track->history != NULL) {
+      if (!track->history->ProcessMeasurement(meas_package)) {
+        lock_guard<mutex> lock(track->mutex);
+        track->dropped++;
+        continue;
+      }
+    } else {
+      track->filter->ProcessMeasurement(meas_package);
+    }
+    track->rmse.Add(CartesianEstimate(track->filter->StateAt(meas_package.timestamp_)), meas_package.ground_truth_);
+    if (callback_)
+      callback_(track->track_id, *track->filter, meas_package, track->rmse.Rmse());
+  }
+  // more measurements may be pending, continue in a new task which other
+  // workers can steal
+  pool_.Submit([this, track] { Drain(track); });
+}
+
+
+void TrackingPipeline::Flush() {
+  pool_.Wait();
+}
+
+
+vector<TrackingPipeline::TrackSummary> TrackingPipeline::Summary() {
+  vector<TrackSummary> summary;
+  lock_guard<mutex> lock(tracks_mutex_);
+  for (map<int, Track*>::iterator it = tracks_.begin(); it != tracks_.end(); ++it) {
+    Track* track = it->second;
+    lock_guard<mutex> track_lock(track->mutex);
+    TrackSummary s;
+    s.track_id = track->track_id;
+    s.x = track->filter->x_;
+    s.rmse = track->rmse.Rmse();
+    s.measurements = track->measurements;
+    s.dropped = track->dropped;
+    s.nis_laser_counter = track->filter->nis_laser_counter_;
+    s.nis_radar_counter = track->filter->nis_radar_counter_;
+    s.gated_laser_counter = track->filter->gated_laser_counter_;
+    s.gated_radar_counter = track->filter->gated_radar_counter_;
+    s.timestep = track->filter->timestep_;
+    summary.push_back(s);
+  }
+  return summary;
+}
+
+
+bool TrackingPipeline::Retire(int track_id) {
+  lock_guard<mutex> lock(tracks_mutex_);
+  map<int, Track*>::iterator it = tracks_.find(track_id);
+  if (it == tracks_.end())
+    return false;
+  Track* track = it->second;
+  {
+    lock_guard<mutex> track_lock(track->mutex);
+    if (track->scheduled)
+      return false;
+  }
+  tracks_.erase(it);
+  track_pool_.Destroy(track);
+  return true;
+}
+
+
+bool TrackingPipeline::SaveSnapshot(const string& path) {
+  FilterSnapshotWriter writer;
+  if (!writer.Open(path))
+    return false;
+  lock_guard<mutex> lock(tracks_mutex_);
+  for (map<int, Track*>::iterator it = tracks_.begin(); it != tracks_.end(); ++it) {
+    Track* track = it->second;
+    lock_guard<mutex> track_lock(track->mutex);
+    if (!writer.Write(track->track_id, *track->filter))
+      return false;
+  }
+  return writer.Close();
+}
+
+
+long TrackingPipeline::LoadSnapshot(const string& path) {
+  MappedFilterSnapshot snapshot;
+  if (!snapshot.Open(path))
+    return -1;
+  for (size_t i = 0; i < snapshot.Size(); i++) {
+    Track* track = GetTrack(snapshot.Record(i).track_id);
+    lock_guard<mutex> lock(track->mutex);
+    if (!snapshot.Restore(i, track->filter))
+      return -1;
+    track->restored_us = track->filter->time_us_;
+    track->last_timestamp = track->filter->time_us_;
+  }
+  return snapshot.Size();
+}
+
+
+size_t TrackingPipeline::Tracks() {
+  lock_guard<mutex> lock(tracks_mutex_);
+  return track_pool_.Size();
+}
@@ -0,0 +1,161 @@
+#ifndef TRACKING_PIPELINE_H_
+#define TRACKING_PIPELINE_H_
+
+#include "replay.h"
+#include "thread_pool.h"
+#include "filter_history.h"
+#include "slab_pool.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Multi object tracking stage.
+ *
+ * Measurements are routed by their track id to one filter per track, which is
+ * created from the shared FilterConfig on the first measurement of the
+ * track. The predict and update work runs on a work stealing ThreadPool.
+ * Every track has at most one task scheduled at a time, which processes the
+ * pending measurements of the track in timestamp order, so different tracks
+ * run in parallel while each track stays sequential.
+ *
+ * Measurements which are older than the last processed measurement of their
+ * track are rewound into the track with a FilterHistory if the configuration
+ * enables one, otherwise they are dropped and counted.
+ *
+ * Tracks live in a SlabPool together with their filter, so the state of a
+ * track is contiguous and a retired track is replaced by the next new one in
+ * the same memory.
+ */
+class TrackingPipeline {
+public:
+  /**
+   * Called on a worker thread after every processed measurement. Calls for
+   * the same track never overlap, calls for different tracks can.
+   */
+  typedef std::function<void(int track_id, const Filter& filter, const MeasurementPackage& meas_package,
+                             const RmseVector& rmse)> EstimateCallback;
+
+  /**
+   * Summary of one track
+   */
+  struct TrackSummary {
+    int track_id;
+    StateVector x;
+    RmseVector rmse;
+    long measurements;
+    long dropped;
+    int nis_laser_counter;
+    int nis_radar_counter;
+    int gated_laser_counter;
+    int gated_radar_counter;
+    int timestep;
+  };
+
+  /**
+   * @param config filter configuration used for every track
+   * @param threads number of worker threads, 0 uses all cores
+   */
+  TrackingPipeline(const FilterConfig& config, int threads = 0);
+  virtual ~TrackingPipeline();
+
+  void SetEstimateCallback(const EstimateCallback& callback) { callback_ = callback; }
+
+  /**
+   * Queues a measurement for its track and returns immediately
+   */
+  void Push(const MeasurementPackage& meas_package);
+
+  /**
+   * Blocks until all pushed measurements are processed
+   */
+  void Flush();
+
+  /**
+   * Summaries of all tracks ordered by track id, call after Flush
+   */
+  std::vector<TrackSummary> Summary();
+
+  /**
+   * Removes an idle track, a later measurement of the same id starts a new
+   * track. A track is idle when none of its measurements are pending, e.g.
+   * after Flush. Must not be called while measurements of the same track id
+   * are pushed.
+   * @return false if the track does not exist or is not idle
+   */
+  bool Retire(int track_id);
+
+  /**
+   * Writes the filters of all tracks into a snapshot, ordered by track id.
+   * Call after Flush.
+   * @return false if the file can not be written
+   */
+  bool SaveSnapshot(const std::string& path);
+
+  /**
+   * Creates a track for every record of a snapshot and restores its filter.
+   * Measurements of a restored track up to the time of its snapshot are
+   * skipped, so replaying the log the snapshot was taken from continues
+   * where it ended. Call before the first Push.
+   * @return number of restored tracks, -1 if the file is no valid snapshot of
+   *         the configured filter
+   */
+  long LoadSnapshot(const std::string& path);
+
+  size_t Tracks();
+
+  int Threads() const { return pool_.Size(); }
+  long Steals() const { return pool_.Steals(); }
+
+private:
+  struct Track {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Track() : filter(NULL), history(NULL) {}
+
+    ~Track() {
+      delete history;
+      if (filter != NULL)
+        filter->~Filter();
+    }
+
+    int track_id;
+    Filter* filter;               // created in filter_storage
+    FilterHistory* history;       // NULL if out of sequence handling is disabled
+    RmseAccumulator rmse;
+
+    ///* guards pending, scheduled and last_timestamp
+    std::mutex mutex;
+    std::deque<MeasurementPackage> pending;
+    bool scheduled;
+    long last_timestamp;
+    long long restored_us;        // time of the snapshot the track was restored from
+    long measurements;
+    long dropped;
+
+    FilterStorage filter_storage;
+  };
+
+  ///* measurements processed by one task before it reschedules itself, so a
+  ///* busy track does not occupy a worker forever
+  static const int kBatchSize = 32;
+
+  FilterConfig config_;
+  EstimateCallback callback_;
+
+  ///* guards tracks_ and track_pool_
+  std::mutex tracks_mutex_;
+  std::map<int, Track*> tracks_;
+  SlabPool<Track> track_pool_;
+
+  ///* declared last so the workers are joined before the tracks are freed
+  ThreadPool pool_;
+
+  Track* GetTrack(int track_id);
+  void Drain(Track* track);
+};
+
+#endif /* TRACKING_PIPELINE_H_ */
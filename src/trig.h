@@ -0,0 +1,92 @@
+#ifndef TRIG_H
+#define TRIG_H
+
+#include <math.h>
+
+/**
+ * Sine and cosine of the process and measurement models. Every user computes
+ * the pair of an angle once and reuses it, the mode selects how the pair is
+ * evaluated.
+ *
+ * The vectorized CTRV kernels have their own copy in ctrv_kernel_simd.h,
+ * this header must not be included by the instruction set specific
+ * translation units, their versions of the inline functions would otherwise
+ * be shared with the rest of the program.
+ */
+
+enum TrigMode {
+  TRIG_EXACT = 0,   // sin and cos of the C library
+  TRIG_FAST         // polynomial approximation, see SinCosFast
+};
+
+// largest argument which SinCosFast reduces itself, above it the C library is used
+#define TRIG_FAST_MAX_ARG    1.0e5
+
+// bound of the absolute error of SinCosFast for |x| <= TRIG_FAST_MAX_ARG
+#define TRIG_FAST_MAX_ERROR  2.0e-9
+
+/**
+ * Sine and cosine of x with the C library
+ */
+inline void SinCosExact(double x, double* s, double* c) {
+  *s = sin(x);
+  *c = cos(x);
+}
+
+/**
+ * Approximate sine and cosine of x. The argument is reduced to [-pi/4, pi/4]
+ * with a two part Cody-Waite reduction, which is exact for the quadrant
+ * numbers below TRIG_FAST_MAX_ARG, and evaluated by the leading terms of the
+ * cephes polynomials: degree 9 for the sine and degree 10 for the cosine.
+ * The truncation dominates the error, which stays below TRIG_FAST_MAX_ERROR.
+ * Note that the error is absolute: the CTRV model divides differences of
+ * sines by the yaw rate, so position errors grow with v/yawd.
+ */
+inline void SinCosFast(double x, double* s, double* c) {
+  if (!(fabs(x) <= TRIG_FAST_MAX_ARG)) {
+    SinCosExact(x, s, c);
+    return;
+  }
+
+  // quadrant and reduced argument
+  // rounded by truncation, which compiles to a single conversion
+  long quadrant = static_cast<long>(x * 0.63661977236758134308 + (x >= 0 ? 0.5 : -0.5));
+  double q = static_cast<double>(quadrant);
+  double r = x - q * 1.5707963267341256141;
+  r = r - q * 6.0771005065061922518e-11;
+  double r2 = r * r;
+
+  double sin_r = r + r * r2 * (-1.66666666666666307295E-1 + r2 * (8.33333333332211858878E-3 +
+                 r2 * (-1.98412698295895385996E-4 + r2 * 2.75573136213857245213E-6)));
+  double cos_r = 1.0 - 0.5 * r2 + r2 * r2 * (4.16666666666665929218E-2 + r2 * (-1.38888888888730564116E-3 +
+                 r2 * (2.48015872888517045348E-5 + r2 * -2.75573141792967388112E-7)));
+
+  // quadrant modulo 4: 0 -> (s, c), 1 -> (c, -s), 2 -> (-s, -c), 3 -> (-c, s)
+  switch (quadrant & 3) {
+    case 0:  *s =  sin_r; *c =  cos_r; break;
+    case 1:  *s =  cos_r; *c = -sin_r; break;
+    case 2:  *s = -sin_r; *c = -cos_r; break;
+    default: *s = -cos_r; *c =  sin_r; break;
+  }
+}
+
+/**
+ * Sine and cosine of x in the given mode
+ */
+inline void SinCos(double x, double* s, double* c, TrigMode mode = TRIG_EXACT) {
+  if (mode == TRIG_FAST)
+    SinCosFast(x, s, c);
+  else
+    SinCosExact(x, s, c);
+}
+
+/**
+ * Wraps an angle into [-pi, pi). Unlike fmod(a, 2*pi), which keeps the sign
+ * of a and leaves it anywhere in (-2*pi, 2*pi), this is the shortest signed
+ * difference of two angles, as needed for bearing residuals.
+ */
+inline double NormalizeAngle(double a) {
+  return a - 2.0*M_PI * floor((a + M_PI) / (2.0*M_PI));
+}
+
+#endif /* TRIG_H */
@@ -1,15 +1,101 @@
 #include "ukf.h"
+#include "measurement_model.h"
+#include "stats.h"
 #include <Eigen/Dense>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 using std::vector;
 
-// Chi-square distribution parameters for NIS check
-#define CHI_SQ_3  7.8
-#define CHI_SQ_2  5.991
+namespace {
+
+///* one lidar and one radar measurement stacked into one vector
+typedef CTRV::Measurement<LaserMeasurement::kDim + RadarMeasurement::kDim> LidarRadarMeasurement;
+
+/**
+ * Rows of one measurement within a stacked unscented update of type M
+ */
+template <class Model, class M>
+struct StackedRows {
+  // transforms the sigma points into rows o.. of Zsig and copies the
+  // measurement and its noise. The angles of the sigma points are unwrapped
+  // around the angle of the mean sigma point, so their weighted mean stays
+  // valid when they straddle +-pi. A stacked update combines all sensors of
+  // the epoch, a wrong mean there would corrupt every one of them.
+  static void Stack(const UKF& ukf, const MeasurementPackage& meas, int o, typename M::SigmaMatrix* Zsig,
+                    typename M::Vector* z, typename M::CovMatrix* S) {
+    const Model h;
+    for (int i = 0; i < CTRV::kSigmaPoints; i++) {
+      typename Model::Vector z_i;
+      h(ukf.Xsig_pred_.col(i), &z_i);
+      Zsig->col(i).template segment<Model::kDim>(o) = z_i;
+    }
+    if (Model::kAngleRow >= 0) {
+      const int a = o + Model::kAngleRow;
+      for (int i = 1; i < CTRV::kSigmaPoints; i++)
+        (*Zsig)(a, i) = (*Zsig)(a, 0) + NormalizeAngle((*Zsig)(a, i) - (*Zsig)(a, 0));
+    }
+    z->template segment<Model::kDim>(o) = meas.raw_measurements_;
+    S->template block<Model::kDim, Model::kDim>(o, o) = Model::Noise(ukf);
+  }
+
+  // angle normalization of the residual
+  static void Normalize(typename M::Vector* z_diff, int o) {
+    if (Model::kAngleRow >= 0)
+      (*z_diff)(o + Model::kAngleRow) = NormalizeAngle((*z_diff)(o + Model::kAngleRow));
+  }
+
+  // the NIS uses the block of S of this measurement, so it matches the value
+  // of a single update from the same prediction
+  static double Nis(const typename M::CovMatrix& S, const typename M::Vector& z_diff, int o) {
+    typename Model::CovMatrix S_k = S.template block<Model::kDim, Model::kDim>(o, o);
+    typename Model::Vector z_k = z_diff.template segment<Model::kDim>(o);
+    return z_k.dot(S_k.ldlt().solve(z_k));
+  }
+
+  static void RecordNis(UKF* ukf, double nis) {
+    ::RecordNis<Model>(ukf, nis);
+  }
+
+  static bool PassesGate(UKF* ukf, double nis) {
+    return ::PassesGate<Model>(ukf, nis);
+  }
+};
+
+/**
+ * Functions of one sensor type in a stacked update of type M
+ */
+template <class M>
+struct StackedSensor {
+  int dim;
+  void (*stack)(const UKF& ukf, const MeasurementPackage& meas, int o, typename M::SigmaMatrix* Zsig,
+                typename M::Vector* z, typename M::CovMatrix* S);
+  void (*normalize)(typename M::Vector* z_diff, int o);
+  double (*nis)(const typename M::CovMatrix& S, const typename M::Vector& z_diff, int o);
+  void (*record_nis)(UKF* ukf, double nis);
+  bool (*passes_gate)(UKF* ukf, double nis);
+};
+
+// adds the weighted covariance of the measurement sigma point residuals Z_diff
+// to S and sets their cross correlation Tc with the state. Each is one matrix
+// product over all sigma points, evaluated coefficient wise within the fixed
+// size storage. Tc is only needed for the gain, so it is computed once the
+// measurement passed the gate.
+template <class ZMatrix, class CovMatrix>
+void UnscentedCovariance(const CTRV::WeightVector& weights, const ZMatrix& Z_diff, CovMatrix* S) {
+  ZMatrix Z_weighted = Z_diff.array().rowwise() * weights.transpose().array();
+  S->noalias() += Z_weighted.lazyProduct(Z_diff.transpose());
+}
+
+template <class ZMatrix, class GainMatrix>
+void UnscentedCrossCorrelation(const UKF::UnscentedContext& context, const ZMatrix& Z_diff, GainMatrix* Tc) {
+  Tc->noalias() = context.X_weighted.lazyProduct(Z_diff.transpose());
+}
+
+}
 
 
 UKF::UKF() {
@@ -28,8 +114,8 @@ UKF::UKF(bool verbose, bool use_laser, bool use_radar, double std_a, double std_
  */
 void UKF::Init(bool verbose, bool use_laser, bool use_radar, double std_a, double std_yawdd)
 {
-  n_x_        = 5; // we use 5 state variables: px, py, v, yaw, yawrate
-  n_aug_      = 7; // augmented state vector additionally includes std_a and std_yawdd
+  n_x_        = CTRV::kStateDim; // we use 5 state variables: px, py, v, yaw, yawrate
+  n_aug_      = CTRV::kAugStateDim; // augmented state vector additionally includes std_a and std_yawdd
 
   // if this is false, laser measurements will be ignored (except during init)
   use_laser_ = use_laser;
@@ -38,41 +124,14 @@ void UKF::Init(bool verbose, bool use_laser, bool use_radar, double std_a, doubl
   use_radar_ = use_radar;
   verbose_ = verbose;
 
-  // initial state vector
-  x_ = VectorXd(n_x_);
-
-  // initial covariance matrix
-  P_ = MatrixXd(n_x_, n_x_);
-  H_laser_ = MatrixXd(2, n_x_);
-  R_lidar_ = MatrixXd(2, 2);
-  R_radar_ = MatrixXd(3, 3);
-
-  // measurement matrix for linear kalman filter update from laser scanner data
-  H_laser_ << 1,    0,    0,    0,  0,
-              0,    1,    0,    0,  0;
-
   // Process noise standard deviation longitudinal acceleration in m/s^2
   std_a_ = std_a;
 
   // Process noise standard deviation yaw acceleration in rad/s^2
   std_yawdd_ = std_yawdd;
-  
-  //DO NOT MODIFY measurement noise values below these are provided by the sensor manufacturer.
-  // Laser measurement noise standard deviation position1 in m
-  std_laspx_ = 0.15;
-
-  // Laser measurement noise standard deviation position2 in m
-  std_laspy_ = 0.15;
-
-  // Radar measurement noise standard deviation radius in m
-  std_radr_ = 0.3;
-
-  // Radar measurement noise standard deviation angle in rad
-  std_radphi_ = 0.03;
 
-  // Radar measurement noise standard deviation radius change in m/s
-  std_radrd_ = 0.3;
-  //DO NOT MODIFY measurement noise values above these are provided by the sensor manufacturer.
+  // measurement noise values of the sensor manufacturer, shared by all filters
+  model_ = &FilterModelConfig::Default();
   
   /**
   TODO:
@@ -83,25 +142,26 @@ void UKF::Init(bool verbose, bool use_laser, bool use_radar, double std_a, doubl
   */
   timestep_ = 0;
   is_initialized_ = false;
-  lambda_     = 3-n_aug_;
+  ctrv_kernel_ = CTRV_KERNEL_AUTO;
+  ctrv_precision_ = CTRV_PRECISION_DOUBLE;
+  trig_mode_  = TRIG_EXACT;
   time_us_    = 0;
-  weights_    = VectorXd::Zero(2*n_aug_+1);
-  x_          = VectorXd::Zero(n_x_);
-  Xsig_pred_  = MatrixXd::Zero(n_x_, 2*n_aug_+1);
-  P_          = MatrixXd::Identity(n_x_, n_x_);
-  R_radar_ <<   std_radr_*std_radr_,  0,                          0,
-                0,                    std_radphi_*std_radphi_,    0,
-                0,                    0,                          std_radrd_*std_radrd_;
-  R_lidar_ <<   std_laspx_*std_laspx_,  0,
-                0,                      std_laspy_*std_laspy_;
-
-  //set weights
-  weights_(0) = lambda_ / (lambda_ + n_aug_);
-  for (int i = 1; i < 2*n_aug_+1 ; i++)
-    weights_(i) = 1 / (2*(lambda_+n_aug_));
-
+  state_us_   = 0;
+  lazy_prediction_ = false;
+  x_          = StateVector::Zero();
+  Xsig_pred_  = CTRV::SigmaMatrix::Zero();
+  unscented_.valid = false;
+  P_          = StateMatrix::Identity();
+
+  nis_laser_ = 0;
+  nis_radar_ = 0;
   nis_laser_counter_ = 0;
   nis_radar_counter_ = 0;
+  log_likelihood_ = 0;
+  nis_gate_ = NIS_GATE_OFF;
+  gated_laser_counter_ = 0;
+  gated_radar_counter_ = 0;
+  gated_run_ = 0;
 }
 
 
@@ -112,7 +172,7 @@ UKF::~UKF() {}
  * @param {MeasurementPackage} meas_package The latest measurement data of
  * either radar or laser.
  */
-void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
+void UKF::ProcessMeasurement(const MeasurementPackage& meas_package) {
   /**
   TODO:
 
@@ -129,54 +189,22 @@ void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
   timestep_++;
 
   if (!is_initialized_) {
-    if ((meas_package.sensor_type_ == MeasurementPackage::LASER) && use_laser_) {
-      /**
-      Initialize state by lidar measurement.
-      */
-      if (verbose_)
-        cout << "Initial lidar measurement received!" << endl;
-
-      double px, py, v, yaw, yawd;
-      px = meas_package.raw_measurements_[0];
-      py = meas_package.raw_measurements_[1];
-      v  = 0.0;
-      yaw = 0.0; 
-      yawd = 0.0; 
-      x_ << px, py, v, yaw, yawd;
-
-      // done initializing, no need to predict or update
-      is_initialized_ = true;
-    } 
-    if ((meas_package.sensor_type_ == MeasurementPackage::RADAR) && use_radar_) {
-      /**
-      Initialize state by radar measurement, 
-      this involves converting radar measurements from polar to cartesian coordinates.
-      */
-      if (verbose_)
-          cout << "Initial radar measurement received!" << endl;
-
-      double px, py, v, yaw, yawd;
-      double rho = meas_package.raw_measurements_[0];
-      double phi = meas_package.raw_measurements_[1];
-      double rhodot = meas_package.raw_measurements_[2];
-      px = rho * cos(phi);
-      py = rho * sin(phi);
-      v  = 0.0;
-      yaw = 0.0; 
-      yawd = 0.0; 
-      x_ << px, py, v, yaw, yawd;
-
-      // done initializing, no need to predict or update
-      is_initialized_ = true;
-    }
+    InitializeState(meas_package);
+    state_us_ = time_us_;
   }
-  else {
-      Prediction(dt);
-
-      if ((meas_package.sensor_type_ == MeasurementPackage::LASER) && use_laser_)
-        UpdateLidar(meas_package);
-      if ((meas_package.sensor_type_ == MeasurementPackage::RADAR) && use_radar_)
-        UpdateRadar(meas_package);
+  else if (UsesSensor(meas_package.sensor_type_)) {
+      //a lazy filter keeps the time pending if the measurement is rejected
+      FilterState prior;
+      if (lazy_prediction_)
+        SaveState(&prior);
+      PredictTo(time_us_);
+
+      //the update of the sensor type is looked up in the update table
+      if (!(this->*kUpdates[meas_package.sensor_type_])(meas_package) && lazy_prediction_)
+        DiscardPrediction(prior);
+  }
+  else if (!lazy_prediction_) {
+      PredictTo(time_us_);
   }
 
   if (!x_.allFinite()) {
@@ -212,89 +240,82 @@ void UKF::Prediction(double delta_t) {
   Complete this function! Estimate the object's location. Modify the state
   vector, x_. Predict sigma points, the state, and the state covariance matrix.
   */
+  STATS_TIMER(STATS_PREDICTION);
   if (verbose_)
     cout << "Prediction step" << endl;
 
     //create augmented mean vector
-  VectorXd x_aug = VectorXd(n_aug_);
+  CTRV::AugStateVector x_aug;
   //create augmented state covariance
-  MatrixXd P_aug = MatrixXd::Zero(n_aug_, n_aug_);
+  CTRV::AugStateMatrix P_aug = CTRV::AugStateMatrix::Zero();
   //create sigma point matrix
-  MatrixXd Xsig_aug = MatrixXd(n_aug_, 2*n_aug_+1);
-  // Vector / Matrix output format
-  Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
+  CTRV::AugSigmaMatrix Xsig_aug;
 
   //create augmented mean state
   x_aug << x_, 0, 0;
 
   //create augmented covariance matrix
-  P_aug.topLeftCorner(5,5) = P_;
+  P_aug.topLeftCorner<CTRV::kStateDim, CTRV::kStateDim>() = P_;
   P_aug(5,5) = std_a_*std_a_;
   P_aug(6,6) = std_yawdd_*std_yawdd_;
 
   //create square root matrix
-  MatrixXd L = P_aug.llt().matrixL();
+  CTRV::AugStateMatrix L = P_aug.llt().matrixL();
 
   //create augmented sigma points
   Xsig_aug.col(0)  = x_aug;
   for (int i = 0; i< n_aug_; i++) {
-    Xsig_aug.col(i+1)        = x_aug + sqrt(lambda_+n_aug_) * L.col(i);
-    Xsig_aug.col(i+1+n_aug_) = x_aug - sqrt(lambda_+n_aug_) * L.col(i);
+    Xsig_aug.col(i+1)        = x_aug + sqrt(model_->lambda+n_aug_) * L.col(i);
+    Xsig_aug.col(i+1+n_aug_) = x_aug - sqrt(model_->lambda+n_aug_) * L.col(i);
   }
   
 
-  //predict sigma points
-  for (int i = 0; i< 2*n_aug_+1; i++) {
-    //extract values for better readability
-    double p_x = Xsig_aug(0,i);
-    double p_y = Xsig_aug(1,i);
-    double v = Xsig_aug(2,i);
-    double yaw = Xsig_aug(3,i);
-    double yawd = Xsig_aug(4,i);
-    double nu_a = Xsig_aug(5,i);
-    double nu_yawdd = Xsig_aug(6,i);
-
-    //predicted state values
-    double px_p, py_p, v_p, yaw_p, yawd_p;
-
-    //avoid division by zero
-    if (fabs(yawd) > std::numeric_limits<double>::epsilon()) {
-        px_p = p_x + v/yawd * ( sin (yaw + yawd*delta_t) - sin(yaw));
-        py_p = p_y + v/yawd * ( cos(yaw) - cos(yaw+yawd*delta_t) );
-    } else {
-        px_p = p_x + v*delta_t*cos(yaw);
-        py_p = p_y + v*delta_t*sin(yaw);
-    }
-
-    // add noise
-    px_p += 0.5*nu_a*delta_t*delta_t * cos(yaw);
-    py_p += 0.5*nu_a*delta_t*delta_t * sin(yaw);
-    // prediction and adding noise
-    v_p     = v + nu_a*delta_t;
-    yaw_p   = yaw + yawd*delta_t + 0.5*nu_yawdd*delta_t*delta_t;
-    yawd_p  = yawd + nu_yawdd*delta_t;
-
-    //write predicted sigma point into right column
-    Xsig_pred_.col(i) << px_p, py_p, v_p, yaw_p, yawd_p;
+  //predict sigma points, the sigma point matrices are row major so each row
+  //is passed to the CTRV kernel as one component array
+  if (ctrv_precision_ == CTRV_PRECISION_FLOAT) {
+    //only the propagation runs in float, the mean and covariance below are
+    //accumulated in double
+    CTRV::AugSigmaMatrixF Xsig_aug_f = Xsig_aug.cast<float>();
+    CTRV::SigmaMatrixF Xsig_pred_f;
+    float dt[CTRV::kSigmaPoints];
+    std::fill(dt, dt + CTRV::kSigmaPoints, static_cast<float>(delta_t));
+    CtrvSigmaPointsF points;
+    for (int k = 0; k < n_aug_; k++)
+      points.aug[k] = Xsig_aug_f.row(k).data();
+    for (int k = 0; k < n_x_; k++)
+      points.pred[k] = Xsig_pred_f.row(k).data();
+    points.delta_t = dt;
+    points.n = CTRV::kSigmaPoints;
+    points.fast_trig = false;
+    CtrvPredict(points, ctrv_kernel_);
+    Xsig_pred_ = Xsig_pred_f.cast<double>();
+  } else {
+    double dt[CTRV::kSigmaPoints];
+    std::fill(dt, dt + CTRV::kSigmaPoints, delta_t);
+    CtrvSigmaPoints points;
+    for (int k = 0; k < n_aug_; k++)
+      points.aug[k] = Xsig_aug.row(k).data();
+    for (int k = 0; k < n_x_; k++)
+      points.pred[k] = Xsig_pred_.row(k).data();
+    points.delta_t = dt;
+    points.n = CTRV::kSigmaPoints;
+    points.fast_trig = (trig_mode_ == TRIG_FAST);
+    CtrvPredict(points, ctrv_kernel_);
   }
 
 
   //predicted state mean
-  x_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++)  //iterate over sigma points
-    x_ += weights_(i) * Xsig_pred_.col(i);
+  x_.noalias() = Xsig_pred_ * model_->weights;
 
-  //predicted state covariance matrix
-  P_.fill(0.0);
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //iterate over sigma points
-    // state difference
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    //angle normalization
-    x_diff(3) = fmod(x_diff(3), 2.0*M_PI);
-    P_ += weights_(i) * x_diff * x_diff.transpose() ;
-  }
+  //predicted state covariance matrix P = X_diff * W * X_diff^T, the weighted
+  //deviations are kept for the updates
+  unscented_.valid = false;
+  const UnscentedContext& context = SigmaPointDeviations();
+  P_.noalias() = context.X_weighted.lazyProduct(context.X_diff.transpose());
 
   if (verbose_) {
+    // Vector / Matrix output format
+    Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
     cout << "Xsig_pred_: " << endl << Xsig_pred_.format(CleanFmt) << endl;
     cout << "x_: " << endl << x_.format(CleanFmt) << endl;
     cout << "P_: " << endl << P_.format(CleanFmt) << endl;
@@ -303,220 +324,278 @@ void UKF::Prediction(double delta_t) {
 
 
 /**
- * Updates the state and the state covariance matrix using a laser measurement.
- * This function just uses the simple linear Kalman filter equations becasuse
- * the measurement equations are linear (we measure the position states directly).
- * @param {MeasurementPackage} meas_package
+ * Computes the deviations of the predicted sigma points from the current state
+ * if they are not cached yet. They are exact for every update which follows
+ * the prediction directly, a later update uses the moved state like before.
  */
-void UKF::UpdateLidar(MeasurementPackage meas_package) {
-  /**
-  TODO:
-
-  Complete this function! Use lidar data to update the belief about the object's
-  position. Modify the state vector, x_, and covariance, P_.
+const UKF::UnscentedContext& UKF::SigmaPointDeviations() {
+  if (!unscented_.valid) {
+    // state difference
+    unscented_.X_diff = Xsig_pred_.colwise() - x_;
+    //angle normalization
+    for (int i = 0; i < CTRV::kSigmaPoints; i++)
+      unscented_.X_diff(3, i) = fmod(unscented_.X_diff(3, i), 2.0*M_PI);
+    unscented_.X_weighted = unscented_.X_diff.array().rowwise() * model_->weights.transpose().array();
+    unscented_.valid = true;
+  }
+  return unscented_;
+}
 
-  You'll also need to calculate the lidar NIS.
-  */
-  if (verbose_)
-    cout << "UpdateLidar step" << endl;
 
-  VectorXd y = meas_package.raw_measurements_ - H_laser_ * x_;
-  MatrixXd Ht = H_laser_.transpose();
-  MatrixXd S = H_laser_ * P_ * Ht + R_lidar_;
-  MatrixXd Si = S.inverse();
-  MatrixXd PHt = P_ * Ht;
-  MatrixXd K = PHt * Si;
-  MatrixXd I = MatrixXd::Identity(n_x_, n_x_);
+void UKF::RestoreState(const FilterState& state) {
+  Filter::RestoreState(state);
+  unscented_.valid = false;
+}
 
-  //new estimate
-  x_ = x_ + (K * y);
-  P_ = (I - K * H_laser_) * P_;
 
-  nis_laser_ = y.transpose() * S.inverse() * y;
-  if (nis_laser_ > CHI_SQ_2)
-    nis_laser_counter_++;
+/**
+ * Updates the state with the Kalman filter equations linearized around the
+ * predicted state, which are exact for a linear model
+ * @param {MeasurementPackage} meas_package
+ */
+template <class Model>
+bool UKF::UpdateLinearized(const MeasurementPackage& meas_package) {
+  if (verbose_)
+    cout << "Update " << Model::Name() << " step" << endl;
 
-  if (verbose_) {
-    cout << "NIS(laser): ";
-    cout << 100.0 * nis_laser_counter_ / timestep_ << "% (" << nis_laser_counter_ << " samples out of " << timestep_ << ") are out of 95% NIS range!" << endl;
-  }
+  if (!LinearizedUpdate(this, Model(), meas_package))
+    return false;
+  unscented_.valid = false;
+  return true;
 }
 
 
 /**
- * Updates the state and the state covariance matrix using a laser measurement
- * by applying the unscented transform instead of the linear kalman filter equations.
+ * Updates the state and the state covariance matrix with the unscented
+ * transform of the predicted sigma points through the measurement model.
  * @param {MeasurementPackage} meas_package
  */
-void UKF::UpdateLidarUnscented(MeasurementPackage meas_package) {
-  /**
-  TODO:
-
-  Complete this function! Use lidar data to update the belief about the object's
-  position. Modify the state vector, x_, and covariance, P_.
-
-  You'll also need to calculate the lidar NIS.
-  */
+template <class Model>
+bool UKF::UpdateUnscented(const MeasurementPackage& meas_package) {
+  STATS_TIMER(STATS_UPDATE_LASER + Model::kSensor);
   if (verbose_)
-    cout << "UpdateLidar step" << endl;
+    cout << "Update " << Model::Name() << " step" << endl;
 
- // Vector / Matrix output format
-  Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
-  int n_z = 2; // measurement dimension
-  double p_x, p_y;
+  typedef typename Model::Types M;
+  const Model h;
   //create matrix for sigma points in measurement space
-  MatrixXd Zsig = MatrixXd(n_z, 2*n_aug_+1);
-  //mean predicted measurement
-  VectorXd z_pred = VectorXd::Zero(n_z);
+  typename M::SigmaMatrix Zsig;
   //measurement covariance matrix S
-  MatrixXd S = MatrixXd::Zero(n_z, n_z);
+  typename M::CovMatrix S;
   //create matrix for cross correlation Tc
-  MatrixXd Tc = MatrixXd::Zero(n_x_, n_z);
-  // measurement noise covariance matrix
-  MatrixXd R = MatrixXd(n_z, n_z);
+  typename M::GainMatrix Tc;
 
   //transform sigma points into measurement space
   for (int i = 0; i < 2*n_aug_+1; i++) {  //2n+1 simga points
-    // measurement model
-    Zsig.col(i) << Xsig_pred_(0,i), Xsig_pred_(1,i);  // px, py
+    typename M::Vector z;
+    h(Xsig_pred_.col(i), &z);
+    Zsig.col(i) = z;
+  }
+  //unwrap the angles around the mean sigma point like the stacked update,
+  //otherwise their weighted mean is wrong when they straddle +-pi
+  if (Model::kAngleRow >= 0) {
+    const int a = Model::kAngleRow;
+    for (int i = 1; i < 2*n_aug_+1; i++)
+      Zsig(a, i) = Zsig(a, 0) + NormalizeAngle(Zsig(a, i) - Zsig(a, 0));
   }
 
   //mean predicted measurement
-  z_pred = Zsig * weights_;
+  typename M::Vector z_pred = Zsig * model_->weights;
   // measurement residual
-  MatrixXd Z_diff = Zsig.colwise() - z_pred;
-  // state difference
-  MatrixXd X_diff = Xsig_pred_.colwise() - x_;
+  typename M::SigmaMatrix Z_diff = Zsig.colwise() - z_pred;
 
   // innovation covariance matrix S
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
-    //angle normalization
-    Z_diff(1, i) = fmod(Z_diff(1,i), 2.0*M_PI);
-    S += weights_(i) * Z_diff.col(i) * Z_diff.col(i).transpose();
-  }
-  // add measurement noise
-  S += R_lidar_;
-
-  // calculate cross correlation matrix
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
-    //angle normalization
-    X_diff(3, i) = fmod(X_diff(3, i), 2.0*M_PI);
-    Tc += weights_(i) * X_diff.col(i) * Z_diff.col(i).transpose();
-  }
-
-  //Kalman gain K;
-  MatrixXd K = Tc * S.inverse();
+  S = Model::Noise(*this);
+  UnscentedCovariance(model_->weights, Z_diff, &S);
 
   //residual
-  VectorXd z_diff = meas_package.raw_measurements_ - z_pred;
+  typename M::Vector z_diff = meas_package.raw_measurements_ - z_pred;
 
   //angle normalization
-  z_diff(1) = fmod(z_diff(1), 2.0*M_PI);
-  
+  if (Model::kAngleRow >= 0)
+    z_diff(Model::kAngleRow) = NormalizeAngle(z_diff(Model::kAngleRow));
+
+  //the NIS is solved with the factorization of S which is reused for the
+  //gain, a measurement outside the gate returns before Tc and K are formed
+  Eigen::LDLT<typename M::CovMatrix> S_ldlt(S);
+  const double nis = z_diff.dot(S_ldlt.solve(z_diff));
+  if (!PassesGate<Model>(this, nis))
+    return false;
+
+  //cross correlation matrix Tc and Kalman gain K = Tc * S^-1
+  UnscentedCrossCorrelation(SigmaPointDeviations(), Z_diff, &Tc);
+  typename M::GainMatrix K = S_ldlt.solve(Tc.transpose()).transpose();
+
   //update state mean and covariance matrix
   x_  += K * z_diff;
   P_  -= K * S * K.transpose();
+  unscented_.valid = false;
 
-  nis_laser_ = z_diff.transpose() * S.inverse() * z_diff;
-  if (nis_laser_ > CHI_SQ_2)
-    nis_laser_counter_++;
+  log_likelihood_ = LogLikelihood(S_ldlt, nis);
+  RecordNis<Model>(this, nis);
+  return true;
+}
 
-  if (verbose_) {
-    cout << "NIS(laser): ";
-    cout << 100.0 * nis_laser_counter_ / timestep_ << "% (" << nis_laser_counter_ << " samples out of " << timestep_ << ") are out of 95% NIS range!" << endl;
-  }
+
+// update of every sensor type: lidar is linear, so the plain Kalman filter
+// equations are used, radar uses the unscented transform
+const UKF::UpdateFunction UKF::kUpdates[MeasurementPackage::SENSOR_TYPES] = {
+  &UKF::UpdateLinearized<LidarModel>,
+  &UKF::UpdateUnscented<RadarModel>
+};
+
+
+bool UKF::Update(const MeasurementPackage& meas_package) {
+  if (!UsesSensor(meas_package.sensor_type_))
+    return false;
+  return (this->*kUpdates[meas_package.sensor_type_])(meas_package);
+}
+
+
+void UKF::UpdateLidar(const MeasurementPackage& meas_package) {
+  UpdateLinearized<LidarModel>(meas_package);
+}
+
+
+void UKF::UpdateLidarUnscented(const MeasurementPackage& meas_package) {
+  UpdateUnscented<LidarModel>(meas_package);
+}
+
+
+void UKF::UpdateRadar(const MeasurementPackage& meas_package) {
+  UpdateUnscented<RadarModel>(meas_package);
 }
 
 
 /**
- * Updates the state and the state covariance matrix using a radar measurement.
- * @param {MeasurementPackage} meas_package
+ * Updates the state with all measurements of one epoch. Measurements of
+ * disabled sensors are skipped. More measurements than fit into one stacked
+ * update are applied in chunks, each after a zero length prediction which
+ * draws new sigma points from the updated covariance.
+ * @param batch Measurements of the epoch
+ * @param n Number of measurements
  */
-void UKF::UpdateRadar(MeasurementPackage meas_package) {
-  /**
-  TODO:
+bool UKF::UpdateEpoch(const MeasurementPackage* batch, int n) {
+  const MeasurementPackage* used[kMaxEpochMeasurements];
+  bool predicted = true;
+  bool applied = false;
+  int i = 0;
+  while (i < n) {
+    int n_used = 0;
+    for (; i < n && n_used < kMaxEpochMeasurements; i++)
+      if (UsesSensor(batch[i].sensor_type_))
+        used[n_used++] = &batch[i];
+    if (n_used == 0)
+      break;
+    if (!predicted)
+      Prediction(0);
+    predicted = false;
+
+    // the common lidar and radar pair uses fixed size matrices
+    if (n_used == 2 && used[0]->sensor_type_ != used[1]->sensor_type_)
+      applied |= UpdateStacked<LidarRadarMeasurement>(used, n_used);
+    else if (n_used > 1)
+      applied |= UpdateStacked<EpochMeasurement>(used, n_used);
+    else
+      applied |= (this->*kUpdates[used[0]->sensor_type_])(*used[0]);
+  }
+  return applied;
+}
 
-  Complete this function! Use radar data to update the belief about the object's
-  position. Modify the state vector, x_, and covariance, P_.
 
-  You'll also need to calculate the radar NIS.
-  */
+/**
+ * Stacked unscented update. The measurement models of all sensors are applied
+ * to the same predicted sigma points and their rows are stacked, the sensor
+ * noise is block diagonal. For the lidar rows the unscented transform gives
+ * exactly the linear Kalman filter terms, because the predicted covariance is
+ * computed from the same sigma points.
+ * @param meas Measurements to apply, at most kMaxEpochMeasurements
+ * @param n Number of measurements
+ * @param gated True if the measurements already passed the NIS gate
+ * M holds the stacked measurement types, either of fixed size for a known
+ * combination of sensors or EpochMeasurement for any combination.
+ */
+template <class M>
+bool UKF::UpdateStacked(const MeasurementPackage* const* meas, int n, bool gated) {
+  STATS_TIMER(STATS_UPDATE_EPOCH);
   if (verbose_)
-    cout << "UpdateRadar step" << endl;
+    cout << "UpdateStacked step with " << n << " measurements" << endl;
+
+  // rows of every sensor type, indexed by sensor type
+  static const StackedSensor<M> sensors[MeasurementPackage::SENSOR_TYPES] = {
+    {LidarModel::kDim, &StackedRows<LidarModel, M>::Stack, &StackedRows<LidarModel, M>::Normalize,
+     &StackedRows<LidarModel, M>::Nis, &StackedRows<LidarModel, M>::RecordNis,
+     &StackedRows<LidarModel, M>::PassesGate},
+    {RadarModel::kDim, &StackedRows<RadarModel, M>::Stack, &StackedRows<RadarModel, M>::Normalize,
+     &StackedRows<RadarModel, M>::Nis, &StackedRows<RadarModel, M>::RecordNis,
+     &StackedRows<RadarModel, M>::PassesGate}
+  };
+
+  //row offset of every measurement in the stacked vector
+  int offset[kMaxEpochMeasurements + 1];
+  offset[0] = 0;
+  for (int k = 0; k < n; k++)
+    offset[k+1] = offset[k] + sensors[meas[k]->sensor_type_].dim;
+  const int n_z = offset[n];
 
-  // Vector / Matrix output format
-  Eigen::IOFormat CleanFmt(cout.precision(3), 0, ", ", "\n", "  [", "]");
-  int n_z = 3; // measurement dimension
-  double p_x, p_y, v, yaw;
   //create matrix for sigma points in measurement space
-  MatrixXd Zsig = MatrixXd(n_z, 2*n_aug_+1);
-  //mean predicted measurement
-  VectorXd z_pred = VectorXd::Zero(n_z);
-  //measurement covariance matrix S
-  MatrixXd S = MatrixXd::Zero(n_z, n_z);
+  typename M::SigmaMatrix Zsig(n_z, CTRV::kSigmaPoints);
+  //stacked measurement and block diagonal measurement noise
+  typename M::Vector z(n_z);
+  typename M::CovMatrix S = M::CovMatrix::Zero(n_z, n_z);
   //create matrix for cross correlation Tc
-  MatrixXd Tc = MatrixXd::Zero(n_x_, n_z);
-  // measurement noise covariance matrix
-  MatrixXd R = MatrixXd(n_z, n_z);
+  typename M::GainMatrix Tc(n_x_, n_z);
 
   //transform sigma points into measurement space
-  for (int i = 0; i < 2*n_aug_+1; i++) {  //2n+1 simga points
-    // extract values for better readibility
-    p_x = Xsig_pred_(0,i);
-    p_y = Xsig_pred_(1,i);
-    v   = Xsig_pred_(2,i);
-    yaw = Xsig_pred_(3,i);
-
-    // measurement model
-    Zsig(0,i) = sqrt(p_x*p_x + p_y*p_y);              //r
-    Zsig(1,i) = atan2(p_y,p_x);                       //phi
-    Zsig(2,i) = (p_x*cos(yaw)*v + p_y*sin(yaw)*v) / Zsig(0,i);       //r_dot
-  }
+  for (int k = 0; k < n; k++)
+    sensors[meas[k]->sensor_type_].stack(*this, *meas[k], offset[k], &Zsig, &z, &S);
 
   //mean predicted measurement
-  z_pred = Zsig * weights_;
+  typename M::Vector z_pred = Zsig * model_->weights;
   // measurement residual
-  MatrixXd Z_diff = Zsig.colwise() - z_pred;
-  // state difference
-  MatrixXd X_diff = Xsig_pred_.colwise() - x_;
+  typename M::SigmaMatrix Z_diff = Zsig.colwise() - z_pred;
+  //residual
+  typename M::Vector z_diff = z - z_pred;
+  for (int k = 0; k < n; k++)
+    sensors[meas[k]->sensor_type_].normalize(&z_diff, offset[k]);
 
   // innovation covariance matrix S
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
-    //angle normalization
-    Z_diff(1, i) = fmod(Z_diff(1,i), 2.0*M_PI);
-    S += weights_(i) * Z_diff.col(i) * Z_diff.col(i).transpose();
-  }
-  // add measurement noise
-  S += R_radar_;
-
-  // calculate cross correlation matrix
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {  //2n+1 simga points
-    //angle normalization
-    X_diff(3, i) = fmod(X_diff(3, i), 2.0*M_PI);
-    Tc += weights_(i) * X_diff.col(i) * Z_diff.col(i).transpose();
+  UnscentedCovariance(model_->weights, Z_diff, &S);
+
+  //NIS of every measurement. With the gate on, the measurements outside of it
+  //are dropped before Tc and K are formed and the others are stacked again
+  //from the same prediction. The gate keeps state across measurements, so
+  //the accepted ones are stacked as already gated instead of passing it twice.
+  double nis[kMaxEpochMeasurements];
+  for (int k = 0; k < n; k++)
+    nis[k] = sensors[meas[k]->sensor_type_].nis(S, z_diff, offset[k]);
+  if (nis_gate_ != NIS_GATE_OFF && !gated) {
+    const MeasurementPackage* accepted[kMaxEpochMeasurements];
+    int n_accepted = 0;
+    for (int k = 0; k < n; k++)
+      if (sensors[meas[k]->sensor_type_].passes_gate(this, nis[k]))
+        accepted[n_accepted++] = meas[k];
+    if (n_accepted == 0)
+      return false;
+    if (n_accepted < n)
+      return UpdateStacked<EpochMeasurement>(accepted, n_accepted, true);
   }
 
-  //Kalman gain K;
-  MatrixXd K = Tc * S.inverse();
+  //cross correlation matrix Tc and Kalman gain K = Tc * S^-1
+  UnscentedCrossCorrelation(SigmaPointDeviations(), Z_diff, &Tc);
+  Eigen::LDLT<typename M::CovMatrix> S_ldlt(S);
+  typename M::GainMatrix K = S_ldlt.solve(Tc.transpose()).transpose();
 
-  //residual
-  VectorXd z_diff = meas_package.raw_measurements_ - z_pred;
-
-  //angle normalization
-  z_diff(1) = fmod(z_diff(1), 2.0*M_PI);
-  
   //update state mean and covariance matrix
-  x_  += K * z_diff;
-  P_  -= K * S * K.transpose();
-
-  nis_radar_ = z_diff.transpose() * S.inverse() * z_diff;
-  if (nis_radar_ > CHI_SQ_3)
-    nis_radar_counter_++;
-
-  if (verbose_) {
-    cout << "NIS(radar): ";
-    cout << 100.0 * nis_radar_counter_ / timestep_ << "% (" << nis_radar_counter_ << " samples out of " << timestep_ << ") are out of 95% NIS range!" << endl;
-  }
+  x_.noalias() += K * z_diff;
+  P_.noalias() -= K * S * K.transpose();
+  unscented_.valid = false;
+
+  //the NIS of the whole stacked innovation reuses the factorization
+  log_likelihood_ = LogLikelihood(S_ldlt, z_diff.dot(S_ldlt.solve(z_diff)));
+  for (int k = 0; k < n; k++)
+    sensors[meas[k]->sensor_type_].record_nis(this, nis[k]);
+  return true;
 }
 
 void UKF::write_vec(const vector<double>& vec) {
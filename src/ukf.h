@@ -3,6 +3,7 @@
 
 #include "measurement_package.h"
 #include "filter.h"
+#include "ctrv_kernel.h"
 #include <Eigen/Dense>
 #include <vector>
 #include <string>
@@ -16,13 +17,24 @@ class UKF: public Filter {
 public:
 
   ///* predicted sigma points matrix
-  MatrixXd Xsig_pred_;
+  CTRV::SigmaMatrix Xsig_pred_;
 
-  ///* Weights of sigma points
-  VectorXd weights_;
+  /**
+   * Deviations of the predicted sigma points from the predicted state, built
+   * once by Prediction and shared by all unscented updates which follow it
+   */
+  struct UnscentedContext {
+    CTRV::SigmaMatrix X_diff;      // Xsig_pred_ - x_, yaw normalized
+    CTRV::SigmaMatrix X_weighted;  // X_diff with every column scaled by its weight
+    bool valid;                    // false once x_ is not the mean of Xsig_pred_ anymore
+  };
+  UnscentedContext unscented_;
+
+  ///* Kernel used for the sigma point prediction
+  CtrvKernel ctrv_kernel_;
 
-  ///* Sigma point spreading parameter
-  double lambda_;
+  ///* Precision of the sigma point prediction
+  CtrvPrecision ctrv_precision_;
 
  
   /**
@@ -45,7 +57,7 @@ public:
    * ProcessMeasurement
    * @param meas_package The latest measurement data of either radar or laser
    */
-  void ProcessMeasurement(MeasurementPackage meas_package);
+  void ProcessMeasurement(const MeasurementPackage& meas_package);
 
   /**
    * Prediction Predicts sigma points, the state, and the state covariance
@@ -54,28 +66,80 @@ public:
    */
   void Prediction(double delta_t);
 
+  /**
+   * Updates the state with a measurement of any sensor type by the update
+   * table
+   * @return false if the measurement was not applied
+   */
+  bool Update(const MeasurementPackage& meas_package);
+
+  /**
+   * Updates of one sensor type, instantiated per measurement model: the
+   * Kalman filter equations linearized around the state and the unscented
+   * transform of the predicted sigma points
+   */
+  template <class Model> bool UpdateLinearized(const MeasurementPackage& meas_package);
+  template <class Model> bool UpdateUnscented(const MeasurementPackage& meas_package);
+
   /**
    * Updates the state and the state covariance matrix using a laser measurement.
    * This function just uses the simple linear Kalman filter equations becasuse
    * the measurement equations are linear (we measure the position states directly).
    * @param {MeasurementPackage} meas_package
    */
-  void UpdateLidar(MeasurementPackage meas_package);
+  void UpdateLidar(const MeasurementPackage& meas_package);
 
   /**
    * Updates the state and the state covariance matrix using a laser measurement
    * by applying the unscented transform instead of the linear kalman filter equations.
    * @param {MeasurementPackage} meas_package
    */
-  void UpdateLidarUnscented(MeasurementPackage meas_package);
+  void UpdateLidarUnscented(const MeasurementPackage& meas_package);
   /**
    * Updates the state and the state covariance matrix using a radar measurement
    * @param meas_package The measurement at k+1
    */
-  void UpdateRadar(MeasurementPackage meas_package);
+  void UpdateRadar(const MeasurementPackage& meas_package);
+
+  /**
+   * Updates the state with all measurements of an epoch in one unscented
+   * update. The sigma points of all sensors are stacked into one measurement
+   * vector, so the predicted sigma points are used once for every sensor.
+   * @param batch Measurements of the epoch
+   * @param n Number of measurements
+   * @return true if any measurement was applied
+   */
+  bool UpdateEpoch(const MeasurementPackage* batch, int n);
+
+  /**
+   * Restores a saved state, the cached sigma point deviations do not belong
+   * to it anymore
+   */
+  void RestoreState(const FilterState& state);
 
+  /**
+   * Returns the sigma point deviations of the last prediction. They are
+   * computed again from the current state if an update changed it since.
+   */
+  const UnscentedContext& SigmaPointDeviations();
+
+  /**
+   * Stacked unscented update with up to kMaxEpochMeasurements measurements,
+   * M provides the matrix types of the stacked measurement. Measurements
+   * which fail the NIS gate are dropped before the gain is formed, the others
+   * are stacked again with gated set, so the gate decides on each only once.
+   * @return true if any measurement was applied
+   */
+  template <class M>
+  bool UpdateStacked(const MeasurementPackage* const* meas, int n, bool gated = false);
 
   void write_vec(const vector<double>& vec);
+
+private:
+  typedef bool (UKF::*UpdateFunction)(const MeasurementPackage& meas_package);
+
+  ///* update of every sensor type, indexed by MeasurementPackage::SensorType
+  static const UpdateFunction kUpdates[MeasurementPackage::SENSOR_TYPES];
 };
 
 #endif /* UKF_H */
@@ -0,0 +1,341 @@
+#include "ukf_bank.h"
+#include "trig.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+const int n_x   = CTRV::kStateDim;
+const int n_aug = CTRV::kAugStateDim;
+const int n_sig = CTRV::kSigmaPoints;
+const int n_z   = RadarMeasurement::kDim;
+}
+
+
+UKFBank::UKFBank(double std_a, double std_yawdd)
+  : std_a_(std_a),
+    std_yawdd_(std_yawdd),
+    model_(&FilterModelConfig::Default()),
+    ctrv_kernel_(CTRV_KERNEL_AUTO),
+    ctrv_precision_(CTRV_PRECISION_DOUBLE),
+    trig_mode_(TRIG_EXACT),
+    n_tracks_(0) {
+  x_.resize(n_x, 0);
+  P_.resize(n_x*n_x, 0);
+}
+
+
+int UKFBank::AddTrack(const StateVector& x, const StateMatrix& P) {
+  // grow the storage geometrically so adding tracks is amortized O(1)
+  if (n_tracks_ == x_.cols()) {
+    int capacity = max<int>(16, 2 * x_.cols());
+    x_.conservativeResize(Eigen::NoChange, capacity);
+    P_.conservativeResize(Eigen::NoChange, capacity);
+  }
+  x_.col(n_tracks_) = x;
+  SetCovariance(n_tracks_, P);
+  S_lidar_ldlt_.resize(n_tracks_ + 1);
+  FactorLidarCovariance(n_tracks_);
+  return n_tracks_++;
+}
+
+
+void UKFBank::RemoveTrack(int track) {
+  int last = n_tracks_ - 1;
+  if (track != last) {
+    x_.col(track) = x_.col(last);
+    P_.col(track) = P_.col(last);
+    S_lidar_ldlt_[track] = S_lidar_ldlt_[last];
+  }
+  n_tracks_--;
+  S_lidar_ldlt_.resize(n_tracks_);
+}
+
+
+StateVector UKFBank::State(int track) const {
+  return x_.col(track);
+}
+
+
+StateMatrix UKFBank::Covariance(int track) const {
+  StateMatrix P;
+  for (int r = 0; r < n_x; r++)
+    for (int c = 0; c < n_x; c++)
+      P(r, c) = P_(r*n_x + c, track);
+  return P;
+}
+
+
+void UKFBank::SetCovariance(int track, const StateMatrix& P) {
+  for (int r = 0; r < n_x; r++)
+    for (int c = 0; c < n_x; c++)
+      P_(r*n_x + c, track) = P(r, c);
+}
+
+
+void UKFBank::Prediction(double delta_t) {
+  // the workspace is reused, so only the first call for a bank size allocates
+  dt_.resize(n_tracks_);
+  dt_.setConstant(delta_t);
+  Prediction(dt_.data());
+}
+
+
+void UKFBank::Prediction(const double* delta_t) {
+  const int n = n_tracks_;
+  Xsig_aug_.resize(n_aug, n_sig*n);
+  Xsig_pred_.resize(n_x, n_sig*n);
+  X_diff_.resize(n_x, n_sig*n);
+
+  //create augmented sigma points track by track, the cholesky decomposition
+  //is the only part of the prediction that is not done in one pass
+  const double scale = sqrt(model_->lambda + n_aug);
+  for (int t = 0; t < n; t++) {
+    CTRV::AugStateMatrix P_aug = CTRV::AugStateMatrix::Zero();
+    P_aug.topLeftCorner<n_x, n_x>() = Covariance(t);
+    P_aug(5,5) = std_a_*std_a_;
+    P_aug(6,6) = std_yawdd_*std_yawdd_;
+    CTRV::AugStateMatrix L = P_aug.llt().matrixL();
+
+    for (int r = 0; r < n_aug; r++) {
+      double x_aug = (r < n_x) ? x_(r, t) : 0.0;
+      Xsig_aug_(r, t) = x_aug;
+      for (int i = 0; i < n_aug; i++) {
+        Xsig_aug_(r, (i+1)*n + t)       = x_aug + scale * L(r, i);
+        Xsig_aug_(r, (i+1+n_aug)*n + t) = x_aug - scale * L(r, i);
+      }
+    }
+  }
+
+  //predict the sigma points of all tracks, one kernel call per sigma point
+  //index covers that sigma point of every track
+  const int cols = n_sig*n;
+  if (ctrv_precision_ == CTRV_PRECISION_FLOAT) {
+    //only the propagation runs in float, the mean and covariance are
+    //accumulated in double
+    Xsig_aug_f_ = Xsig_aug_.cast<float>();
+    Xsig_pred_f_.resize(n_x, cols);
+    dt_f_ = Eigen::Map<const Eigen::VectorXd>(delta_t, n).cast<float>();
+    for (int s = 0; s < n_sig; s++) {
+      CtrvSigmaPointsF points;
+      for (int k = 0; k < n_aug; k++)
+        points.aug[k] = Xsig_aug_f_.data() + k*cols + s*n;
+      for (int k = 0; k < n_x; k++)
+        points.pred[k] = Xsig_pred_f_.data() + k*cols + s*n;
+      points.delta_t = dt_f_.data();
+      points.n = n;
+      points.fast_trig = false;
+      CtrvPredict(points, ctrv_kernel_);
+    }
+    Xsig_pred_ = Xsig_pred_f_.cast<double>();
+  } else {
+    for (int s = 0; s < n_sig; s++) {
+      CtrvSigmaPoints points;
+      for (int k = 0; k < n_aug; k++)
+        points.aug[k] = Xsig_aug_.data() + k*cols + s*n;
+      for (int k = 0; k < n_x; k++)
+        points.pred[k] = Xsig_pred_.data() + k*cols + s*n;
+      points.delta_t = delta_t;
+      points.n = n;
+      points.fast_trig = (trig_mode_ == TRIG_FAST);
+      CtrvPredict(points, ctrv_kernel_);
+    }
+  }
+
+  ComputeMeanAndCovariance();
+}
+
+
+void UKFBank::ComputeMeanAndCovariance() {
+  const int n = n_tracks_;
+
+  //predicted state mean
+  for (int r = 0; r < n_x; r++) {
+    x_.row(r).head(n).setZero();
+    for (int s = 0; s < n_sig; s++)
+      x_.row(r).head(n) += model_->weights(s) * Xsig_pred_.row(r).segment(s*n, n);
+  }
+
+  //state difference
+  for (int r = 0; r < n_x; r++)
+    for (int s = 0; s < n_sig; s++)
+      X_diff_.row(r).segment(s*n, n) = Xsig_pred_.row(r).segment(s*n, n) - x_.row(r).head(n);
+
+  //angle normalization
+  double* yaw_diff = X_diff_.data() + 3*X_diff_.cols();
+  for (int i = 0; i < X_diff_.cols(); i++)
+    yaw_diff[i] = fmod(yaw_diff[i], 2.0*M_PI);
+
+  //predicted state covariance matrix, only the upper triangle is accumulated
+  for (int r = 0; r < n_x; r++) {
+    for (int c = r; c < n_x; c++) {
+      auto P_rc = P_.row(r*n_x + c).head(n);
+      P_rc.setZero();
+      for (int s = 0; s < n_sig; s++)
+        P_rc.array() += model_->weights(s) * X_diff_.row(r).segment(s*n, n).array()
+                                    * X_diff_.row(c).segment(s*n, n).array();
+      if (c != r)
+        P_.row(c*n_x + r).head(n) = P_rc;
+    }
+  }
+
+  //the lidar S of every track is factorized once for the NIS and the gain
+  for (int t = 0; t < n; t++)
+    FactorLidarCovariance(t);
+}
+
+
+void UKFBank::FactorLidarCovariance(int track) {
+  // H_laser selects px and py, S is the top left block of P plus the noise
+  LaserMeasurement::CovMatrix S;
+  for (int r = 0; r < 2; r++)
+    for (int c = 0; c < 2; c++)
+      S(r, c) = P_(r*n_x + c, track) + model_->R_lidar(r, c);
+  S_lidar_ldlt_[track].compute(S);
+}
+
+
+void UKFBank::PredictRadarMeasurement() {
+  const int n = n_tracks_;
+  const int cols = n_sig*n;
+  Z_diff_.resize(n_z, cols);
+  z_pred_.resize(n_z, n);
+  S_.resize(n_z*n_z, n);
+  Tc_.resize(n_x*n_z, n);
+  S_ldlt_.resize(n);
+  S_log_det_.resize(n);
+
+  //transform the sigma points of all tracks into measurement space in one pass
+  const double* p_x = Xsig_pred_.data() + 0*cols;
+  const double* p_y = Xsig_pred_.data() + 1*cols;
+  const double* v   = Xsig_pred_.data() + 2*cols;
+  const double* yaw = Xsig_pred_.data() + 3*cols;
+  double* rho    = Z_diff_.data() + 0*cols;
+  double* phi    = Z_diff_.data() + 1*cols;
+  double* rhodot = Z_diff_.data() + 2*cols;
+  for (int i = 0; i < cols; i++) {
+    rho[i]    = sqrt(p_x[i]*p_x[i] + p_y[i]*p_y[i]);
+    phi[i]    = atan2(p_y[i], p_x[i]);
+    rhodot[i] = (p_x[i]*cos(yaw[i])*v[i] + p_y[i]*sin(yaw[i])*v[i]) / rho[i];
+  }
+  //unwrap the bearings of every track around its sigma point 0 like UKF,
+  //otherwise their weighted mean is wrong when they straddle +-pi
+  for (int s = 1; s < n_sig; s++)
+    for (int t = 0; t < n; t++)
+      phi[s*n + t] = phi[t] + NormalizeAngle(phi[s*n + t] - phi[t]);
+
+  //mean predicted measurement
+  for (int r = 0; r < n_z; r++) {
+    z_pred_.row(r).setZero();
+    for (int s = 0; s < n_sig; s++)
+      z_pred_.row(r) += model_->weights(s) * Z_diff_.row(r).segment(s*n, n);
+  }
+
+  //measurement residual, Zsig is turned into Z_diff in place
+  for (int r = 0; r < n_z; r++)
+    for (int s = 0; s < n_sig; s++)
+      Z_diff_.row(r).segment(s*n, n) -= z_pred_.row(r);
+
+  //innovation covariance matrix S
+  for (int r = 0; r < n_z; r++) {
+    for (int c = r; c < n_z; c++) {
+      auto S_rc = S_.row(r*n_z + c);
+      S_rc.setConstant(model_->R_radar(r, c));
+      for (int s = 0; s < n_sig; s++)
+        S_rc.array() += model_->weights(s) * Z_diff_.row(r).segment(s*n, n).array()
+                                    * Z_diff_.row(c).segment(s*n, n).array();
+      if (c != r)
+        S_.row(c*n_z + r) = S_rc;
+    }
+  }
+
+  //cross correlation matrix Tc
+  for (int r = 0; r < n_x; r++) {
+    for (int c = 0; c < n_z; c++) {
+      auto Tc_rc = Tc_.row(r*n_z + c);
+      Tc_rc.setZero();
+      for (int s = 0; s < n_sig; s++)
+        Tc_rc.array() += model_->weights(s) * X_diff_.row(r).segment(s*n, n).array()
+                                     * Z_diff_.row(c).segment(s*n, n).array();
+    }
+  }
+
+  //S is factorized once per track, the NIS of every candidate measurement of
+  //a track and the gain of its update are solved with that factorization
+  for (int t = 0; t < n; t++) {
+    RadarMeasurement::CovMatrix S;
+    for (int r = 0; r < n_z; r++)
+      for (int c = 0; c < n_z; c++)
+        S(r, c) = S_(r*n_z + c, t);
+    S_ldlt_[t].compute(S);
+    S_log_det_(t) = S_ldlt_[t].vectorD().array().log().sum();
+  }
+}
+
+
+RadarMeasurement::Vector UKFBank::RadarResidual(int track, const RadarMeasurement::Vector& z) const {
+  RadarMeasurement::Vector z_diff = z - z_pred_.col(track);
+  //angle normalization
+  z_diff(1) = NormalizeAngle(z_diff(1));
+  return z_diff;
+}
+
+
+double UKFBank::RadarNis(int track, const RadarMeasurement::Vector& z, double* log_det) const {
+  RadarMeasurement::Vector z_diff = RadarResidual(track, z);
+  *log_det = S_log_det_(track);
+  return z_diff.dot(S_ldlt_[track].solve(z_diff));
+}
+
+
+double UKFBank::LidarNis(int track, const LaserMeasurement::Vector& z, double* log_det) const {
+  const Eigen::LDLT<LaserMeasurement::CovMatrix>& S_ldlt = S_lidar_ldlt_[track];
+  LaserMeasurement::Vector y;
+  y << z(0) - x_(0, track), z(1) - x_(1, track);
+  *log_det = S_ldlt.vectorD().array().log().sum();
+  return y.dot(S_ldlt.solve(y));
+}
+
+
+void UKFBank::UpdateRadar(const vector<RadarUpdate>& updates) {
+  for (size_t k = 0; k < updates.size(); k++) {
+    const int t = updates[k].track;
+    RadarMeasurement::CovMatrix S;
+    RadarMeasurement::GainMatrix Tc;
+    for (int r = 0; r < n_z; r++)
+      for (int c = 0; c < n_z; c++)
+        S(r, c) = S_(r*n_z + c, t);
+    for (int r = 0; r < n_x; r++)
+      for (int c = 0; c < n_z; c++)
+        Tc(r, c) = Tc_(r*n_z + c, t);
+
+    //Kalman gain K = Tc * S^-1
+    RadarMeasurement::GainMatrix K = S_ldlt_[t].solve(Tc.transpose()).transpose();
+
+    //residual
+    RadarMeasurement::Vector z_diff = RadarResidual(t, updates[k].z);
+
+    //update state mean and covariance matrix
+    x_.col(t) += K * z_diff;
+    SetCovariance(t, Covariance(t) - K * S * K.transpose());
+  }
+}
+
+
+void UKFBank::UpdateLidar(const vector<LidarUpdate>& updates) {
+  for (size_t k = 0; k < updates.size(); k++) {
+    const int t = updates[k].track;
+    StateVector x = State(t);
+    StateMatrix P = Covariance(t);
+
+    // H_laser selects px and py, so H*x, H*P*H^T and P*H^T are plain blocks
+    LaserMeasurement::Vector y = updates[k].z - x.head<2>();
+    LaserMeasurement::GainMatrix K = S_lidar_ldlt_[t].solve(P.topRows<2>()).transpose();
+
+    //new estimate
+    x_.col(t) = x + K * y;
+    SetCovariance(t, P - K * P.topRows<2>());
+  }
+}
@@ -0,0 +1,195 @@
+#ifndef UKF_BANK_H
+#define UKF_BANK_H
+
+#include "filter.h"
+#include "ctrv_kernel.h"
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <vector>
+
+/**
+ * A bank of unscented Kalman filters which tracks many objects at once.
+ *
+ * All per-track quantities are stored as structure-of-arrays: every row of the
+ * storage matrices holds one component (e.g. the px of sigma point 3) for all
+ * tracks contiguously. The CTRV sigma point propagation and the radar
+ * measurement transform therefore run as a single pass over plain arrays that
+ * the compiler can vectorize, instead of one small fixed-size loop per track.
+ *
+ * Sigma point columns are laid out sigma-major: column s*n_tracks + t holds
+ * sigma point s of track t.
+ */
+class UKFBank {
+public:
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> SoaMatrix;
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> SoaMatrixF;
+
+  /**
+   * A radar measurement which is assigned to one track of the bank
+   */
+  struct RadarUpdate {
+    int track;
+    RadarMeasurement::Vector z;
+  };
+
+  /**
+   * A lidar measurement which is assigned to one track of the bank
+   */
+  struct LidarUpdate {
+    int track;
+    LaserMeasurement::Vector z;
+  };
+
+  ///* Process noise standard deviation longitudinal acceleration in m/s^2
+  double std_a_;
+
+  ///* Process noise standard deviation yaw acceleration in rad/s^2
+  double std_yawdd_;
+
+  ///* sensor noise and sigma point weights shared with the single track filters
+  const FilterModelConfig* model_;
+
+  ///* Kernel used for the sigma point prediction
+  CtrvKernel ctrv_kernel_;
+
+  ///* Precision of the sigma point prediction
+  CtrvPrecision ctrv_precision_;
+
+  ///* Evaluation of the sine and cosine of the sigma point prediction
+  TrigMode trig_mode_;
+
+  /**
+   * Constructor
+   */
+  UKFBank(double std_a = 2.0, double std_yawdd = 0.5);
+
+  /**
+   * Adds a new track with initial state x and covariance P
+   * @return index of the new track
+   */
+  int AddTrack(const StateVector& x, const StateMatrix& P = StateMatrix::Identity());
+
+  /**
+   * Removes a track. The last track is moved into the freed index.
+   */
+  void RemoveTrack(int track);
+
+  /**
+   * Number of tracks in the bank
+   */
+  int Size() const { return n_tracks_; }
+
+  /**
+   * State vector and covariance matrix of a single track
+   */
+  StateVector State(int track) const;
+  StateMatrix Covariance(int track) const;
+
+  /**
+   * Predicts sigma points, the state and the state covariance matrix of all
+   * tracks by the same time step
+   * @param delta_t Time between k and k+1 in s
+   */
+  void Prediction(double delta_t);
+
+  /**
+   * Predicts all tracks, each by its own time step
+   * @param delta_t Array with one time step in s per track
+   */
+  void Prediction(const double* delta_t);
+
+  /**
+   * Transforms the predicted sigma points of all tracks into radar measurement
+   * space and computes the predicted measurement, innovation covariance and
+   * cross correlation per track. Must be called after Prediction and before
+   * UpdateRadar.
+   */
+  void PredictRadarMeasurement();
+
+  /**
+   * NIS of a radar measurement z for one track and the log determinant of its
+   * innovation covariance, from the factorization of S which the last
+   * PredictRadarMeasurement call cached
+   */
+  double RadarNis(int track, const RadarMeasurement::Vector& z, double* log_det) const;
+
+  /**
+   * NIS of a lidar measurement z for one track and the log determinant of its
+   * innovation covariance, from the factorization of S which the last
+   * Prediction cached. Valid between Prediction and the updates.
+   */
+  double LidarNis(int track, const LaserMeasurement::Vector& z, double* log_det) const;
+
+  /**
+   * Updates the given tracks with their radar measurement using the result of
+   * the last PredictRadarMeasurement call. Every track may appear only once in
+   * the radar and lidar updates after a prediction, as the association
+   * assigns them, because the gains come from the cached factorizations of S.
+   */
+  void UpdateRadar(const std::vector<RadarUpdate>& updates);
+
+  /**
+   * Updates the given tracks with the linear Kalman filter equations for a
+   * lidar measurement, with the factorization of S cached by the last
+   * Prediction. Every track may appear only once, see UpdateRadar.
+   */
+  void UpdateLidar(const std::vector<LidarUpdate>& updates);
+
+private:
+  int n_tracks_;
+
+  ///* state of track t in column t, one row per state component
+  SoaMatrix x_;
+
+  ///* covariance of track t in column t, row r*n_x+c holds P(r,c)
+  SoaMatrix P_;
+
+  ///* augmented sigma points (sigma-major columns)
+  SoaMatrix Xsig_aug_;
+
+  ///* predicted sigma points (sigma-major columns)
+  SoaMatrix Xsig_pred_;
+
+  ///* predicted sigma points minus predicted mean, yaw normalized
+  SoaMatrix X_diff_;
+
+  ///* sigma points in radar measurement space minus predicted measurement
+  SoaMatrix Z_diff_;
+
+  ///* predicted radar measurement per track
+  SoaMatrix z_pred_;
+
+  ///* radar innovation covariance per track, row r*n_z+c holds S(r,c)
+  SoaMatrix S_;
+
+  ///* radar cross correlation per track, row r*n_z+c holds Tc(r,c)
+  SoaMatrix Tc_;
+
+  ///* factorization of the radar innovation covariance per track and the
+  ///* log of its determinant, shared by the NIS and the gain
+  std::vector<Eigen::LDLT<RadarMeasurement::CovMatrix> > S_ldlt_;
+  Eigen::VectorXd S_log_det_;
+
+  ///* factorization of the lidar innovation covariance per track, valid
+  ///* from Prediction or AddTrack until the track is updated
+  std::vector<Eigen::LDLT<LaserMeasurement::CovMatrix>,
+              Eigen::aligned_allocator<Eigen::LDLT<LaserMeasurement::CovMatrix> > > S_lidar_ldlt_;
+
+  ///* time step per track used by Prediction(double)
+  Eigen::VectorXd dt_;
+
+  ///* single precision copies of the sigma points and time steps of
+  ///* CTRV_PRECISION_FLOAT
+  SoaMatrixF Xsig_aug_f_;
+  SoaMatrixF Xsig_pred_f_;
+  Eigen::VectorXf dt_f_;
+
+  void ComputeMeanAndCovariance();
+  void SetCovariance(int track, const StateMatrix& P);
+  void FactorLidarCovariance(int track);
+  // residual of a radar measurement with the bearing normalized, shared by
+  // the association and the update so both see the same innovation
+  RadarMeasurement::Vector RadarResidual(int track, const RadarMeasurement::Vector& z) const;
+};
+
+#endif /* UKF_BANK_H */